@@ -85,6 +85,13 @@ typedef struct LilvNodeImpl        LilvNode;         /**< Typed Value. */
 typedef struct LilvWorldImpl       LilvWorld;        /**< Lilv World. */
 typedef struct LilvInstanceImpl    LilvInstance;     /**< Plugin instance. */
 typedef struct LilvStateImpl       LilvState;        /**< Plugin state. */
+typedef struct LilvMatchesImpl     LilvMatches;      /**< Match iterator. */
+typedef struct LilvInstancePoolImpl LilvInstancePool; /**< Instance pool. */
+typedef struct LilvPortBuffersImpl  LilvPortBuffers;  /**< Port buffers. */
+typedef struct LilvGraphImpl        LilvGraph;        /**< Instance graph. */
+typedef struct LilvBufferPlanImpl   LilvBufferPlan;   /**< Buffer plan. */
+typedef struct LilvControlQueueImpl LilvControlQueue; /**< Control queue. */
+typedef struct LilvStateSaverImpl   LilvStateSaver;   /**< State saver. */
 
 typedef void LilvIter;           /**< Collection iterator */
 typedef void LilvPluginClasses;  /**< set<PluginClass>. */
@@ -519,29 +526,115 @@ lilv_world_new(void);
    Enable/disable language filtering.
    Language filtering applies to any functions that return (a) value(s).
    With filtering enabled, Lilv will automatically return the best value(s)
-   for the current LANG.  With filtering disabled, all matching values will
-   be returned regardless of language tag.  Filtering is enabled by default.
+   for the current language.  With filtering disabled, all matching values
+   will be returned regardless of language tag.  Filtering is enabled by
+   default.
 */
 #define LILV_OPTION_FILTER_LANG "http://drobilla.net/ns/lilv#filter-lang"
 
+/**
+   Set the language used for language filtering.
+
+   The value is a string in either LANG style (e.g. "en_CA.utf-8") or language
+   tag style (e.g. "en-ca").  By default, the language is taken from the LANG
+   environment variable when the world is created, and LANG is not read again
+   unless this option is set to NULL, which restores the default.
+*/
+#define LILV_OPTION_LANG "http://drobilla.net/ns/lilv#lang"
+
 /**
    Enable/disable dynamic manifest support.
    Dynamic manifest data will only be loaded if this option is true.
 */
 #define LILV_OPTION_DYN_MANIFEST "http://drobilla.net/ns/lilv#dyn-manifest"
 
+/**
+   Set the number of unused plugin libraries to keep open.
+
+   By default, a library is closed as soon as its last instance is freed, so
+   instantiating the same plugin again must load it again.  If this is set to
+   an integer greater than zero, up to that many unused libraries are kept
+   open, and the least recently used ones are closed first.
+*/
+#define LILV_OPTION_KEEP_LIBS "http://drobilla.net/ns/lilv#keep-libs"
+
+/**
+   Set the maximum total size of unused plugin libraries to keep open.
+
+   The value is an integer size in megabytes, where zero (the default) means
+   no limit.  This only has an effect if LILV_OPTION_KEEP_LIBS is also set.
+*/
+#define LILV_OPTION_KEEP_LIBS_SIZE "http://drobilla.net/ns/lilv#keep-libs-size"
+
+/**
+   Set the number of threads that run plugin work.
+
+   The value is a positive integer, the default is 1.  The threads are shared
+   by every instance with a worker provided by lilv, and are started when the
+   first such instance is created, so this must be set before then.
+*/
+#define LILV_OPTION_WORKER_THREADS "http://drobilla.net/ns/lilv#worker-threads"
+
 /**
    Set an option option for `world`.
 
    Currently recognized options:
    @ref LILV_OPTION_FILTER_LANG
+   @ref LILV_OPTION_LANG
    @ref LILV_OPTION_DYN_MANIFEST
+   @ref LILV_OPTION_KEEP_LIBS
+   @ref LILV_OPTION_KEEP_LIBS_SIZE
+   @ref LILV_OPTION_WORKER_THREADS
 */
 LILV_API void
 lilv_world_set_option(LilvWorld*      world,
                       const char*     uri,
                       const LilvNode* value);
 
+/**
+   Start loading all plugin libraries in a background thread.
+
+   This opens the shared library of every plugin, so that the first
+   instantiation of each plugin does not need to wait for it to be loaded from
+   disk.  A library stays loaded until it is first instantiated, after which
+   it is closed as usual (see @ref LILV_OPTION_KEEP_LIBS), or until its bundle
+   is unloaded, this function is called again, or the world is freed.  Only
+   static initialisers in the libraries are run, plugin descriptors are not
+   accessed until lilv_plugin_instantiate().
+
+   @return Zero if the thread was started.
+*/
+LILV_API int
+lilv_world_preload_libraries(LilvWorld* world);
+
+/**
+   Load all plugin data and make the world read-only.
+
+   Many functions that take a const pointer load data lazily the first time
+   they are called, so a world can not normally be used by several threads.
+   This function does all of that loading in advance.
+
+   After this call, functions that only get information from the world, or
+   from the plugins, ports, and classes in it, may be called from any number
+   of threads at once.  Functions that load or unload data, and
+   lilv_world_set_option(), fail with an error.  Nodes returned by these
+   functions refer to the world without a reference count, so they, and
+   their duplicates, are made and freed without locking.  Nodes made with
+   lilv_new_uri() and friends still take a short lock, as do their
+   duplicates.  Plugin instantiation and state functions are not covered by
+   this guarantee.
+
+   @return Zero on success.
+*/
+LILV_API int
+lilv_world_freeze(LilvWorld* world);
+
+/**
+   Return true iff `world` has been frozen with lilv_world_freeze().
+*/
+LILV_API bool
+lilv_world_is_frozen(const LilvWorld* world);
+
 /**
    Destroy the world, mwahaha.
    It is safe to call this function on NULL.
@@ -676,6 +769,74 @@ lilv_world_find_nodes(LilvWorld*      world,
                       const LilvNode* predicate,
                       const LilvNode* object);
 
+/**
+   Function called for every match found by lilv_world_foreach().
+   @param node The matching node, which is only valid during this call.
+   @param data The user data passed to lilv_world_foreach().
+   @return Non-zero to stop iteration.
+*/
+typedef int (*LilvMatchFunc)(const LilvNode* node, void* data);
+
+/**
+   Call `func` for each node matching a triple pattern.
+
+   The pattern is the same as for lilv_world_find_nodes(), but matches are
+   read directly from the model and nodes are not copied, so no memory is
+   allocated for each match.  Literals are filtered by language in the same
+   way as for lilv_world_find_nodes().
+
+   @return The number of matches passed to `func`.
+*/
+LILV_API unsigned
+lilv_world_foreach(LilvWorld*      world,
+                   const LilvNode* subject,
+                   const LilvNode* predicate,
+                   const LilvNode* object,
+                   LilvMatchFunc   func,
+                   void*           data);
+
+/**
+   Return an iterator over nodes matching a triple pattern.
+
+   This is an iterator version of lilv_world_foreach().  Nodes returned by
+   lilv_matches_get() are borrowed from the world and are only valid until the
+   next call to lilv_matches_next() or lilv_matches_free().  The world must not
+   be modified while the iterator is in use.
+
+   @return A new iterator which must be freed with lilv_matches_free(), or NULL
+   if the pattern is invalid.
+*/
+LILV_API LilvMatches*
+lilv_world_match(LilvWorld*      world,
+                 const LilvNode* subject,
+                 const LilvNode* predicate,
+                 const LilvNode* object);
+
+/**
+   Return true iff `matches` is at the end of the results.
+*/
+LILV_API bool
+lilv_matches_end(const LilvMatches* matches);
+
+/**
+   Return the current match, or NULL if `matches` is at the end.
+   The returned node must not be freed and is only valid until `matches` moves.
+*/
+LILV_API const LilvNode*
+lilv_matches_get(const LilvMatches* matches);
+
+/**
+   Move `matches` to the next result.
+*/
+LILV_API void
+lilv_matches_next(LilvMatches* matches);
+
+/**
+   Free a match iterator.
+*/
+LILV_API void
+lilv_matches_free(LilvMatches* matches);
+
 /**
    Find a single node that matches a pattern.
    Exactly one of `subject`, `predicate`, `object` must be NULL.
@@ -690,6 +851,82 @@ lilv_world_get(LilvWorld*      world,
                const LilvNode* predicate,
                const LilvNode* object);
 
+/**
+   Get the values of several properties of a subject at once.
+
+   Each value is the first that lilv_world_match() returns for the subject and
+   predicate, so literals are filtered by language as with
+   lilv_world_find_nodes(), but the subject's statements are only scanned
+   once.  This makes it much faster to read many properties of one resource,
+   for example to display information about a plugin or port.
+
+   @param world The world.
+   @param subject Subject of statements.
+   @param n_predicates The length of `predicates` and `values`.
+   @param predicates Predicates to get the values of.
+   @param values Set to the value of the corresponding predicate, or NULL.
+   Returned values must be freed by the caller with lilv_node_free().
+   @return The number of predicates for which a value was found.
+*/
+LILV_API unsigned
+lilv_world_get_batch(LilvWorld*             world,
+                     const LilvNode*        subject,
+                     unsigned               n_predicates,
+                     const LilvNode* const* predicates,
+                     LilvNode**             values);
+
+/**
+   A term in a query pattern, which is either a node or a variable.
+*/
+typedef struct {
+	const LilvNode* node;  /**< Node, or NULL if this term is a variable. */
+	unsigned        var;   /**< Index of variable if `node` is NULL. */
+} LilvQueryTerm;
+
+/**
+   A triple pattern for lilv_world_query().
+*/
+typedef struct {
+	LilvQueryTerm subject;    /**< Subject of pattern. */
+	LilvQueryTerm predicate;  /**< Predicate of pattern. */
+	LilvQueryTerm object;     /**< Object of pattern. */
+} LilvQueryPattern;
+
+/**
+   Function called for every solution found by lilv_world_query().
+   @param bindings The value of each variable, indexed by variable number.
+   These nodes are only valid during this call.
+   @param data The user data passed to lilv_world_query().
+   @return Non-zero to stop the query.
+*/
+typedef int (*LilvQueryFunc)(const LilvNode* const* bindings, void* data);
+
+/**
+   Find all solutions to a conjunction of triple patterns.
+
+   A variable that appears in several patterns must have the same value in
+   each, so for example, all presets for a plugin with their labels can be
+   found with the patterns (?0 lv2:appliesTo plugin) and (?0 rdfs:label ?1).
+   Patterns are joined in order of selectivity, so the subject or object of
+   each search is bound wherever possible.  No memory is allocated for each
+   solution, and values are not filtered by language.
+
+   @param world The world.
+   @param n_patterns The number of elements in `patterns`.
+   @param patterns The patterns which must all match.
+   @param n_vars The number of variables, used as indices 0 to `n_vars` - 1.
+   @param func Function called with the bindings of every solution, or NULL.
+   @param data User data passed to `func`.
+   @return The number of solutions found.
+*/
+LILV_API unsigned
+lilv_world_query(LilvWorld*              world,
+                 unsigned                n_patterns,
+                 const LilvQueryPattern* patterns,
+                 unsigned                n_vars,
+                 LilvQueryFunc           func,
+                 void*                   data);
+
 /**
    Return true iff a statement matching a certain pattern exists.
 
@@ -810,6 +1047,18 @@ LILV_API LilvNodes*
 lilv_plugin_get_value(const LilvPlugin* p,
                       const LilvNode*   predicate);
 
+/**
+   Call `func` for each value of `predicate` on the plugin.
+   This is a non-allocating version of lilv_plugin_get_value(), see
+   lilv_world_foreach() for details.
+   @return The number of values passed to `func`.
+*/
+LILV_API unsigned
+lilv_plugin_foreach_value(const LilvPlugin* p,
+                          const LilvNode*   predicate,
+                          LilvMatchFunc     func,
+                          void*             data);
+
 /**
    Return whether a feature is supported by a plugin.
    This will return true if the feature is an optional or required feature
@@ -1054,6 +1303,37 @@ lilv_plugin_write_manifest_entry(LilvWorld*        world,
 LILV_API LilvNodes*
 lilv_plugin_get_related(const LilvPlugin* plugin, const LilvNode* type);
 
+/**
+   An entry in the preset index, for lilv_plugin_get_presets().
+
+   All nodes are owned by the world.
+*/
+typedef struct {
+	const LilvNode* uri;     /**< Preset URI. */
+	const LilvNode* plugin;  /**< Plugin the preset applies to. */
+	const LilvNode* bundle;  /**< Bundle the preset was found in. */
+	const LilvNode* label;   /**< Label from the manifest, or NULL. */
+	const LilvNode* bank;    /**< Bank (pset:bank), or NULL. */
+	const LilvNode* file;    /**< File with preset data, or NULL. */
+} LilvPresetInfo;
+
+/**
+   Get the presets for `plugin` from the preset index.
+
+   Presets described in bundle manifests are indexed when the bundle is
+   loaded, so unlike lilv_plugin_get_related() this does not search the
+   world, and no preset data is loaded.  Use lilv_world_load_presets() to
+   load states for some or all of the returned presets.
+
+   @param plugin The plugin.
+   @param presets Set to an array of presets sorted by URI, which is valid
+   until a bundle is loaded or unloaded.
+   @return The number of elements in `presets`.
+*/
+LILV_API unsigned
+lilv_plugin_get_presets(const LilvPlugin*      plugin,
+                        const LilvPresetInfo** presets);
+
 /**
    @}
    @name Port
@@ -1079,6 +1359,16 @@ lilv_port_get_value(const LilvPlugin* plugin,
                     const LilvPort*   port,
                     const LilvNode*   predicate);
 
+/**
+   Port analog of lilv_plugin_foreach_value().
+*/
+LILV_API unsigned
+lilv_port_foreach_value(const LilvPlugin* plugin,
+                        const LilvPort*   port,
+                        const LilvNode*   predicate,
+                        LilvMatchFunc     func,
+                        void*             data);
+
 /**
    Get a single property value of a port.
 
@@ -1201,6 +1491,15 @@ lilv_port_get_scale_points(const LilvPlugin* plugin,
    @{
 */
 
+/**
+   File name extension for binary state files.
+
+   State saved with lilv_state_save() to a file name with this extension is
+   written in a compact binary format with raw atom bodies, which is much
+   faster to save and load than Turtle, but only readable by lilv.
+*/
+#define LILV_STATE_BINARY_EXTENSION ".lilvstate"
+
 /**
    Load a state snapshot from the world RDF model.
    This function can be used to load the default state of a plugin by passing
@@ -1229,6 +1528,10 @@ lilv_state_new_from_world(LilvWorld*      world,
    This function parses the file separately to create the state, it does not
    parse the file into the world model, i.e. the returned state is the only
    new memory consumed once this function returns.
+
+   Binary state files (see LILV_STATE_BINARY_EXTENSION) are detected by their
+   content and loaded by mapping the file, in which case `subject` is ignored.
+   Deltas saved with lilv_state_save_delta() are applied to their base.
 */
 LILV_API LilvState*
 lilv_state_new_from_file(LilvWorld*      world,
@@ -1244,6 +1547,36 @@ lilv_state_new_from_string(LilvWorld*    world,
                            LV2_URID_Map* map,
                            const char*   str);
 
+/**
+   Load states for several presets from the preset index.
+
+   This parses every preset file once, regardless of how many presets it
+   contains, and makes states directly from the parsed data without loading
+   it into the world.  This is much faster than loading each preset with
+   lilv_world_load_resource() and lilv_state_new_from_world(), particularly
+   for banks of many presets in a few files.
+
+   Files may be parsed by several threads, in which case `map` must be
+   thread-safe.
+
+   @param world The world.
+   @param map URID mapper.
+   @param n_presets Number of elements in `presets` and `states`.
+   @param presets Presets to load, for example from lilv_plugin_get_presets().
+   @param states Set to the state for each preset, or NULL on error.  Each
+   state must be freed with lilv_state_free().
+   @param n_threads Maximum number of threads to use, or zero to use the
+   number of processors.
+   @return The number of states loaded.
+*/
+LILV_API unsigned
+lilv_world_load_presets(LilvWorld*            world,
+                        LV2_URID_Map*         map,
+                        unsigned              n_presets,
+                        const LilvPresetInfo* presets,
+                        LilvState**           states,
+                        unsigned              n_threads);
+
 /**
    Function to get a port value.
    @param port_symbol The symbol of the port.
@@ -1274,10 +1607,10 @@ typedef const void* (*LilvGetPortValueFunc)(const char* port_symbol,
    not be referred to directly in state (a temporary directory is appropriate).
 
    @param copy_dir Directory of copies of files in `file_dir` (or NULL).  This
-   directory will have the same structure as `file_dir` but with possibly
-   modified file names to distinguish different revisions.  If you only care
-   about saving one state snapshot, it can be the same as `save_dir`.  Plugin
-   state will refer to files in this directory.
+   directory is a store of copies named by the hash of their contents, so a
+   file is only copied once no matter how many snapshots refer to it.  If you
+   only care about saving one state snapshot, it can be the same as
+   `save_dir`.  Plugin state will refer to files in this directory.
 
    @param save_dir Directory of files created by plugin during save (or NULL).
    If the state will be saved, this should be the bundle directory later passed
@@ -1337,6 +1670,25 @@ lilv_state_new_from_instance(const LilvPlugin*          plugin,
                              uint32_t                   flags,
                              const LV2_Feature *const * features);
 
+/**
+   Create a new in-memory state snapshot from a plugin instance.
+
+   This is like lilv_state_new_from_instance() with no directories, but is
+   intended for frequent snapshots like undo history.  Paths are stored as
+   given by the plugin, so no files are copied or linked.
+
+   The snapshot can be restored with lilv_state_restore() without touching
+   the filesystem, provided the files it refers to still exist.
+*/
+LILV_API LilvState*
+lilv_state_new_snapshot(const LilvPlugin*          plugin,
+                        LilvInstance*              instance,
+                        LV2_URID_Map*              map,
+                        LilvGetPortValueFunc       get_value,
+                        void*                      user_data,
+                        uint32_t                   flags,
+                        const LV2_Feature *const * features);
+
 /**
    Free `state`.
 */
@@ -1345,10 +1697,39 @@ lilv_state_free(LilvState* state);
 
 /**
    Return true iff `a` is equivalent to `b`.
+
+   Port values and properties are compared by a hash computed when each state
+   is made, so only files referred to by properties are compared in full.
 */
 LILV_API bool
 lilv_state_equals(const LilvState* a, const LilvState* b);
 
+/**
+   Size of a state hash in bytes.
+*/
+#define LILV_STATE_HASH_SIZE 16
+
+/**
+   Get a hash of the contents of `state`.
+
+   The hash covers the plugin URI, label, port values, and properties, with
+   files referred to by properties hashed by content, so states have equal
+   hashes iff they are equivalent.  Port values and properties are hashed
+   once when the state is made, but files are hashed on every call, so the
+   hash covers their contents at that time.  States are not modified after
+   they are made, except by lilv_state_set_label(), so this may be called for
+   the same state from several threads at once, but not during a call to
+   lilv_state_set_label().
+
+   Property keys are URIDs, so hashes are only comparable between states that
+   use the same URID map.
+
+   @param state The state.
+   @param hash Set to the hash, which is LILV_STATE_HASH_SIZE bytes long.
+*/
+LILV_API void
+lilv_state_get_hash(const LilvState* state, uint8_t* hash);
+
 /**
    Return the number of properties in `state`.
 */
@@ -1455,10 +1836,16 @@ lilv_state_restore(const LilvState*           state,
 
    The format of state on disk is compatible with that defined in the LV2
    preset extension, i.e. this function may be used to save presets which can
-   be loaded by any host.
+   be loaded by any host.  The state file is written to a temporary file which
+   replaces any existing one when complete.
 
    If `uri` is NULL, the preset URI will be a file URI, but the bundle
    can safely be moved (i.e. the state file will use "<>" as the subject).
+
+   If `filename` ends with LILV_STATE_BINARY_EXTENSION, the state is written
+   in binary format and is not added to the bundle manifest.  Converting
+   between formats is done by loading a state and saving it with the other
+   extension.
 */
 LILV_API int
 lilv_state_save(LilvWorld*                 world,
@@ -1469,6 +1856,128 @@ lilv_state_save(LilvWorld*                 world,
                 const char*                dir,
                 const char*                filename);
 
+/**
+   Save several states into one bundle.
+
+   This is like calling lilv_state_save() for each state, but the manifest is
+   only read and written once, so saving many states into the same bundle
+   takes time proportional to the number of states.
+
+   @param world The world.
+   @param map URID mapper.
+   @param unmap URID unmapper.
+   @param n_states The number of states to save.
+   @param states The states to save.
+   @param uris The URI of each state, may be NULL, as may any element.
+   @param dir Path of the bundle directory to save into.
+   @param filenames The path of each state file relative to `dir`.
+   @return Zero if every state was saved, otherwise the first error.
+*/
+LILV_API int
+lilv_state_save_batch(LilvWorld*              world,
+                      LV2_URID_Map*           map,
+                      LV2_URID_Unmap*         unmap,
+                      unsigned                n_states,
+                      const LilvState* const* states,
+                      const char* const*      uris,
+                      const char*             dir,
+                      const char* const*      filenames);
+
+/**
+   Save the changes from a saved state to `state` as a delta.
+
+   Only the port values and properties that differ from `base` are written,
+   so this is much faster than lilv_state_save() for large states with few
+   changes.  The delta is always written in the binary format (so `filename`
+   should end with LILV_STATE_BINARY_EXTENSION) and refers to the file that
+   `base` was saved to, which must be `base_filename` in `dir`.  Loading the
+   delta with lilv_state_new_from_file() loads the base and applies the
+   changes.  The delta records the random ID written to a binary base file
+   (or the hash of any other base file), so loading fails if the base has
+   been overwritten since.
+
+   The base may itself be a delta, but every file in the chain is read to
+   load the state, so hosts should periodically compact a chain by saving
+   the state in full with lilv_state_save().
+
+   @param base The state saved to `base_filename`.
+   @param base_filename The file name of `base` in `dir`.
+   @param state The state to save.
+   @param uri URI of state, may be NULL.
+   @param dir Path of the bundle directory to save into.
+   @param filename Path of the delta file relative to `dir`.
+*/
+LILV_API int
+lilv_state_save_delta(LilvWorld*       world,
+                      LV2_URID_Map*    map,
+                      LV2_URID_Unmap*  unmap,
+                      const LilvState* base,
+                      const char*      base_filename,
+                      const LilvState* state,
+                      const char*      uri,
+                      const char*      dir,
+                      const char*      filename);
+
+/**
+   Function called when a state has been saved by a LilvStateSaver.
+   @param path The absolute path of the state file.
+   @param status Zero on success, -1 if the save was superseded by a later
+   save of the same state, otherwise an error code like lilv_state_save().
+   @param user_data The user_data passed to lilv_state_saver_save().
+*/
+typedef void (*LilvStateSavedFunc)(const char* path,
+                                   int         status,
+                                   void*       user_data);
+
+/**
+   Create a new saver which saves states in a background thread.
+
+   The `map` and `unmap` features are used by the background thread, so they
+   must be safe to call from any thread.
+*/
+LILV_API LilvStateSaver*
+lilv_state_saver_new(LV2_URID_Map* map, LV2_URID_Unmap* unmap);
+
+/**
+   Finish all queued saves, call their callbacks, and free `saver`.
+*/
+LILV_API void
+lilv_state_saver_free(LilvStateSaver* saver);
+
+/**
+   Queue a state to be saved like lilv_state_save() in the background.
+
+   The saver takes ownership of `state`, which must not be used afterwards.
+   A state from lilv_state_new_snapshot() is a cheap choice.  The state file
+   is written to a temporary file which is renamed when complete, so a crash
+   never leaves a partially written state.
+
+   If a save of the same state (with the same `uri`, or if `uri` is NULL, the
+   same file) is still queued, it is replaced by this one.
+
+   @return Zero if the save was queued.
+*/
+LILV_API int
+lilv_state_saver_save(LilvStateSaver*    saver,
+                      LilvState*         state,
+                      const char*        uri,
+                      const char*        dir,
+                      const char*        filename,
+                      LilvStateSavedFunc func,
+                      void*              user_data);
+
+/**
+   Call the callbacks of all finished saves and free their states.
+
+   This should be called regularly, for example in the UI thread.  Since it
+   frees states, it must not be called at the same time as functions that
+   load or unload data in the world the states came from.
+
+   @return The number of callbacks called.
+*/
+LILV_API unsigned
+lilv_state_saver_dispatch(LilvStateSaver* saver);
+
 /**
    Save state to a string.  This function does not use the filesystem.
 
@@ -1596,6 +2105,11 @@ struct LilvInstanceImpl {
    eventually free it with lilv_instance_free().
    `features` is a NULL-terminated array of features the host supports.
    NULL may be passed if the host supports no additional features.
+
+   If the plugin supports the LV2 worker extension and `features` does not
+   contain a work:schedule feature, lilv provides one, and runs the work in
+   a pool of threads shared by all instances.  The host must then call
+   lilv_instance_end_run() after every run.
    @return NULL if instantiation failed.
 */
 LILV_API LilvInstance*
@@ -1603,6 +2117,52 @@ lilv_plugin_instantiate(const LilvPlugin*        plugin,
                         double                   sample_rate,
                         const LV2_Feature*const* features);
 
+/**
+   Result of a plugin instantiation request.
+*/
+typedef enum {
+	LILV_INSTANTIATE_SUCCESS,        /**< Instance created. */
+	LILV_INSTANTIATE_ERR_DATA,       /**< Invalid or missing plugin data. */
+	LILV_INSTANTIATE_ERR_LIBRARY,    /**< Failed to open plugin library. */
+	LILV_INSTANTIATE_ERR_NOT_FOUND,  /**< Plugin not found in library. */
+	LILV_INSTANTIATE_ERR_FAILED      /**< Plugin failed to instantiate. */
+} LilvInstantiateStatus;
+
+/**
+   A request to instantiate a plugin, for lilv_plugins_instantiate_batch().
+*/
+typedef struct {
+	const LilvPlugin*        plugin;       /**< Plugin to instantiate. */
+	double                   sample_rate;  /**< Sample rate. */
+	const LV2_Feature*const* features;     /**< Features, or NULL. */
+	LilvInstance*            instance;     /**< Set to new instance, or NULL. */
+	LilvInstantiateStatus    status;       /**< Set to result of request. */
+} LilvInstantiateRequest;
+
+/**
+   Instantiate several plugins in parallel.
+
+   This is equivalent to calling lilv_plugin_instantiate() for every request,
+   except that the plugins are instantiated by a pool of threads, which is
+   much faster when plugins do a lot of work when instantiated.  The result
+   of each request is written to its `instance` and `status` fields, so
+   instances are returned in request order.
+
+   Plugin data is loaded on the calling thread, but the plugins themselves
+   are instantiated on other threads, so `features` must be safe to use from
+   several threads at once (for example, a thread-safe URID map).
+
+   @param n_requests Number of elements in `requests`.
+   @param requests Array of requests, results are written here.
+   @param n_threads Maximum number of threads to use, or zero to use the
+   number of processors.
+   @return The number of instances created.
+*/
+LILV_API unsigned
+lilv_plugins_instantiate_batch(unsigned                n_requests,
+                               LilvInstantiateRequest* requests,
+                               unsigned                n_threads);
+
 /**
    Free a plugin instance.
    It is safe to call this function on NULL.
@@ -1611,6 +2171,102 @@ lilv_plugin_instantiate(const LilvPlugin*        plugin,
 LILV_API void
 lilv_instance_free(LilvInstance* instance);
 
+/**
+   Return true iff lilv provided a worker for `instance`.
+*/
+LILV_API bool
+lilv_instance_has_worker(const LilvInstance* instance);
+
+/**
+   Finish a run of `instance`.
+
+   If lilv provided a worker for `instance`, this delivers any responses
+   from the worker to the plugin, then calls its end_run() method.  It must
+   be called in the audio thread after lilv_instance_run(), and is realtime
+   safe.  Otherwise, this does nothing.
+*/
+LILV_API void
+lilv_instance_end_run(LilvInstance* instance);
+
+/**
+   Wait until the worker lilv provided for `instance` has run all scheduled work.
+
+   The responses are delivered by the next lilv_instance_end_run().  This is
+   not realtime safe, but is useful for offline rendering, where the result
+   must not depend on how long work takes.  If lilv did not provide a worker
+   for `instance`, this does nothing.
+*/
+LILV_API void
+lilv_instance_wait_for_work(LilvInstance* instance);
+
+/**
+   The number of buckets in a LilvRunStats histogram.
+*/
+#define LILV_RUN_STATS_BUCKETS 528
+
+/**
+   Statistics about the runs of an instance.
+
+   Durations are in nanoseconds, measured with a monotonic clock.  The
+   histogram is log-linear, with 16 buckets for every power of two, so the
+   value of a bucket is accurate to within about 6%.
+*/
+typedef struct {
+	uint64_t n_runs;      /**< Number of timed runs. */
+	uint64_t n_overruns;  /**< Number of runs longer than the budget. */
+	uint64_t total_ns;    /**< Total time of all runs. */
+	uint64_t max_ns;      /**< Time of the longest run. */
+	uint64_t last_ns;     /**< Time of the last run. */
+	uint64_t histogram[LILV_RUN_STATS_BUCKETS];  /**< Runs per duration. */
+} LilvRunStats;
+
+/**
+   Enable collecting run statistics for `instance`.
+
+   This allocates memory, so must not be called in the audio thread, or
+   while `instance` is being run.  It may be called again to change the
+   budget, and statistics are kept until the instance is freed.
+
+   @param budget_ns Run duration that counts as an overrun, or zero.
+*/
+LILV_API void
+lilv_instance_enable_run_stats(LilvInstance* instance, uint64_t budget_ns);
+
+/**
+   Run `instance` like lilv_instance_run(), and time the run.
+
+   If run statistics are enabled for `instance`, this adds the duration of
+   the run to them.  This is realtime safe, and adds only the cost of
+   reading the clock twice.
+*/
+LILV_API void
+lilv_instance_run_timed(LilvInstance* instance, uint32_t sample_count);
+
+/**
+   Copy the run statistics of `instance` to `stats`.
+
+   This may be called from any thread, such as a monitoring thread, while
+   the instance is running.  The copy is consistent, it never contains a
+   partially recorded run.
+
+   @return Zero on success, or non-zero if run statistics are not enabled.
+*/
+LILV_API int
+lilv_instance_get_run_stats(const LilvInstance* instance,
+                            LilvRunStats*       stats);
+
+/**
+   Return the lowest duration that falls in histogram bucket `bucket`.
+*/
+LILV_API uint64_t
+lilv_run_stats_bucket_min(unsigned bucket);
+
+/**
+   Return the approximate run duration at `percentile` (0 to 100).
+*/
+LILV_API uint64_t
+lilv_run_stats_get_percentile(const LilvRunStats* stats, double percentile);
+
 #ifndef LILV_INTERNAL
 
 /**
@@ -1717,6 +2373,307 @@ lilv_instance_get_handle(const LilvInstance* instance)
 
 #endif /* LILV_INTERNAL */
 
+/**
+   @}
+   @name Instance Pool
+   @{
+*/
+
+/**
+   Create a pool of ready instances of `plugin`.
+
+   The pool keeps `size` activated instances ready, so a realtime thread can
+   get a new instance without waiting for instantiation.  A background thread
+   creates more instances as they are taken, and resets instances that are
+   returned to the pool so they can be used again.
+
+   `features` is passed to every instantiation, and must remain valid until
+   the pool is freed.  If `state` is not NULL, it is restored (without port
+   values) to every instance before it is activated, and must also remain
+   valid until the pool is freed.
+
+   @return NULL if the plugin could not be instantiated.
+*/
+LILV_API LilvInstancePool*
+lilv_instance_pool_new(const LilvPlugin*        plugin,
+                       double                   sample_rate,
+                       const LV2_Feature*const* features,
+                       const LilvState*         state,
+                       unsigned                 size);
+
+/**
+   Free `pool` and all of the instances in it.
+
+   Instances taken from the pool and not returned are not freed, they must be
+   deactivated and freed with lilv_instance_free().
+*/
+LILV_API void
+lilv_instance_pool_free(LilvInstancePool* pool);
+
+/**
+   Take an activated instance from the pool.
+
+   This function is realtime safe, but may only be called from one thread at a
+   time.  Port connections are not reset, so every port must be connected
+   before the instance is run.
+
+   @return NULL if no instance is ready.
+*/
+LILV_API LilvInstance*
+lilv_instance_pool_get(LilvInstancePool* pool);
+
+/**
+   Return an activated instance to the pool.
+
+   The instance is deactivated, reset, and activated again in the background
+   before it is handed out again.  This function is realtime safe, but may
+   only be called from one thread at a time (usually the same thread that
+   calls lilv_instance_pool_get()).
+
+   @return Zero on success, or non-zero if the pool is full.
+*/
+LILV_API int
+lilv_instance_pool_put(LilvInstancePool* pool, LilvInstance* instance);
+
+/**
+   @}
+   @name Control Queue
+   @{
+*/
+
+/**
+   A change of a control port value at an absolute frame time.
+*/
+typedef struct {
+	uint32_t port;   /**< Index of control input port. */
+	uint64_t frame;  /**< Absolute frame time. */
+	float    value;  /**< New port value. */
+} LilvControlEvent;
+
+/**
+   Create a queue for sending control changes to the audio thread.
+
+   The queue is a lock-free ring with room for at least `capacity` events.  Events
+   may be pushed from one thread, such as an automation or UI thread, while
+   the audio thread reads them in lilv_instance_run_segmented().
+*/
+LILV_API LilvControlQueue*
+lilv_control_queue_new(uint32_t capacity);
+
+/**
+   Free `queue`.
+*/
+LILV_API void
+lilv_control_queue_free(LilvControlQueue* queue);
+
+/**
+   Push a control change to `queue`.
+
+   This is realtime safe, but must only be called from one thread at a time.
+   Events must be pushed in time order.  The `frame` is an absolute time on
+   the same timeline as the block times passed to
+   lilv_instance_run_segmented(), so it does not depend on which block the
+   audio thread is running when the event is pushed.
+
+   @return Zero on success, or non-zero if the queue is full.
+*/
+LILV_API int
+lilv_control_queue_push(LilvControlQueue* queue,
+                        uint32_t          port_index,
+                        uint64_t          frame,
+                        float             value);
+
+/**
+   Run `instance` for a block, applying queued control changes in time.
+
+   The block is split into segments at the frame of each event in `queue`,
+   and the value of each control port in `buffers` is written between them,
+   so automation is sample accurate.  Audio ports are connected to the
+   corresponding offset in `buffers` for each segment, and reconnected to
+   the start of the block afterwards.
+
+   The audio thread keeps a running frame counter, which is the absolute time
+   of the start of the block, and passes it as `frame`.  Each event is applied
+   at its time minus `frame`.  Late events, before `frame`, are applied at the
+   start of the block, and events after the end of the block are left in the
+   queue for a later one.
+
+   To bound the overhead of very short runs, segments are at least
+   `min_segment` frames long (except the last), so an event may be applied
+   up to `min_segment` - 1 frames early.  If `buffers` has atom ports, whose
+   event times can not be split, every event in the block is applied at its
+   start.
+
+   This is realtime safe.  `instance` must be connected to `buffers`.
+*/
+LILV_API void
+lilv_instance_run_segmented(LilvInstance*          instance,
+                            const LilvPortBuffers* buffers,
+                            LilvControlQueue*      queue,
+                            uint64_t               frame,
+                            uint32_t               sample_count,
+                            uint32_t               min_segment);
+
+/**
+   @}
+   @name Graph
+   @{
+*/
+
+/**
+   A connection from an output port of one graph node to an input of another.
+*/
+typedef struct {
+	uint32_t src_node;  /**< Index of source node. */
+	uint32_t src_port;  /**< Index of output port on source node. */
+	uint32_t dst_node;  /**< Index of destination node. */
+	uint32_t dst_port;  /**< Index of input port on destination node. */
+} LilvGraphEdge;
+
+/**
+   Create a new empty graph of plugin instances.
+
+   A graph runs every instance once per cycle, after all of the instances it
+   depends on.  Independent instances are run in parallel by up to
+   `n_threads` threads, including the thread that calls lilv_graph_run().
+*/
+LILV_API LilvGraph*
+lilv_graph_new(unsigned n_threads);
+
+/**
+   Free `graph`.
+   The instances in the graph are not freed.
+*/
+LILV_API void
+lilv_graph_free(LilvGraph* graph);
+
+/**
+   Add an instance to `graph` and return its node index.
+
+   The graph does not own or connect the instance, which must be activated,
+   and have all of its ports connected, before the graph is run.
+*/
+LILV_API uint32_t
+lilv_graph_add_node(LilvGraph* graph, LilvInstance* instance);
+
+/**
+   Connect an output port of one node to an input port of another.
+
+   This makes `dst_node` depend on `src_node`.  The graph does not connect
+   any buffers, it only uses connections to find the order instances must be
+   run in.
+
+   @return Zero on success, or non-zero if the nodes are invalid.
+*/
+LILV_API int
+lilv_graph_connect(LilvGraph* graph,
+                   uint32_t   src_node,
+                   uint32_t   src_port,
+                   uint32_t   dst_node,
+                   uint32_t   dst_port);
+
+/**
+   Compile `graph` so it can be run.
+
+   This must be called after adding nodes or connections, and before
+   lilv_graph_run().  It is not realtime safe, and must not be called while
+   the graph is running.
+
+   @return Zero on success, or non-zero if the graph has a cycle.
+*/
+LILV_API int
+lilv_graph_compile(LilvGraph* graph);
+
+/**
+   Run every instance in `graph` once for `sample_count` frames.
+
+   This does not allocate memory or take any locks.  Worker threads are woken
+   with a semaphore, and the calling thread takes part in the work, returning
+   when every instance has been run.  Each thread runs instances from its own
+   queue, and steals from the others when it is empty, so the calling thread
+   runs any instance that is ready rather than waiting for a worker to.  When
+   no instance is ready, it spins briefly, then blocks on a semaphore until a
+   worker finishes one.
+
+   @return Zero on success, or non-zero if the graph is not compiled.
+*/
+LILV_API int
+lilv_graph_run(LilvGraph* graph, uint32_t sample_count);
+
+/**
+   Return the number of nodes in `graph`.
+*/
+LILV_API uint32_t
+lilv_graph_get_num_nodes(const LilvGraph* graph);
+
+/**
+   Return the connections in `graph`, and set `n_edges` to their number.
+*/
+LILV_API const LilvGraphEdge*
+lilv_graph_get_edges(const LilvGraph* graph, uint32_t* n_edges);
+
+/**
+   Return the time taken by the last run of `node` in seconds.
+   This is zero if the system does not provide a monotonic clock.
+*/
+LILV_API double
+lilv_graph_get_node_time(const LilvGraph* graph, uint32_t node);
+
+/**
+   Plan shared audio buffers for the connections in `graph`.
+
+   Rather than allocating a buffer for every output, this assigns each audio
+   or CV port one of a minimal set of shared buffers.  A buffer is reused once
+   every instance that reads its current value is guaranteed to have run, and
+   an instance processes in place, with outputs sharing the buffers of its
+   inputs, unless its plugin has the lv2:inPlaceBroken feature.
+
+   Buffer 0 is connected to every unconnected input and must be silent.
+   Unconnected outputs are never read, but are given distinct buffers if
+   their instances may run concurrently.
+   Several connections to the same input can not be mixed, so are an error.
+
+   @param graph A compiled graph.
+   @param plugins The plugin of each node in `graph`.
+   @return A new plan, or NULL on error.
+*/
+LILV_API LilvBufferPlan*
+lilv_graph_plan_buffers(const LilvGraph*         graph,
+                        const LilvPlugin* const* plugins);
+
+/**
+   Free `plan`.
+*/
+LILV_API void
+lilv_buffer_plan_free(LilvBufferPlan* plan);
+
+/**
+   Return the number of buffers required by `plan`.
+*/
+LILV_API uint32_t
+lilv_buffer_plan_get_num_buffers(const LilvBufferPlan* plan);
+
+/**
+   Return the index of the buffer for a port, or -1 if it is not planned.
+*/
+LILV_API int32_t
+lilv_buffer_plan_get_buffer(const LilvBufferPlan* plan,
+                            uint32_t              node,
+                            uint32_t              port);
+
+/**
+   Connect every planned port of the instances in `graph`.
+
+   Buffer `i` of the plan starts at `buffers + i * stride`, so `buffers` must
+   hold lilv_buffer_plan_get_num_buffers() times `stride` floats, where
+   `stride` is at least the maximum block length.
+*/
+LILV_API void
+lilv_buffer_plan_connect(const LilvBufferPlan* plan,
+                         const LilvGraph*      graph,
+                         float*                buffers,
+                         uint32_t              stride);
+
 /**
    @}
    @name Plugin UI
@@ -0,0 +1,155 @@
+/*
+  Copyright 2007-2015 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/**
+   @file portbuffers.h Port buffer API for Lilv.
+
+   This is separate from lilv.h so that only hosts using it depend on the
+   LV2 atom headers.
+*/
+
+#ifndef LILV_PORTBUFFERS_H
+#define LILV_PORTBUFFERS_H
+
+#include <stdint.h>
+
+#include "lilv/lilv.h"
+#include "lv2/lv2plug.in/ns/ext/atom/atom.h"
+#include "lv2/lv2plug.in/ns/ext/urid/urid.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   @addtogroup lilv
+   @{
+   @name Port Buffers
+   @{
+*/
+
+/**
+   The kind of buffer allocated for a port.
+*/
+typedef enum {
+	LILV_PORT_BUFFER_NONE,     /**< Unsupported port, connected to NULL. */
+	LILV_PORT_BUFFER_AUDIO,    /**< Audio or CV port, block of floats. */
+	LILV_PORT_BUFFER_CONTROL,  /**< Control port, single float. */
+	LILV_PORT_BUFFER_ATOM      /**< Atom port, LV2_Atom_Sequence. */
+} LilvPortBufferType;
+
+/**
+   Allocate buffers for every port of `plugin`.
+
+   All buffers are allocated in a single block of memory, and every buffer is
+   aligned to 64 bytes, so they are suitable for SIMD processing.  Audio and
+   CV buffers hold `block_length` samples, control buffers are set to the
+   port default (or zero), and atom buffers hold at least `atom_capacity`
+   bytes (8192 if zero), or the port's rsz:minimumSize if that is larger.
+
+   @param map URID map used for atom types, or NULL if there are no atom ports.
+*/
+LILV_API LilvPortBuffers*
+lilv_port_buffers_new(const LilvPlugin* plugin,
+                      LV2_URID_Map*     map,
+                      uint32_t          block_length,
+                      uint32_t          atom_capacity);
+
+/**
+   Free port buffers.
+   Any instance connected to `buffers` must not be run after this call.
+*/
+LILV_API void
+lilv_port_buffers_free(LilvPortBuffers* buffers);
+
+/**
+   Connect every port of `instance` to its buffer in `buffers`.
+   Ports with no buffer (type LILV_PORT_BUFFER_NONE) are connected to NULL.
+*/
+LILV_API void
+lilv_port_buffers_connect(const LilvPortBuffers* buffers,
+                          LilvInstance*          instance);
+
+/**
+   Prepare atom buffers for the next run.
+
+   Input sequences are emptied, and output sequences are reset to a Chunk
+   with the full capacity, as plugins expect.  This is realtime safe, and
+   should be called before every lilv_instance_run() if the plugin has atom
+   ports.
+*/
+LILV_API void
+lilv_port_buffers_reset(LilvPortBuffers* buffers);
+
+/**
+   Return the number of ports in `buffers`.
+*/
+LILV_API uint32_t
+lilv_port_buffers_get_num_ports(const LilvPortBuffers* buffers);
+
+/**
+   Return the type of buffer for port `index`.
+*/
+LILV_API LilvPortBufferType
+lilv_port_buffers_get_type(const LilvPortBuffers* buffers, uint32_t index);
+
+/**
+   Return the buffer for port `index`, or NULL if it has none.
+*/
+LILV_API void*
+lilv_port_buffers_get(const LilvPortBuffers* buffers, uint32_t index);
+
+/**
+   Return the audio or CV buffer for port `index`, or NULL.
+*/
+LILV_API float*
+lilv_port_buffers_get_audio(const LilvPortBuffers* buffers, uint32_t index);
+
+/**
+   Return the control value for port `index`, or NULL.
+*/
+LILV_API float*
+lilv_port_buffers_get_control(const LilvPortBuffers* buffers, uint32_t index);
+
+/**
+   Return the atom sequence for port `index`, or NULL.
+*/
+LILV_API LV2_Atom_Sequence*
+lilv_port_buffers_get_atom(const LilvPortBuffers* buffers, uint32_t index);
+
+/**
+   Allocate buffers for every port and connect `instance` to them.
+
+   This is a convenience for lilv_port_buffers_new() followed by
+   lilv_port_buffers_connect().  The returned buffers must be freed with
+   lilv_port_buffers_free() after `instance` is freed.
+*/
+LILV_API LilvPortBuffers*
+lilv_instance_auto_connect(LilvInstance*     instance,
+                           const LilvPlugin* plugin,
+                           LV2_URID_Map*     map,
+                           uint32_t          block_length);
+
+/**
+   @}
+   @}
+*/
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* LILV_PORTBUFFERS_H */
@@ -0,0 +1,152 @@
+/*
+  Copyright 2016 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+
+#include "lilv_internal.h"
+
+struct LilvControlQueueImpl {
+	ZixRing* ring;  ///< LilvControlEvent stream
+};
+
+LILV_API LilvControlQueue*
+lilv_control_queue_new(uint32_t capacity)
+{
+	LilvControlQueue* queue = (LilvControlQueue*)malloc(
+		sizeof(LilvControlQueue));
+	queue->ring = zix_ring_new((capacity + 1) * sizeof(LilvControlEvent));
+	zix_ring_mlock(queue->ring);
+	return queue;
+}
+
+LILV_API void
+lilv_control_queue_free(LilvControlQueue* queue)
+{
+	if (queue) {
+		zix_ring_free(queue->ring);
+		free(queue);
+	}
+}
+
+LILV_API int
+lilv_control_queue_push(LilvControlQueue* queue,
+                        uint32_t          port_index,
+                        uint64_t          frame,
+                        float             value)
+{
+	const LilvControlEvent ev = { port_index, frame, value };
+	if (zix_ring_write_space(queue->ring) < sizeof(ev)) {
+		return 1;
+	}
+
+	zix_ring_write(queue->ring, &ev, sizeof(ev));
+	return 0;
+}
+
+/**
+   Read the next event, but leave it queued.
+
+   The event time is converted to an offset in the block that starts at
+   `frame`, which is zero for late events.
+*/
+static bool
+lilv_control_queue_peek(LilvControlQueue* queue,
+                        uint64_t          frame,
+                        LilvControlEvent* ev)
+{
+	if (zix_ring_peek(queue->ring, ev, sizeof(*ev)) != sizeof(*ev)) {
+		return false;
+	}
+
+	ev->frame = (ev->frame > frame) ? ev->frame - frame : 0;
+	return true;
+}
+
+static void
+apply(const LilvPortBuffers* buffers, const LilvControlEvent* ev)
+{
+	float* const control = lilv_port_buffers_get_control(buffers, ev->port);
+	if (control) {
+		*control = ev->value;
+	}
+}
+
+/** Connect every audio port to `offset` frames into its buffer. */
+static void
+connect_audio(LilvInstance*          instance,
+              const LilvPortBuffers* buffers,
+              uint32_t               offset)
+{
+	const uint32_t n_ports = lilv_port_buffers_get_num_ports(buffers);
+	for (uint32_t i = 0; i < n_ports; ++i) {
+		float* const audio = lilv_port_buffers_get_audio(buffers, i);
+		if (audio) {
+			instance->lv2_descriptor->connect_port(
+				instance->lv2_handle, i, audio + offset);
+		}
+	}
+}
+
+static bool
+has_atom_ports(const LilvPortBuffers* buffers)
+{
+	const uint32_t n_ports = lilv_port_buffers_get_num_ports(buffers);
+	for (uint32_t i = 0; i < n_ports; ++i) {
+		if (lilv_port_buffers_get_type(buffers, i) == LILV_PORT_BUFFER_ATOM) {
+			return true;
+		}
+	}
+	return false;
+}
+
+LILV_API void
+lilv_instance_run_segmented(LilvInstance*          instance,
+                            const LilvPortBuffers* buffers,
+                            LilvControlQueue*      queue,
+                            uint64_t               frame,
+                            uint32_t               sample_count,
+                            uint32_t               min_segment)
+{
+	// Event times in atom sequences can not be split, so apply all at once
+	if (has_atom_ports(buffers)) {
+		min_segment = sample_count;
+	}
+
+	LilvControlEvent ev;
+	bool             have_ev = lilv_control_queue_peek(queue, frame, &ev);
+	uint32_t         pos     = 0;
+	while (pos < sample_count) {
+		// Apply events before the end of the shortest allowed segment
+		const uint32_t min_end = pos + (min_segment ? min_segment : 1);
+		while (have_ev && ev.frame < min_end && ev.frame < sample_count) {
+			apply(buffers, &ev);
+			zix_ring_skip(queue->ring, sizeof(ev));
+			have_ev = lilv_control_queue_peek(queue, frame, &ev);
+		}
+
+		// Run until the next event, or the end of the block
+		const uint32_t end = (have_ev && ev.frame < sample_count)
+			? (uint32_t)ev.frame : sample_count;
+		if (pos) {
+			connect_audio(instance, buffers, pos);
+		}
+		instance->lv2_descriptor->run(instance->lv2_handle, end - pos);
+		if (pos && end == sample_count) {
+			connect_audio(instance, buffers, 0);
+		}
+		pos = end;
+	}
+}
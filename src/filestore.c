@@ -0,0 +1,418 @@
+/*
+  Copyright 2016 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef _POSIX_C_SOURCE
+#    define _POSIX_C_SOURCE 200809L  /* for link, mkstemp, and fchmod */
+#endif
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#ifdef _WIN32
+#    include <io.h>
+#else
+#    include <unistd.h>
+#endif
+
+#include "lilv_internal.h"
+
+/**
+   @file filestore.c Content-addressed store of file copies.
+
+   Each file is stored as STORE/HASH/NAME, where HASH is the SHA-256 of the
+   contents and NAME is the original file name, so stored files keep their
+   extension.  Stored files are never modified, so copies with the same
+   contents and a different name are hard links where possible.
+
+   New files are copied into the store before they are hashed, so the hash is
+   always of the stored contents even if the source changes meanwhile.  Hashes
+   of source files are cached in STORE/.hashes, keyed by device and inode, and
+   only used to skip copying a file that is already stored, if the size and
+   modification time still match.
+*/
+
+#define LILV_HASH_CHUNK_SIZE (1 << 16)
+
+static const uint32_t sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
+	0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3,
+	0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc,
+	0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7,
+	0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13,
+	0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3,
+	0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5,
+	0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208,
+	0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2 };
+
+#define ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+static void
+sha256_compress(uint32_t* state, const uint8_t* block)
+{
+	uint32_t w[64];
+	for (unsigned i = 0; i < 16; ++i) {
+		w[i] = ((uint32_t)block[i * 4] << 24) |
+			((uint32_t)block[i * 4 + 1] << 16) |
+			((uint32_t)block[i * 4 + 2] << 8) |
+			(uint32_t)block[i * 4 + 3];
+	}
+	for (unsigned i = 16; i < 64; ++i) {
+		const uint32_t s0 = (ROTR(w[i - 15], 7) ^ ROTR(w[i - 15], 18) ^
+		                     (w[i - 15] >> 3));
+		const uint32_t s1 = (ROTR(w[i - 2], 17) ^ ROTR(w[i - 2], 19) ^
+		                     (w[i - 2] >> 10));
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+
+	uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+	uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+	for (unsigned i = 0; i < 64; ++i) {
+		const uint32_t s1  = ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25);
+		const uint32_t ch  = (e & f) ^ (~e & g);
+		const uint32_t t1  = h + s1 + ch + sha256_k[i] + w[i];
+		const uint32_t s0  = ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22);
+		const uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+		h = g;
+		g = f;
+		f = e;
+		e = d + t1;
+		d = c;
+		c = b;
+		b = a;
+		a = t1 + s0 + maj;
+	}
+
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+void
+lilv_sha256_init(LilvSha256* sha)
+{
+	static const uint32_t init[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19 };
+	memcpy(sha->state, init, sizeof(init));
+	sha->length  = 0;
+	sha->n_block = 0;
+}
+
+void
+lilv_sha256_update(LilvSha256* sha, const uint8_t* data, size_t size)
+{
+	sha->length += size;
+	while (size) {
+		if (sha->n_block == 0 && size >= 64) {
+			sha256_compress(sha->state, data);
+			data += 64;
+			size -= 64;
+			continue;
+		}
+
+		const size_t n = (size < 64 - sha->n_block) ? size : 64 - sha->n_block;
+		memcpy(sha->block + sha->n_block, data, n);
+		sha->n_block += n;
+		data         += n;
+		size         -= n;
+		if (sha->n_block == 64) {
+			sha256_compress(sha->state, sha->block);
+			sha->n_block = 0;
+		}
+	}
+}
+
+void
+lilv_sha256_finish(LilvSha256* sha, uint8_t* digest)
+{
+	const uint64_t bits = sha->length * 8;
+	uint8_t        pad[72];
+	const size_t   n_pad = (sha->n_block < 56)
+		? 56 - sha->n_block : 120 - sha->n_block;
+	memset(pad, 0, sizeof(pad));
+	pad[0] = 0x80;
+	for (unsigned i = 0; i < 8; ++i) {
+		pad[n_pad + i] = (uint8_t)(bits >> (56 - i * 8));
+	}
+	lilv_sha256_update(sha, pad, n_pad + 8);
+
+	for (unsigned i = 0; i < 32; ++i) {
+		digest[i] = (uint8_t)(sha->state[i / 4] >> (24 - (i % 4) * 8));
+	}
+}
+
+int
+lilv_file_sha256(const char* path, char* hex)
+{
+	FILE* fd = fopen(path, "rb");
+	if (!fd) {
+		return errno;
+	}
+
+	LilvSha256 sha;
+	uint8_t*   chunk  = (uint8_t*)malloc(LILV_HASH_CHUNK_SIZE);
+	size_t     n_read = 0;
+	lilv_sha256_init(&sha);
+	while ((n_read = fread(chunk, 1, LILV_HASH_CHUNK_SIZE, fd)) > 0) {
+		lilv_sha256_update(&sha, chunk, n_read);
+	}
+
+	const int st = ferror(fd) ? EIO : 0;
+	free(chunk);
+	fclose(fd);
+	if (!st) {
+		uint8_t digest[32];
+		lilv_sha256_finish(&sha, digest);
+		for (unsigned i = 0; i < 32; ++i) {
+			snprintf(hex + i * 2, 3, "%02x", digest[i]);
+		}
+	}
+	return st;
+}
+
+#ifndef _WIN32
+/** Return the path of the hash cache entry for the file with status `st`. */
+static char*
+hash_cache_path(const char* store_dir, const struct stat* st)
+{
+	char name[64];
+	snprintf(name, sizeof(name), "%llu-%llu",
+	         (unsigned long long)st->st_dev, (unsigned long long)st->st_ino);
+
+	char* const cache_dir  = lilv_path_join(store_dir, ".hashes");
+	char* const cache_path = lilv_path_join(cache_dir, name);
+	free(cache_dir);
+	return cache_path;
+}
+#endif
+
+/** Get the cached hash of `path` if the file has not changed since. */
+static bool
+lilv_file_store_cached_hash(const char* store_dir, const char* path, char* hex)
+{
+#ifdef _WIN32
+	return false;
+#else
+	struct stat st;
+	if (stat(path, &st)) {
+		return false;
+	}
+
+	char* const        cache_path = hash_cache_path(store_dir, &st);
+	unsigned long long size       = 0;
+	long long          mtime      = 0;
+	char               cached[65];
+	FILE*              fd         = fopen(cache_path, "r");
+	bool               found      = false;
+	if (fd) {
+		found = (fscanf(fd, "%llu %lld %64s", &size, &mtime, cached) == 3 &&
+		         size == (unsigned long long)st.st_size &&
+		         mtime == (long long)st.st_mtime &&
+		         strlen(cached) == 64);
+		fclose(fd);
+	}
+
+	if (found) {
+		memcpy(hex, cached, sizeof(cached));
+	}
+	free(cache_path);
+	return found;
+#endif
+}
+
+/**
+   Cache `hex` as the hash of a file with status `st`.
+
+   Only files not modified recently are cached, since a change within the
+   resolution of the modification time would not be noticed.
+*/
+static void
+lilv_file_store_cache_hash(const char*        store_dir,
+                           const struct stat* st,
+                           const char*        hex)
+{
+#ifndef _WIN32
+	if (time(NULL) - st->st_mtime <= 1) {
+		return;
+	}
+
+	char* const cache_dir  = lilv_path_join(store_dir, ".hashes");
+	char* const cache_path = hash_cache_path(store_dir, st);
+	FILE*       fd         = NULL;
+	lilv_mkdir_p(cache_dir);
+	if ((fd = fopen(cache_path, "w"))) {
+		fprintf(fd, "%llu %lld %s\n", (unsigned long long)st->st_size,
+		        (long long)st->st_mtime, hex);
+		fclose(fd);
+	}
+	free(cache_path);
+	free(cache_dir);
+#endif
+}
+
+static void
+find_stored(const char* path, const char* name, void* data)
+{
+	char** stored = (char**)data;
+	if (!*stored && name[0] != '.') {
+		*stored = lilv_path_join(path, name);
+	}
+}
+
+/**
+   Create a new empty temporary file for `name` in `dir`.
+
+   The file name is unique, so concurrent saves of the same file never write
+   to the same temporary file.  Returns the path of the file, or NULL.
+*/
+static char*
+lilv_file_store_tmp(const char* dir, const char* name)
+{
+	char* const tmp_name = lilv_strjoin(".", name, ".XXXXXX", NULL);
+	char* const tmp      = lilv_path_join(dir, tmp_name);
+	free(tmp_name);
+#ifndef _WIN32
+	const int fd = mkstemp(tmp);
+	if (fd < 0) {
+		free(tmp);
+		return NULL;
+	}
+	fchmod(fd, 0644);
+	close(fd);
+#else
+	if (_mktemp_s(tmp, strlen(tmp) + 1)) {
+		free(tmp);
+		return NULL;
+	}
+#endif
+	return tmp;
+}
+
+/**
+   Move the file at `tmp` to `stored` in `hash_dir`.
+
+   If the directory already has a file with the same contents and another
+   name, `stored` is made a link to it instead, and `tmp` is removed.
+*/
+static int
+lilv_file_store_move(const char* hash_dir, const char* stored, const char* tmp)
+{
+	lilv_mkdir_p(hash_dir);
+
+	char* other = NULL;
+	int   st    = 0;
+	lilv_dir_for_each(hash_dir, &other, find_stored);
+#ifndef _WIN32
+	const char* const slash    = strrchr(stored, '/');
+	char* const       link_tmp = other
+		? lilv_file_store_tmp(hash_dir, slash ? slash + 1 : stored)
+		: NULL;
+	if (link_tmp) {
+		remove(link_tmp);  // Only the unique name is needed
+	}
+	if (link_tmp && !link(other, link_tmp)) {
+		remove(tmp);
+		st = lilv_replace_file(link_tmp, stored);
+	} else {
+		st = lilv_replace_file(tmp, stored);
+	}
+	if (st && link_tmp) {
+		remove(link_tmp);
+	}
+	free(link_tmp);
+#else
+	st = lilv_replace_file(tmp, stored);
+#endif
+
+	free(other);
+	return st;
+}
+
+char*
+lilv_file_store_add(const char* store_dir, const char* path)
+{
+	const char* slash = strrchr(path, '/');
+	const char* name  = slash ? slash + 1 : path;
+	char        hash[65];
+
+	// Skip copying if the cached hash shows the file is already stored
+	if (lilv_file_store_cached_hash(store_dir, path, hash)) {
+		char* const hash_dir = lilv_path_join(store_dir, hash);
+		char* const stored   = lilv_path_join(hash_dir, name);
+		free(hash_dir);
+		if (lilv_path_exists(stored, NULL)) {
+			return stored;
+		}
+		free(stored);
+	}
+
+	// Copy first and hash the copy, so the hash matches what is stored
+	struct stat before;
+	struct stat after;
+	lilv_mkdir_p(store_dir);
+	char* const tmp = lilv_file_store_tmp(store_dir, name);
+	if (!tmp) {
+		LILV_ERRORF("Error creating temporary file in %s (%s)\n",
+		            store_dir, strerror(errno));
+		return NULL;
+	}
+
+	int st = stat(path, &before) ? errno : 0;
+#ifndef _WIN32
+	st = st ? st : lilv_clone_file(path, tmp);
+#else
+	st = st ? st : lilv_copy_file(path, tmp);
+#endif
+	if (!st && !(st = lilv_file_sha256(tmp, hash))) {
+		// Cache the hash only if the source did not change while copying
+		if (!stat(path, &after) &&
+		    after.st_size == before.st_size &&
+		    after.st_mtime == before.st_mtime) {
+			lilv_file_store_cache_hash(store_dir, &after, hash);
+		}
+	}
+
+	char* const hash_dir = st ? NULL : lilv_path_join(store_dir, hash);
+	char*       stored   = st ? NULL : lilv_path_join(hash_dir, name);
+	if (stored && lilv_path_exists(stored, NULL)) {
+		remove(tmp);  // Already stored with this name
+	} else if (stored) {
+		st = lilv_file_store_move(hash_dir, stored, tmp);
+	}
+
+	if (st) {
+		LILV_ERRORF("Error storing copy of %s (%s)\n", path, strerror(st));
+		remove(tmp);
+		free(stored);
+		stored = NULL;
+	}
+
+	free(hash_dir);
+	free(tmp);
+	return stored;
+}
@@ -0,0 +1,815 @@
+/*
+  Copyright 2016 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef _POSIX_C_SOURCE
+#    define _POSIX_C_SOURCE 200112L  /* for clock_gettime */
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lilv_internal.h"
+
+#ifdef HAVE_CLOCK_GETTIME
+#    include <time.h>
+#endif
+
+/** Number of failed attempts to find work before a thread stops spinning. */
+#define LILV_GRAPH_SPIN 4096
+
+typedef struct {
+	LilvInstance* instance;
+	uint32_t*     successors;    ///< Indices of nodes that depend on this one
+	uint32_t      n_successors;
+	uint32_t      n_deps;        ///< Number of nodes this one depends on
+	LilvAtomic    pending;       ///< Dependencies not yet run this cycle
+	double        time;          ///< Duration of last run in seconds
+} LilvGraphNode;
+
+/**
+   Queue of ready nodes owned by one thread.
+
+   The owner pushes and pops at the bottom, and other threads steal from the
+   top.  Every node is pushed exactly once per cycle, so the queue never wraps,
+   and it is simply reset before each cycle.
+*/
+typedef struct {
+	LilvAtomic* tasks;   ///< Node indices
+	LilvAtomic  top;     ///< Index of next task to steal
+	LilvAtomic  bottom;  ///< Index one past the last task
+} LilvGraphDeque;
+
+typedef struct {
+	LilvGraph* graph;
+	ZixThread  thread;
+	unsigned   index;    ///< Index of deque, 0 is the thread calling run()
+} LilvGraphThread;
+
+struct LilvGraphImpl {
+	LilvGraphNode*   nodes;
+	uint32_t         n_nodes;
+	LilvGraphEdge*   edges;
+	uint32_t         n_edges;
+	uint32_t*        order;        ///< Topological order of nodes
+	uint32_t*        sources;      ///< Nodes with no dependencies
+	uint32_t         n_sources;
+	LilvGraphDeque*  deques;       ///< Ready queue of each thread
+	unsigned         n_deques;
+	LilvAtomic       n_remaining;  ///< Nodes not yet finished this cycle
+	LilvAtomic       n_active;     ///< Workers taking part in this cycle
+	LilvAtomic       waiting;      ///< Run thread is waiting on wake
+	uint32_t         sample_count;
+	bool             compiled;
+	unsigned         n_threads;
+	LilvGraphThread* threads;
+	unsigned         n_workers;    ///< Number of threads started
+	ZixSem           sem;          ///< Wakes workers for a cycle
+	ZixSem           wake;         ///< Wakes the run thread on progress
+	bool             exit;
+};
+
+static double
+lilv_graph_now(void)
+{
+#ifdef HAVE_CLOCK_GETTIME
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1000000000.0;
+#else
+	return 0.0;
+#endif
+}
+
+static void
+lilv_graph_run_node(LilvGraph* graph, LilvGraphNode* node)
+{
+	const double start = lilv_graph_now();
+	node->instance->lv2_descriptor->run(
+		node->instance->lv2_handle, graph->sample_count);
+	node->time = lilv_graph_now() - start;
+}
+
+/** Push a ready node, only called by the owner of `dq` (or before a cycle). */
+static void
+lilv_deque_push(LilvGraphDeque* dq, uint32_t index)
+{
+	dq->tasks[dq->bottom] = (long)index;
+	LILV_BARRIER();
+	dq->bottom = dq->bottom + 1;
+}
+
+/** Pop the newest node, only called by the owner of `dq`, or return -1. */
+static long
+lilv_deque_pop(LilvGraphDeque* dq)
+{
+	const long b = dq->bottom - 1;
+	dq->bottom = b;
+	LILV_BARRIER();
+	const long t = dq->top;
+	if (t > b) {
+		dq->bottom = t;  // Empty
+		return -1;
+	}
+
+	long index = dq->tasks[b];
+	if (t == b) {
+		// Last node, which a thief may be taking at the same time
+		if (!LILV_ATOMIC_CAS(&dq->top, t, t + 1)) {
+			index = -1;
+		}
+		dq->bottom = t + 1;
+	}
+	return index;
+}
+
+/** Steal the oldest node from another thread's deque, or return -1. */
+static long
+lilv_deque_steal(LilvGraphDeque* dq)
+{
+	const long t = dq->top;
+	LILV_BARRIER();
+	const long b = dq->bottom;
+	if (t >= b) {
+		return -1;
+	}
+
+	const long index = dq->tasks[t];
+	return LILV_ATOMIC_CAS(&dq->top, t, t + 1) ? index : -1;
+}
+
+/** Wake the run thread if it is waiting for progress. */
+static void
+lilv_graph_wake(LilvGraph* graph)
+{
+	if (graph->waiting && LILV_ATOMIC_CAS(&graph->waiting, 1, 0)) {
+		zix_sem_post(&graph->wake);
+	}
+}
+
+static bool
+lilv_graph_has_work(const LilvGraph* graph)
+{
+	for (unsigned i = 0; i < graph->n_deques; ++i) {
+		if (graph->deques[i].top < graph->deques[i].bottom) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+   Block the run thread until another thread makes progress.
+
+   Progress is a node becoming ready, the last node finishing, or the last
+   worker leaving the cycle, which all call lilv_graph_wake().  The state is
+   checked again after setting the flag, so a wake just before it is not lost.
+*/
+static void
+lilv_graph_wait(LilvGraph* graph)
+{
+	graph->waiting = 1;
+	LILV_BARRIER();
+	if (lilv_graph_has_work(graph) ||
+	    (graph->n_remaining == 0 && graph->n_active == 0)) {
+		if (LILV_ATOMIC_CAS(&graph->waiting, 1, 0)) {
+			return;  // Progress already made, and nobody will post
+		}
+	}
+	zix_sem_wait(&graph->wake);
+}
+
+/** Return the next node for thread `self` to run, or -1. */
+static long
+lilv_graph_take(LilvGraph* graph, unsigned self)
+{
+	long index = lilv_deque_pop(&graph->deques[self]);
+	for (unsigned i = 1; index < 0 && i < graph->n_deques; ++i) {
+		index = lilv_deque_steal(
+			&graph->deques[(self + i) % graph->n_deques]);
+	}
+	return index;
+}
+
+/**
+   Run nodes until every node has run this cycle.
+
+   Each thread runs nodes from its own deque, newest first, and steals the
+   oldest node of another thread when its own is empty.  Successors that become
+   ready are pushed to the deque of the thread that ran their last dependency,
+   so chains tend to stay on one thread.  After a while without work, workers
+   leave the cycle, and the run thread waits until there is work again.  The
+   run thread never leaves, so every node is run even if all workers have.
+*/
+static void
+lilv_graph_work(LilvGraph* graph, unsigned self)
+{
+	unsigned idle = 0;
+	while (graph->n_remaining > 0) {
+		const long index = lilv_graph_take(graph, self);
+		if (index < 0) {
+			if (++idle < LILV_GRAPH_SPIN) {
+				continue;
+			} else if (self) {
+				return;
+			}
+			lilv_graph_wait(graph);
+			idle = 0;
+			continue;
+		}
+
+		LilvGraphNode* node = &graph->nodes[index];
+		lilv_graph_run_node(graph, node);
+		for (uint32_t s = 0; s < node->n_successors; ++s) {
+			const uint32_t succ = node->successors[s];
+			if (LILV_ATOMIC_DEC(&graph->nodes[succ].pending) == 0) {
+				lilv_deque_push(&graph->deques[self], succ);
+				lilv_graph_wake(graph);
+			}
+		}
+		if (LILV_ATOMIC_DEC(&graph->n_remaining) == 0) {
+			lilv_graph_wake(graph);
+		}
+		idle = 0;
+	}
+}
+
+static void*
+lilv_graph_thread(void* data)
+{
+	LilvGraphThread* self  = (LilvGraphThread*)data;
+	LilvGraph*       graph = self->graph;
+	while (!zix_sem_wait(&graph->sem) && !graph->exit) {
+		LILV_ATOMIC_ADD(&graph->n_active, 1);
+		lilv_graph_work(graph, self->index);
+		if (LILV_ATOMIC_DEC(&graph->n_active) == 0) {
+			lilv_graph_wake(graph);
+		}
+	}
+	return NULL;
+}
+
+LILV_API LilvGraph*
+lilv_graph_new(unsigned n_threads)
+{
+	LilvGraph* graph = (LilvGraph*)calloc(1, sizeof(LilvGraph));
+	graph->n_threads = n_threads ? n_threads : 1;
+	zix_sem_init(&graph->sem, 0);
+	zix_sem_init(&graph->wake, 0);
+	return graph;
+}
+
+static void
+lilv_graph_stop(LilvGraph* graph)
+{
+	graph->exit = true;
+	for (unsigned i = 0; i < graph->n_workers; ++i) {
+		zix_sem_post(&graph->sem);
+	}
+	for (unsigned i = 0; i < graph->n_workers; ++i) {
+		zix_thread_join(graph->threads[i].thread, NULL);
+	}
+	free(graph->threads);
+	graph->threads   = NULL;
+	graph->n_workers = 0;
+	graph->exit      = false;
+}
+
+static void
+lilv_graph_free_deques(LilvGraph* graph)
+{
+	for (unsigned i = 0; i < graph->n_deques; ++i) {
+		free((void*)graph->deques[i].tasks);
+	}
+	free(graph->deques);
+	graph->deques   = NULL;
+	graph->n_deques = 0;
+}
+
+LILV_API void
+lilv_graph_free(LilvGraph* graph)
+{
+	if (!graph) {
+		return;
+	}
+
+	lilv_graph_stop(graph);
+	lilv_graph_free_deques(graph);
+	zix_sem_destroy(&graph->wake);
+	zix_sem_destroy(&graph->sem);
+	for (uint32_t i = 0; i < graph->n_nodes; ++i) {
+		free(graph->nodes[i].successors);
+	}
+	free(graph->nodes);
+	free(graph->edges);
+	free(graph->order);
+	free(graph->sources);
+	free(graph);
+}
+
+LILV_API uint32_t
+lilv_graph_add_node(LilvGraph* graph, LilvInstance* instance)
+{
+	graph->nodes = (LilvGraphNode*)realloc(
+		graph->nodes, (graph->n_nodes + 1) * sizeof(LilvGraphNode));
+
+	LilvGraphNode* node = &graph->nodes[graph->n_nodes];
+	memset(node, 0, sizeof(LilvGraphNode));
+	node->instance  = instance;
+	graph->compiled = false;
+	return graph->n_nodes++;
+}
+
+LILV_API int
+lilv_graph_connect(LilvGraph* graph,
+                   uint32_t   src_node,
+                   uint32_t   src_port,
+                   uint32_t   dst_node,
+                   uint32_t   dst_port)
+{
+	if (src_node >= graph->n_nodes || dst_node >= graph->n_nodes ||
+	    src_node == dst_node) {
+		return -1;
+	}
+
+	graph->edges = (LilvGraphEdge*)realloc(
+		graph->edges, (graph->n_edges + 1) * sizeof(LilvGraphEdge));
+
+	const LilvGraphEdge edge = { src_node, src_port, dst_node, dst_port };
+	graph->edges[graph->n_edges++] = edge;
+	graph->compiled = false;
+	return 0;
+}
+
+LILV_API int
+lilv_graph_compile(LilvGraph* graph)
+{
+	const uint32_t n_nodes = graph->n_nodes;
+
+	// Build successor lists, with one entry per dependent node
+	for (uint32_t i = 0; i < n_nodes; ++i) {
+		free(graph->nodes[i].successors);
+		graph->nodes[i].successors   = NULL;
+		graph->nodes[i].n_successors = 0;
+		graph->nodes[i].n_deps       = 0;
+	}
+	for (uint32_t e = 0; e < graph->n_edges; ++e) {
+		LilvGraphNode* src = &graph->nodes[graph->edges[e].src_node];
+		const uint32_t dst = graph->edges[e].dst_node;
+		bool           dup = false;
+		for (uint32_t s = 0; s < src->n_successors && !dup; ++s) {
+			dup = (src->successors[s] == dst);
+		}
+		if (!dup) {
+			src->successors = (uint32_t*)realloc(
+				src->successors, (src->n_successors + 1) * sizeof(uint32_t));
+			src->successors[src->n_successors++] = dst;
+			++graph->nodes[dst].n_deps;
+		}
+	}
+
+	// Topological sort (Kahn's algorithm), which also finds cycles
+	graph->order   = (uint32_t*)realloc(graph->order, n_nodes * sizeof(uint32_t));
+	graph->sources = (uint32_t*)realloc(graph->sources,
+	                                    n_nodes * sizeof(uint32_t));
+	graph->n_sources = 0;
+	uint32_t n_sorted = 0;
+	for (uint32_t i = 0; i < n_nodes; ++i) {
+		graph->nodes[i].pending = graph->nodes[i].n_deps;
+		if (!graph->nodes[i].n_deps) {
+			graph->sources[graph->n_sources++] = i;
+			graph->order[n_sorted++]           = i;
+		}
+	}
+	for (uint32_t i = 0; i < n_sorted; ++i) {
+		const LilvGraphNode* node = &graph->nodes[graph->order[i]];
+		for (uint32_t s = 0; s < node->n_successors; ++s) {
+			const uint32_t succ = node->successors[s];
+			if (--graph->nodes[succ].pending == 0) {
+				graph->order[n_sorted++] = succ;
+			}
+		}
+	}
+	if (n_sorted != n_nodes) {
+		LILV_ERROR("Graph has a cycle\n");
+		return -1;
+	}
+
+	// Start workers, the thread that calls run() is one of them
+	const unsigned n_workers = (graph->n_threads < n_nodes)
+		? graph->n_threads - 1 : (n_nodes ? n_nodes - 1 : 0);
+	if (n_workers != graph->n_workers) {
+		lilv_graph_stop(graph);
+		graph->threads = (LilvGraphThread*)calloc(
+			n_workers, sizeof(LilvGraphThread));
+		for (unsigned i = 0; i < n_workers; ++i) {
+			LilvGraphThread* thread = &graph->threads[i];
+			thread->graph = graph;
+			thread->index = i + 1;
+			if (zix_thread_create(&thread->thread, 0,
+			                      lilv_graph_thread, thread)) {
+				break;
+			}
+			++graph->n_workers;
+		}
+	}
+
+	// Allocate a deque for each thread, large enough for every node
+	lilv_graph_free_deques(graph);
+	graph->n_deques = graph->n_workers + 1;
+	graph->deques   = (LilvGraphDeque*)calloc(
+		graph->n_deques, sizeof(LilvGraphDeque));
+	for (unsigned i = 0; i < graph->n_deques; ++i) {
+		graph->deques[i].tasks = (LilvAtomic*)calloc(
+			n_nodes ? n_nodes : 1, sizeof(LilvAtomic));
+	}
+
+	graph->compiled = true;
+	return 0;
+}
+
+LILV_API int
+lilv_graph_run(LilvGraph* graph, uint32_t sample_count)
+{
+	if (!graph->compiled) {
+		return -1;
+	}
+
+	graph->sample_count = sample_count;
+	if (!graph->n_workers) {
+		// Single-threaded, simply run in topological order
+		for (uint32_t i = 0; i < graph->n_nodes; ++i) {
+			lilv_graph_run_node(graph, &graph->nodes[graph->order[i]]);
+		}
+		return 0;
+	}
+
+	// Reset deques and dependency counters, then spread sources over deques
+	for (unsigned i = 0; i < graph->n_deques; ++i) {
+		graph->deques[i].top    = 0;
+		graph->deques[i].bottom = 0;
+	}
+	for (uint32_t i = 0; i < graph->n_nodes; ++i) {
+		graph->nodes[i].pending = graph->nodes[i].n_deps;
+	}
+	for (uint32_t i = 0; i < graph->n_sources; ++i) {
+		lilv_deque_push(&graph->deques[i % graph->n_deques],
+		                graph->sources[i]);
+	}
+	LILV_BARRIER();
+	graph->n_remaining = graph->n_nodes;
+	LILV_BARRIER();
+
+	// Wake workers and work along with them
+	for (unsigned i = 0; i < graph->n_workers; ++i) {
+		zix_sem_post(&graph->sem);
+	}
+	lilv_graph_work(graph, 0);
+
+	// Wait for workers to leave the cycle, so the deques can be reset
+	for (unsigned idle = 0; graph->n_active > 0;) {
+		if (++idle >= LILV_GRAPH_SPIN) {
+			lilv_graph_wait(graph);
+			idle = 0;
+		}
+	}
+
+	return 0;
+}
+
+LILV_API uint32_t
+lilv_graph_get_num_nodes(const LilvGraph* graph)
+{
+	return graph->n_nodes;
+}
+
+LILV_API const LilvGraphEdge*
+lilv_graph_get_edges(const LilvGraph* graph, uint32_t* n_edges)
+{
+	*n_edges = graph->n_edges;
+	return graph->edges;
+}
+
+LILV_API double
+lilv_graph_get_node_time(const LilvGraph* graph, uint32_t node)
+{
+	return (node < graph->n_nodes) ? graph->nodes[node].time : 0.0;
+}
+
+struct LilvBufferPlanImpl {
+	int32_t*  buffers;    ///< Buffer index of every port of every node, or -1
+	uint32_t* offsets;    ///< Index of the first port of each node in buffers
+	uint32_t  n_nodes;
+	uint32_t  n_buffers;
+};
+
+#define LILV_PLAN_SILENCE 0  ///< Buffer for unconnected audio inputs
+#define LILV_PLAN_NONE    UINT32_MAX
+
+static inline uint32_t
+lilv_plan_num_ports(const LilvBufferPlan* plan, uint32_t node)
+{
+	return plan->offsets[node + 1] - plan->offsets[node];
+}
+
+static inline void
+bits_set(uint64_t* bits, uint32_t i)
+{
+	bits[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
+/** Return true iff every bit set in `a` is also set in `b`. */
+static inline bool
+bits_subset(const uint64_t* a, const uint64_t* b, uint32_t n_words)
+{
+	for (uint32_t w = 0; w < n_words; ++w) {
+		if (a[w] & ~b[w]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+typedef struct {
+	uint64_t* users;      ///< Nodes using the current value of each buffer
+	uint32_t* writers;    ///< Node that wrote the current value of each buffer
+	uint32_t  n_buffers;
+	uint32_t  n_words;    ///< Number of words in a node bit set
+} LilvPlanBuffers;
+
+static uint32_t
+lilv_plan_new_buffer(LilvPlanBuffers* bufs)
+{
+	const uint32_t n_words = bufs->n_words;
+	const uint32_t index   = bufs->n_buffers++;
+
+	bufs->users = (uint64_t*)realloc(
+		bufs->users, bufs->n_buffers * n_words * sizeof(uint64_t));
+	bufs->writers = (uint32_t*)realloc(
+		bufs->writers, bufs->n_buffers * sizeof(uint32_t));
+	memset(bufs->users + index * n_words, 0, n_words * sizeof(uint64_t));
+	bufs->writers[index] = LILV_PLAN_NONE;
+	return index;
+}
+
+/** Return true iff `node` reads buffer `b` on some input. */
+static bool
+lilv_plan_node_reads(const LilvBufferPlan* plan,
+                     const bool*           is_output,
+                     uint32_t              node,
+                     int32_t               b)
+{
+	for (uint32_t i = plan->offsets[node]; i < plan->offsets[node + 1]; ++i) {
+		if (!is_output[i] && plan->buffers[i] == b) {
+			return true;
+		}
+	}
+	return false;
+}
+
+/**
+   Choose a buffer for an output of `node`.
+
+   A buffer may be reused if every node using its current value is `node`
+   itself or one of its ancestors, since those are guaranteed to have run, in
+   any schedule, before `node` writes to it.  Buffers already written by
+   `node` are never shared between its outputs, and its input buffers are
+   preferred so the plugin processes in place unless it is inPlaceBroken.
+*/
+static uint32_t
+lilv_plan_choose_buffer(const LilvBufferPlan* plan,
+                        LilvPlanBuffers*      bufs,
+                        const bool*           is_output,
+                        const uint64_t*       mask,
+                        uint32_t              node,
+                        bool                  in_place_broken)
+{
+	uint32_t choice = LILV_PLAN_NONE;
+	for (uint32_t b = LILV_PLAN_SILENCE + 1; b < bufs->n_buffers; ++b) {
+		const uint64_t* users = bufs->users + b * bufs->n_words;
+		if (bufs->writers[b] == node ||
+		    !bits_subset(users, mask, bufs->n_words)) {
+			continue;
+		}
+
+		const bool is_input = lilv_plan_node_reads(
+			plan, is_output, node, (int32_t)b);
+		if (is_input && in_place_broken) {
+			continue;
+		} else if (is_input) {
+			return b;  // In place, the best choice
+		} else if (choice == LILV_PLAN_NONE) {
+			choice = b;
+		}
+	}
+
+	return (choice != LILV_PLAN_NONE) ? choice : lilv_plan_new_buffer(bufs);
+}
+
+LILV_API LilvBufferPlan*
+lilv_graph_plan_buffers(const LilvGraph*         graph,
+                        const LilvPlugin* const* plugins)
+{
+	if (!graph->compiled) {
+		return NULL;
+	}
+
+	const uint32_t  n_nodes = graph->n_nodes;
+	const uint32_t  n_words = n_nodes / 64 + 1;
+	LilvBufferPlan* plan    = (LilvBufferPlan*)calloc(
+		1, sizeof(LilvBufferPlan));
+	plan->n_nodes = n_nodes;
+	plan->offsets = (uint32_t*)calloc(n_nodes + 1, sizeof(uint32_t));
+	for (uint32_t i = 0; i < n_nodes; ++i) {
+		plan->offsets[i + 1] = plan->offsets[i] +
+			lilv_plugin_get_num_ports(plugins[i]);
+	}
+
+	// Classify ports, unconnected audio inputs use silence
+	const uint32_t n_ports   = plan->offsets[n_nodes];
+	bool*          is_output = (bool*)calloc(n_ports + 1, sizeof(bool));
+	bool*          connected = (bool*)calloc(n_ports + 1, sizeof(bool));
+	uint32_t*      sources   = (uint32_t*)malloc((n_ports + 1) *
+	                                             sizeof(uint32_t));
+	plan->buffers = (int32_t*)malloc((n_ports + 1) * sizeof(int32_t));
+	for (uint32_t i = 0; i < n_nodes; ++i) {
+		const LilvPlugin* plugin = plugins[i];
+		const LilvWorld*  world  = plugin->world;
+		for (uint32_t p = 0; p < plugin->num_ports; ++p) {
+			const LilvPort* port  = plugin->ports[p];
+			const uint32_t  index = plan->offsets[i] + p;
+
+			sources[index] = LILV_PLAN_NONE;
+			if (lilv_port_has_class(port, world->uris.lv2_AudioPort) ||
+			    lilv_port_has_class(port, world->uris.lv2_CVPort)) {
+				is_output[index] = lilv_port_has_class(
+					port, world->uris.lv2_OutputPort);
+				plan->buffers[index] = LILV_PLAN_SILENCE;
+			} else {
+				plan->buffers[index] = -1;
+			}
+		}
+	}
+
+	// Find the source of every connected audio input
+	for (uint32_t e = 0; e < graph->n_edges; ++e) {
+		const LilvGraphEdge* edge = &graph->edges[e];
+		if (edge->src_port >= lilv_plan_num_ports(plan, edge->src_node) ||
+		    edge->dst_port >= lilv_plan_num_ports(plan, edge->dst_node)) {
+			continue;
+		}
+
+		const uint32_t src = plan->offsets[edge->src_node] + edge->src_port;
+		const uint32_t dst = plan->offsets[edge->dst_node] + edge->dst_port;
+		if (plan->buffers[src] < 0 || !is_output[src] ||
+		    plan->buffers[dst] < 0 || is_output[dst]) {
+			continue;  // Not an audio connection, only orders nodes
+		} else if (sources[dst] != LILV_PLAN_NONE && sources[dst] != src) {
+			LILV_ERRORF("Port %u of node %u has several sources\n",
+			            edge->dst_port, edge->dst_node);
+			free(sources);
+			free(connected);
+			free(is_output);
+			lilv_buffer_plan_free(plan);
+			return NULL;
+		}
+		sources[dst]   = src;
+		connected[src] = true;
+	}
+
+	// Find the ancestors of every node, which always run before it
+	uint64_t* ancestors = (uint64_t*)calloc(n_nodes * n_words,
+	                                        sizeof(uint64_t));
+	for (uint32_t i = 0; i < n_nodes; ++i) {
+		const uint32_t       n    = graph->order[i];
+		const LilvGraphNode* node = &graph->nodes[n];
+		for (uint32_t s = 0; s < node->n_successors; ++s) {
+			uint64_t* succ = ancestors + node->successors[s] * n_words;
+			for (uint32_t w = 0; w < n_words; ++w) {
+				succ[w] |= ancestors[n * n_words + w];
+			}
+			bits_set(succ, n);
+		}
+	}
+
+	// Assign buffers to outputs in topological order
+	LilvPlanBuffers bufs = { NULL, NULL, 0, n_words };
+	lilv_plan_new_buffer(&bufs);  // LILV_PLAN_SILENCE
+
+	uint64_t* mask = (uint64_t*)malloc(n_words * sizeof(uint64_t));
+	LilvNode* in_place_broken = n_nodes
+		? lilv_new_uri(plugins[0]->world, LV2_CORE__inPlaceBroken) : NULL;
+	for (uint32_t i = 0; i < n_nodes; ++i) {
+		const uint32_t       n      = graph->order[i];
+		const LilvGraphNode* node   = &graph->nodes[n];
+		const uint32_t       begin  = plan->offsets[n];
+		const uint32_t       end    = plan->offsets[n + 1];
+		const bool           broken = lilv_plugin_has_feature(
+			plugins[n], in_place_broken);
+
+		memcpy(mask, ancestors + n * n_words, n_words * sizeof(uint64_t));
+		bits_set(mask, n);
+
+		// Inputs share the buffer of their source, assigned earlier
+		for (uint32_t p = begin; p < end; ++p) {
+			if (sources[p] != LILV_PLAN_NONE) {
+				plan->buffers[p] = plan->buffers[sources[p]];
+			}
+		}
+
+		for (uint32_t p = begin; p < end; ++p) {
+			if (plan->buffers[p] < 0 || !is_output[p]) {
+				continue;
+			}
+
+			/* Reserve the buffer for this node and every node that reads it.
+			   Unconnected outputs are never read, but still get a buffer of
+			   their own, since nodes that may run concurrently must not
+			   share a scratch buffer. */
+			const uint32_t b = lilv_plan_choose_buffer(
+				plan, &bufs, is_output, mask, n, broken);
+			uint64_t* users = bufs.users + b * n_words;
+			memset(users, 0, n_words * sizeof(uint64_t));
+			bits_set(users, n);
+			for (uint32_t s = 0; connected[p] && s < node->n_successors; ++s) {
+				const uint32_t succ = node->successors[s];
+				for (uint32_t q = plan->offsets[succ];
+				     q < plan->offsets[succ + 1]; ++q) {
+					if (sources[q] == p) {
+						bits_set(users, succ);
+					}
+				}
+			}
+			bufs.writers[b]  = n;
+			plan->buffers[p] = (int32_t)b;
+		}
+	}
+
+	plan->n_buffers = bufs.n_buffers;
+	lilv_node_free(in_place_broken);
+	free(mask);
+	free(bufs.writers);
+	free(bufs.users);
+	free(ancestors);
+	free(sources);
+	free(connected);
+	free(is_output);
+	return plan;
+}
+
+LILV_API void
+lilv_buffer_plan_free(LilvBufferPlan* plan)
+{
+	if (plan) {
+		free(plan->buffers);
+		free(plan->offsets);
+		free(plan);
+	}
+}
+
+LILV_API uint32_t
+lilv_buffer_plan_get_num_buffers(const LilvBufferPlan* plan)
+{
+	return plan->n_buffers;
+}
+
+LILV_API int32_t
+lilv_buffer_plan_get_buffer(const LilvBufferPlan* plan,
+                            uint32_t              node,
+                            uint32_t              port)
+{
+	if (node >= plan->n_nodes || port >= lilv_plan_num_ports(plan, node)) {
+		return -1;
+	}
+	return plan->buffers[plan->offsets[node] + port];
+}
+
+LILV_API void
+lilv_buffer_plan_connect(const LilvBufferPlan* plan,
+                         const LilvGraph*      graph,
+                         float*                buffers,
+                         uint32_t              stride)
+{
+	for (uint32_t n = 0; n < plan->n_nodes && n < graph->n_nodes; ++n) {
+		LilvInstance* instance = graph->nodes[n].instance;
+		for (uint32_t p = 0; p < lilv_plan_num_ports(plan, n); ++p) {
+			const int32_t b = plan->buffers[plan->offsets[n] + p];
+			if (b >= 0) {
+				instance->lv2_descriptor->connect_port(
+					instance->lv2_handle, p, buffers + (size_t)b * stride);
+			}
+		}
+	}
+}
@@ -18,100 +18,230 @@
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#    include <unistd.h>
+#endif
+
+#include "lv2/lv2plug.in/ns/ext/worker/worker.h"
+
 #include "lilv_internal.h"
 
-LILV_API LilvInstance*
-lilv_plugin_instantiate(const LilvPlugin*        plugin,
-                        double                   sample_rate,
-                        const LV2_Feature*const* features)
+static bool
+lilv_features_contain(const LV2_Feature*const* features, const char* uri)
 {
+	for (const LV2_Feature*const* f = features; f && *f; ++f) {
+		if (!strcmp((*f)->URI, uri)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+LilvInstantiateStatus
+lilv_instance_info_init(LilvInstanceInfo* info, const LilvPlugin* plugin)
+{
+	memset(info, 0, sizeof(LilvInstanceInfo));
 	lilv_plugin_load_if_necessary(plugin);
 	if (plugin->parse_errors) {
-		return NULL;
+		return LILV_INSTANTIATE_ERR_DATA;
 	}
 
-	LilvInstance* result = NULL;
+	info->world   = plugin->world;
+	info->lib_uri = lilv_plugin_get_library_uri(plugin);
+	if (!info->lib_uri) {
+		return LILV_INSTANTIATE_ERR_DATA;
+	}
 
-	const LilvNode* const lib_uri    = lilv_plugin_get_library_uri(plugin);
-	const LilvNode* const bundle_uri = lilv_plugin_get_bundle_uri(plugin);
+	info->bundle_uri  = lilv_node_as_uri(lilv_plugin_get_bundle_uri(plugin));
+	info->bundle_path = lilv_file_uri_parse(info->bundle_uri, NULL);
+	info->plugin_uri  = lilv_node_as_uri(lilv_plugin_get_uri(plugin));
+	info->num_ports   = lilv_plugin_get_num_ports(plugin);
 
-	char* const bundle_path = lilv_file_uri_parse(
-		lilv_node_as_uri(lilv_plugin_get_bundle_uri(plugin)), NULL);
+	// Note whether the plugin can use a worker provided by lilv
+	LilvWorld* const world = plugin->world;
+	info->worker = (lilv_world_ask_internal(world, plugin->plugin_uri->node,
+	                                        world->uris.lv2_requiredFeature,
+	                                        world->uris.work_schedule) ||
+	                lilv_world_ask_internal(world, plugin->plugin_uri->node,
+	                                        world->uris.lv2_optionalFeature,
+	                                        world->uris.work_schedule));
+	return LILV_INSTANTIATE_SUCCESS;
+}
 
-	LilvLib* lib = lilv_lib_open(plugin->world, lib_uri, bundle_path, features);
+LilvInstance*
+lilv_instance_new(const LilvInstanceInfo*  info,
+                  double                   sample_rate,
+                  const LV2_Feature*const* features,
+                  LilvInstantiateStatus*   status)
+{
+	LilvLib* lib = lilv_lib_open(
+		info->world, info->lib_uri, info->bundle_path, features);
 	if (!lib) {
-		lilv_free(bundle_path);
+		*status = LILV_INSTANTIATE_ERR_LIBRARY;
 		return NULL;
 	}
 
-	// Parse bundle URI to use as base URI
-	const char* bundle_uri_str = lilv_node_as_uri(bundle_uri);
-	SerdURI     base_uri;
-	if (serd_uri_parse((const uint8_t*)bundle_uri_str, &base_uri)) {
+	// Look up plugin by URI, resolving library URIs against the bundle URI
+	const LV2_Descriptor* ld = lilv_lib_get_plugin_by_uri(
+		lib, info->bundle_uri, info->plugin_uri);
+	if (!ld) {
+		LILV_ERRORF("No plugin <%s> in <%s>\n",
+		            info->plugin_uri, lilv_node_as_uri(info->lib_uri));
 		lilv_lib_close(lib);
-		lilv_free(bundle_path);
+		*status = LILV_INSTANTIATE_ERR_NOT_FOUND;
 		return NULL;
 	}
 
-	const LV2_Feature** local_features = NULL;
-	if (features == NULL) {
-		local_features = (const LV2_Feature**)malloc(sizeof(LV2_Feature*));
-		local_features[0] = NULL;
+	// Provide a worker if the plugin supports one and the host does not
+	LilvWorker*         worker       = NULL;
+	const LV2_Feature** all_features = NULL;
+	if (info->worker &&
+	    !lilv_features_contain(features, LV2_WORKER__schedule)) {
+		worker       = lilv_worker_new(info->world);
+		all_features = lilv_worker_add_feature(worker, features);
+		features     = all_features;
 	}
 
-	// Search for plugin by URI
-	for (uint32_t i = 0; true; ++i) {
-		const LV2_Descriptor* ld = lilv_lib_get_plugin(lib, i);
-		if (!ld) {
-			LILV_ERRORF("No plugin <%s> in <%s>\n",
-			            lilv_node_as_uri(lilv_plugin_get_uri(plugin)),
-			            lilv_node_as_uri(lib_uri));
-			lilv_lib_close(lib);
-			break;  // return NULL
-		}
+	const LV2_Feature* local_features[] = { NULL };
+	LV2_Handle         handle           = ld->instantiate(
+		ld, sample_rate, info->bundle_path,
+		(features) ? features : local_features);
+	free(all_features);
+	if (!handle) {
+		lilv_worker_free(worker);
+		lilv_lib_close(lib);
+		*status = LILV_INSTANTIATE_ERR_FAILED;
+		return NULL;
+	}
+
+	if (worker) {
+		lilv_worker_attach(worker, ld, handle);
+	}
+
+	struct LilvInstancePimpl* pimpl = (struct LilvInstancePimpl*)malloc(
+		sizeof(struct LilvInstancePimpl));
+	pimpl->world  = info->world;
+	pimpl->lib    = lib;
+	pimpl->worker = worker;
+	pimpl->stats  = NULL;
+
+	// Create LilvInstance to return
+	LilvInstance* result = (LilvInstance*)malloc(sizeof(LilvInstance));
+	result->lv2_descriptor = ld;
+	result->lv2_handle     = handle;
+	result->pimpl          = pimpl;
+
+	// "Connect" all ports to NULL (catches bugs)
+	for (uint32_t i = 0; i < info->num_ports; ++i)
+		result->lv2_descriptor->connect_port(result->lv2_handle, i, NULL);
+
+	*status = LILV_INSTANTIATE_SUCCESS;
+	return result;
+}
+
+LILV_API LilvInstance*
+lilv_plugin_instantiate(const LilvPlugin*        plugin,
+                        double                   sample_rate,
+                        const LV2_Feature*const* features)
+{
+	LilvInstance*         result = NULL;
+	LilvInstanceInfo      info;
+	LilvInstantiateStatus st = lilv_instance_info_init(&info, plugin);
+	if (st == LILV_INSTANTIATE_SUCCESS) {
+		result = lilv_instance_new(&info, sample_rate, features, &st);
+	}
 
-		// Resolve library plugin URI against base URI
-		SerdURI  abs_uri;
-		SerdNode abs_uri_node = serd_node_new_uri_from_string(
-			(const uint8_t*)ld->URI, &base_uri, &abs_uri);
-		if (!abs_uri_node.buf) {
-			LILV_ERRORF("Failed to parse plugin URI `%s'\n", ld->URI);
-			lilv_lib_close(lib);
+	lilv_free(info.bundle_path);
+	return result;
+}
+
+typedef struct {
+	LilvInstantiateRequest* requests;
+	LilvInstanceInfo*       infos;
+	unsigned                n_requests;
+	unsigned                next;   ///< Index of next request to process
+	ZixMutex                mutex;  ///< Protects next
+} LilvInstantiateBatch;
+
+static void*
+lilv_instantiate_batch_thread(void* data)
+{
+	LilvInstantiateBatch* batch = (LilvInstantiateBatch*)data;
+	for (;;) {
+		zix_mutex_lock(&batch->mutex);
+		const unsigned i = batch->next++;
+		zix_mutex_unlock(&batch->mutex);
+		if (i >= batch->n_requests) {
 			break;
 		}
 
-		if (!strcmp((const char*)abs_uri_node.buf,
-		            lilv_node_as_uri(lilv_plugin_get_uri(plugin)))) {
-			// Create LilvInstance to return
-			result = (LilvInstance*)malloc(sizeof(LilvInstance));
-			result->lv2_descriptor = ld;
-			result->lv2_handle = ld->instantiate(
-				ld, sample_rate, bundle_path,
-				(features) ? features : local_features);
-			result->pimpl = lib;
-			serd_node_free(&abs_uri_node);
-			break;
-		} else {
-			serd_node_free(&abs_uri_node);
+		LilvInstantiateRequest* req = &batch->requests[i];
+		if (req->status == LILV_INSTANTIATE_SUCCESS) {
+			req->instance = lilv_instance_new(
+				&batch->infos[i], req->sample_rate, req->features,
+				&req->status);
 		}
 	}
+	return NULL;
+}
 
-	free(local_features);
-	lilv_free(bundle_path);
+LILV_API unsigned
+lilv_plugins_instantiate_batch(unsigned                n_requests,
+                               LilvInstantiateRequest* requests,
+                               unsigned                n_threads)
+{
+	if (!n_requests) {
+		return 0;
+	}
 
-	if (result) {
-		// Failed to instantiate
-		if (result->lv2_handle == NULL) {
-			free(result);
-			return NULL;
+	LilvInstantiateBatch batch;
+	batch.requests   = requests;
+	batch.infos      = (LilvInstanceInfo*)malloc(
+		n_requests * sizeof(LilvInstanceInfo));
+	batch.n_requests = n_requests;
+	batch.next       = 0;
+
+	// Gather plugin information here, since plugin data is not thread-safe
+	for (unsigned i = 0; i < n_requests; ++i) {
+		requests[i].instance = NULL;
+		requests[i].status   = lilv_instance_info_init(
+			&batch.infos[i], requests[i].plugin);
+	}
+
+	if (!n_threads) {
+		n_threads = lilv_num_processors();
+	}
+	if (n_threads > n_requests) {
+		n_threads = n_requests;
+	}
+
+	// Run workers, with this thread as the first one
+	zix_mutex_init(&batch.mutex);
+	ZixThread* threads   = (ZixThread*)calloc(n_threads, sizeof(ZixThread));
+	unsigned   n_started = 0;
+	for (unsigned i = 1; i < n_threads; ++i) {
+		if (zix_thread_create(&threads[n_started], 0,
+		                      lilv_instantiate_batch_thread, &batch)) {
+			break;  // Carry on with the threads that were started
 		}
+		++n_started;
+	}
 
-		// "Connect" all ports to NULL (catches bugs)
-		for (uint32_t i = 0; i < lilv_plugin_get_num_ports(plugin); ++i)
-			result->lv2_descriptor->connect_port(result->lv2_handle, i, NULL);
+	lilv_instantiate_batch_thread(&batch);
+	for (unsigned i = 0; i < n_started; ++i) {
+		zix_thread_join(threads[i], NULL);
 	}
+	zix_mutex_destroy(&batch.mutex);
+	free(threads);
 
-	return result;
+	unsigned n_instances = 0;
+	for (unsigned i = 0; i < n_requests; ++i) {
+		lilv_free(batch.infos[i].bundle_path);
+		n_instances += requests[i].instance ? 1 : 0;
+	}
+
+	free(batch.infos);
+	return n_instances;
 }
 
 LILV_API void
@@ -120,9 +250,40 @@ lilv_instance_free(LilvInstance* instance)
 	if (!instance)
 		return;
 
+	// Stop work for this instance before cleaning it up
+	struct LilvInstancePimpl* pimpl =
+		(struct LilvInstancePimpl*)instance->pimpl;
+	lilv_worker_free(pimpl->worker);
+
 	instance->lv2_descriptor->cleanup(instance->lv2_handle);
 	instance->lv2_descriptor = NULL;
-	lilv_lib_close((LilvLib*)instance->pimpl);
+	lilv_lib_close(pimpl->lib);
+	free(pimpl->stats);
+	free(pimpl);
 	instance->pimpl = NULL;
 	free(instance);
 }
+
+LILV_API bool
+lilv_instance_has_worker(const LilvInstance* instance)
+{
+	return ((const struct LilvInstancePimpl*)instance->pimpl)->worker;
+}
+
+LILV_API void
+lilv_instance_end_run(LilvInstance* instance)
+{
+	LilvWorker* worker = ((struct LilvInstancePimpl*)instance->pimpl)->worker;
+	if (worker) {
+		lilv_worker_emit_responses(worker);
+	}
+}
+
+LILV_API void
+lilv_instance_wait_for_work(LilvInstance* instance)
+{
+	LilvWorker* worker = ((struct LilvInstancePimpl*)instance->pimpl)->worker;
+	if (worker) {
+		lilv_worker_wait(worker);
+	}
+}
@@ -0,0 +1,228 @@
+/*
+  Copyright 2016 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+
+#include "lilv_internal.h"
+
+struct LilvInstancePoolImpl {
+	LilvInstanceInfo         info;
+	LilvLib*                 lib;          ///< Reference held for lifetime
+	double                   sample_rate;
+	const LV2_Feature*const* features;
+	const LilvState*         state;
+	unsigned                 size;         ///< Number of instances to keep ready
+	ZixRing*                 ready;        ///< Activated instances to hand out
+	ZixRing*                 returned;     ///< Used instances to be reset
+	ZixSem                   sem;          ///< Signals the pool thread
+	ZixThread                thread;
+	bool                     running;      ///< True iff thread is running
+	bool                     exit;         ///< Set to stop the pool thread
+};
+
+static void
+activate(LilvInstance* instance)
+{
+	if (instance->lv2_descriptor->activate) {
+		instance->lv2_descriptor->activate(instance->lv2_handle);
+	}
+}
+
+static void
+deactivate(LilvInstance* instance)
+{
+	if (instance->lv2_descriptor->deactivate) {
+		instance->lv2_descriptor->deactivate(instance->lv2_handle);
+	}
+}
+
+static LilvInstance*
+lilv_instance_pool_new_instance(LilvInstancePool* pool)
+{
+	LilvInstantiateStatus st       = LILV_INSTANTIATE_SUCCESS;
+	LilvInstance*         instance = lilv_instance_new(
+		&pool->info, pool->sample_rate, pool->features, &st);
+	if (instance) {
+		if (pool->state) {
+			lilv_state_restore(pool->state, instance, NULL, NULL, 0,
+			                   pool->features);
+		}
+		activate(instance);
+	}
+	return instance;
+}
+
+static unsigned
+lilv_instance_pool_n_ready(const LilvInstancePool* pool)
+{
+	return zix_ring_read_space(pool->ready) / sizeof(LilvInstance*);
+}
+
+/** Add an activated instance to the ready ring, or free it if it is full. */
+static void
+lilv_instance_pool_add(LilvInstancePool* pool, LilvInstance* instance)
+{
+	if (zix_ring_write(pool->ready, &instance, sizeof(instance))
+	    != sizeof(instance)) {
+		deactivate(instance);
+		lilv_instance_free(instance);
+	}
+}
+
+/** Reset returned instances, and create new ones until the pool is full. */
+static void
+lilv_instance_pool_refill(LilvInstancePool* pool)
+{
+	LilvInstance* instance = NULL;
+	while (zix_ring_read(pool->returned, &instance, sizeof(instance))) {
+		deactivate(instance);
+		if (pool->state) {
+			lilv_state_restore(pool->state, instance, NULL, NULL, 0,
+			                   pool->features);
+		}
+		activate(instance);
+		lilv_instance_pool_add(pool, instance);
+	}
+
+	while (lilv_instance_pool_n_ready(pool) < pool->size &&
+	       (instance = lilv_instance_pool_new_instance(pool))) {
+		lilv_instance_pool_add(pool, instance);
+	}
+}
+
+static void*
+lilv_instance_pool_thread(void* data)
+{
+	LilvInstancePool* pool = (LilvInstancePool*)data;
+	while (!zix_sem_wait(&pool->sem) && !pool->exit) {
+		lilv_instance_pool_refill(pool);
+	}
+	return NULL;
+}
+
+LILV_API LilvInstancePool*
+lilv_instance_pool_new(const LilvPlugin*        plugin,
+                       double                   sample_rate,
+                       const LV2_Feature*const* features,
+                       const LilvState*         state,
+                       unsigned                 size)
+{
+	LilvInstancePool* pool = (LilvInstancePool*)calloc(
+		1, sizeof(LilvInstancePool));
+
+	const uint32_t ring_size = (size + 1) * 2 * sizeof(LilvInstance*);
+	pool->sample_rate = sample_rate;
+	pool->features    = features;
+	pool->state       = state;
+	pool->size        = size ? size : 1;
+	pool->ready       = zix_ring_new(ring_size);
+	pool->returned    = zix_ring_new(ring_size);
+	pool->running     = false;
+	pool->exit        = false;
+	zix_ring_mlock(pool->ready);
+	zix_ring_mlock(pool->returned);
+	zix_sem_init(&pool->sem, 0);
+
+	if (lilv_instance_info_init(&pool->info, plugin)) {
+		lilv_instance_pool_free(pool);
+		return NULL;
+	}
+
+	/* Hold a library reference for the lifetime of the pool, so the pool
+	   thread never opens or closes the library itself, which would create or
+	   free nodes while the world may be in use by another thread. */
+	pool->lib = lilv_lib_open(pool->info.world, pool->info.lib_uri,
+	                          pool->info.bundle_path, features);
+	if (!pool->lib) {
+		lilv_instance_pool_free(pool);
+		return NULL;
+	}
+
+	// Fill the pool before returning, so the first get() succeeds
+	lilv_instance_pool_refill(pool);
+	if (!lilv_instance_pool_n_ready(pool)) {
+		lilv_instance_pool_free(pool);
+		return NULL;
+	}
+
+	if (zix_thread_create(&pool->thread, 0, lilv_instance_pool_thread, pool)) {
+		LILV_ERROR("Failed to create instance pool thread\n");
+		lilv_instance_pool_free(pool);
+		return NULL;
+	}
+
+	pool->running = true;
+	return pool;
+}
+
+static void
+lilv_instance_pool_drain(ZixRing* ring)
+{
+	LilvInstance* instance = NULL;
+	while (zix_ring_read(ring, &instance, sizeof(instance))) {
+		deactivate(instance);
+		lilv_instance_free(instance);
+	}
+}
+
+LILV_API void
+lilv_instance_pool_free(LilvInstancePool* pool)
+{
+	if (!pool) {
+		return;
+	}
+
+	if (pool->running) {
+		pool->exit = true;
+		zix_sem_post(&pool->sem);
+		zix_thread_join(pool->thread, NULL);
+	}
+
+	lilv_instance_pool_drain(pool->ready);
+	lilv_instance_pool_drain(pool->returned);
+	zix_ring_free(pool->returned);
+	zix_ring_free(pool->ready);
+	zix_sem_destroy(&pool->sem);
+	if (pool->lib) {
+		lilv_lib_close(pool->lib);
+	}
+	lilv_free(pool->info.bundle_path);
+	free(pool);
+}
+
+LILV_API LilvInstance*
+lilv_instance_pool_get(LilvInstancePool* pool)
+{
+	LilvInstance* instance = NULL;
+	if (!zix_ring_read(pool->ready, &instance, sizeof(instance))) {
+		instance = NULL;
+	}
+
+	zix_sem_post(&pool->sem);  // Wake pool thread to refill
+	return instance;
+}
+
+LILV_API int
+lilv_instance_pool_put(LilvInstancePool* pool, LilvInstance* instance)
+{
+	if (zix_ring_write(pool->returned, &instance, sizeof(instance))
+	    != sizeof(instance)) {
+		return -1;
+	}
+
+	zix_sem_post(&pool->sem);  // Wake pool thread to reset instance
+	return 0;
+}
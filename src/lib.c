@@ -14,22 +14,89 @@
   OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
 */
 
+#include <string.h>
+
 #include "lilv_internal.h"
 
+static int
+lib_plugin_cmp(const void* a, const void* b, void* user_data)
+{
+	return strcmp(((const LilvLibPlugin*)a)->uri,
+	              ((const LilvLibPlugin*)b)->uri);
+}
+
+static void
+lib_plugin_free(void* ptr)
+{
+	free(((LilvLibPlugin*)ptr)->uri);
+	free(ptr);
+}
+
+/**
+   Close preloaded handles of the library at `path`, or libraries in `dir`.
+
+   This must be called with libs_mutex held.  Libraries that the preload
+   thread has not opened yet are skipped, or closed as soon as they are.
+*/
+static void
+lilv_lib_preload_release_unlocked(LilvWorld*  world,
+                                  const char* path,
+                                  const char* dir)
+{
+	LilvPreload* const preload = &world->preload;
+	for (unsigned i = 0; i < preload->n_paths; ++i) {
+		if (!preload->released[i]
+		    && ((path && !strcmp(preload->paths[i], path))
+		        || (dir && lilv_path_is_child(preload->paths[i], dir)))) {
+			if (preload->handles[i]) {
+				dlclose(preload->handles[i]);
+				preload->handles[i] = NULL;
+			}
+			preload->released[i] = true;
+		}
+	}
+}
+
+/**
+   Return the open library `key` with a new reference, or NULL.
+   This must be called with libs_mutex held.
+*/
+static LilvLib*
+lilv_lib_ref_unlocked(LilvWorld* world, const LilvLib* key)
+{
+	ZixTreeIter* i = NULL;
+	if (!zix_tree_find(world->libs, key, &i)) {
+		LilvLib* llib = (LilvLib*)zix_tree_get(i);
+		++llib->refs;
+		return llib;
+	}
+	return NULL;
+}
+
+/**
+   Open the library at `uri`, or return the already open one.
+
+   The library is opened and its descriptor is fetched without holding
+   libs_mutex, since both may take a long time, and plugin code may run while
+   they do.  If another thread opened the same library meanwhile, its entry is
+   used and this one is dropped.
+*/
 LilvLib*
 lilv_lib_open(LilvWorld*               world,
               const LilvNode*          uri,
               const char*              bundle_path,
               const LV2_Feature*const* features)
 {
-	ZixTreeIter*  i   = NULL;
 	const LilvLib key = {
-		world, (LilvNode*)uri, (char*)bundle_path, NULL, NULL, NULL, 0
+		world, (LilvNode*)uri, (char*)bundle_path,
+		NULL, NULL, NULL, NULL, 0, 0, 0
 	};
-	if (!zix_tree_find(world->libs, &key, &i)) {
-		LilvLib* llib = (LilvLib*)zix_tree_get(i);
-		++llib->refs;
-		return llib;
+
+	zix_mutex_lock(&world->libs_mutex);
+	LilvLib* existing = lilv_lib_ref_unlocked(world, &key);
+	zix_mutex_unlock(&world->libs_mutex);
+	if (existing) {
+		return existing;
 	}
 
 	const char* const lib_uri  = lilv_node_as_uri(uri);
@@ -57,6 +124,7 @@ lilv_lib_open(LilvWorld*               world,
 		desc = ldf(bundle_path, features);
 		if (!desc) {
 			LILV_ERRORF("Call to %s:lv2_lib_descriptor failed\n", lib_path);
+			dlclose(lib);
 			lilv_free(lib_path);
 			return NULL;
 		}
@@ -67,6 +135,23 @@ lilv_lib_open(LilvWorld*               world,
 		lilv_free(lib_path);
 		return NULL;
 	}
+
+	const size_t size = lilv_file_size(lib_path);
+
+	zix_mutex_lock(&world->libs_mutex);
+	if ((existing = lilv_lib_ref_unlocked(world, &key))) {
+		// Opened by another thread meanwhile, drop this handle
+		zix_mutex_unlock(&world->libs_mutex);
+		if (desc && desc->cleanup) {
+			desc->cleanup(desc->handle);
+		}
+		dlclose(lib);
+		lilv_free(lib_path);
+		return existing;
+	}
+
+	// Now that lib holds a reference, do not keep the library open for it
+	lilv_lib_preload_release_unlocked(world, lib_path, NULL);
 	lilv_free(lib_path);
 
 	LilvLib* llib = (LilvLib*)malloc(sizeof(LilvLib));
@@ -76,9 +161,13 @@ lilv_lib_open(LilvWorld*               world,
 	llib->lib            = lib;
 	llib->lv2_descriptor = df;
 	llib->desc           = desc;
+	llib->plugins        = NULL;
+	llib->size           = size;
+	llib->last_used      = 0;
 	llib->refs           = 1;
 
 	zix_tree_insert(world->libs, llib, NULL);
+	zix_mutex_unlock(&world->libs_mutex);
 	return llib;
 }
 
@@ -94,19 +183,275 @@ lilv_lib_get_plugin(LilvLib* lib, uint32_t index)
 	return NULL;
 }
 
+/**
+   Build the index of all plugins in `lib` by absolute URI.
+
+   Descriptor URIs are resolved against `base_uri` once here, so later
+   lookups do not need to walk every descriptor and allocate its URI.
+*/
+static void
+lilv_lib_index_plugins(LilvLib* lib, const char* base_uri)
+{
+	lib->plugins = zix_tree_new(false, lib_plugin_cmp, NULL, lib_plugin_free);
+
+	SerdURI base;
+	if (serd_uri_parse((const uint8_t*)base_uri, &base)) {
+		return;
+	}
+
+	for (uint32_t i = 0; true; ++i) {
+		const LV2_Descriptor* ld = lilv_lib_get_plugin(lib, i);
+		if (!ld) {
+			break;
+		}
+
+		SerdURI  abs_uri;
+		SerdNode abs_uri_node = serd_node_new_uri_from_string(
+			(const uint8_t*)ld->URI, &base, &abs_uri);
+		if (!abs_uri_node.buf) {
+			LILV_ERRORF("Failed to parse plugin URI `%s'\n", ld->URI);
+			continue;
+		}
+
+		LilvLibPlugin* entry = (LilvLibPlugin*)malloc(sizeof(LilvLibPlugin));
+		entry->uri  = (char*)abs_uri_node.buf;
+		entry->desc = ld;
+		if (zix_tree_insert(lib->plugins, entry, NULL)) {
+			lib_plugin_free(entry);  // Duplicate URI, first one wins
+		}
+	}
+}
+
+const LV2_Descriptor*
+lilv_lib_get_plugin_by_uri(LilvLib*    lib,
+                           const char* base_uri,
+                           const char* plugin_uri)
+{
+	zix_mutex_lock(&lib->world->libs_mutex);
+	if (!lib->plugins) {
+		lilv_lib_index_plugins(lib, base_uri);
+	}
+
+	const LV2_Descriptor* desc = NULL;
+	ZixTreeIter*          i    = NULL;
+	const LilvLibPlugin   key  = { (char*)plugin_uri, NULL };
+	if (!zix_tree_find(lib->plugins, &key, &i)) {
+		desc = ((const LilvLibPlugin*)zix_tree_get(i))->desc;
+	}
+	zix_mutex_unlock(&lib->world->libs_mutex);
+	return desc;
+}
+
+static void
+lilv_lib_free(LilvLib* lib)
+{
+	dlclose(lib->lib);
+
+	ZixTreeIter* i = NULL;
+	if (lib->world->libs && !zix_tree_find(lib->world->libs, lib, &i)) {
+		zix_tree_remove(lib->world->libs, i);
+	}
+
+	zix_tree_free(lib->plugins);
+	lilv_node_free(lib->uri);
+	free(lib->bundle_path);
+	free(lib);
+}
+
+/**
+   Close unused libraries that are no longer wanted.
+
+   If `bundle_path` is given, all unused libraries loaded from that bundle are
+   closed.  Then, the least recently used libraries are closed until the
+   remaining unused ones fit within the limits set by LILV_OPTION_KEEP_LIBS and
+   LILV_OPTION_KEEP_LIBS_SIZE.
+*/
+static void
+lilv_lib_trim_unlocked(LilvWorld* world, const char* bundle_path)
+{
+	if (bundle_path) {
+		lilv_lib_preload_release_unlocked(world, NULL, bundle_path);
+
+		ZixTreeIter* i = zix_tree_begin(world->libs);
+		while (!zix_tree_iter_is_end(i)) {
+			LilvLib*     lib  = (LilvLib*)zix_tree_get(i);
+			ZixTreeIter* next = zix_tree_iter_next(i);
+			if (lib->refs == 0 && !strcmp(lib->bundle_path, bundle_path)) {
+				lilv_lib_free(lib);
+			}
+			i = next;
+		}
+	}
+
+	for (;;) {
+		unsigned n_unused    = 0;
+		size_t   unused_size = 0;
+		LilvLib* lru         = NULL;
+		for (ZixTreeIter* i = zix_tree_begin(world->libs);
+		     !zix_tree_iter_is_end(i);
+		     i = zix_tree_iter_next(i)) {
+			LilvLib* lib = (LilvLib*)zix_tree_get(i);
+			if (lib->refs == 0) {
+				++n_unused;
+				unused_size += lib->size;
+				if (!lru || lib->last_used < lru->last_used) {
+					lru = lib;
+				}
+			}
+		}
+
+		if (!lru || (n_unused <= world->opt.keep_libs &&
+		             (!world->opt.keep_libs_size ||
+		              unused_size <= world->opt.keep_libs_size))) {
+			break;
+		}
+
+		lilv_lib_free(lru);
+	}
+}
+
+void
+lilv_lib_trim(LilvWorld* world, const char* bundle_path)
+{
+	if (bundle_path) {
+		// Wait for preloading, so no library in the bundle is opened after
+		lilv_lib_preload_wait(world);
+	}
+
+	zix_mutex_lock(&world->libs_mutex);
+	lilv_lib_trim_unlocked(world, bundle_path);
+	zix_mutex_unlock(&world->libs_mutex);
+}
+
 void
 lilv_lib_close(LilvLib* lib)
 {
+	LilvWorld* const world = lib->world;
+	if (!world->libs) {
+		if (--lib->refs == 0) {
+			lilv_lib_free(lib);  // World has been destroyed
+		}
+		return;
+	}
+
+	zix_mutex_lock(&world->libs_mutex);
 	if (--lib->refs == 0) {
-		dlclose(lib->lib);
+		lib->last_used = ++world->lib_clock;
+		lilv_lib_trim_unlocked(world, NULL);
+	}
+	zix_mutex_unlock(&world->libs_mutex);
+}
+
+static void*
+lilv_lib_preload_thread(void* data)
+{
+	LilvWorld* const   world   = (LilvWorld*)data;
+	LilvPreload* const preload = &world->preload;
+	for (unsigned i = 0; i < preload->n_paths; ++i) {
+		zix_mutex_lock(&world->libs_mutex);
+		const bool wanted = !preload->released[i];
+		zix_mutex_unlock(&world->libs_mutex);
 
-		ZixTreeIter* i = NULL;
-		if (lib->world->libs && !zix_tree_find(lib->world->libs, lib, &i)) {
-			zix_tree_remove(lib->world->libs, i);
+		void* const handle = wanted ? dlopen(preload->paths[i], RTLD_NOW) : NULL;
+
+		// Close the handle if it was released while the library was opened
+		zix_mutex_lock(&world->libs_mutex);
+		if (handle && preload->released[i]) {
+			dlclose(handle);
+		} else {
+			preload->handles[i] = handle;
 		}
+		zix_mutex_unlock(&world->libs_mutex);
+	}
+	return NULL;
+}
 
-		lilv_node_free(lib->uri);
-		free(lib->bundle_path);
-		free(lib);
+void
+lilv_lib_preload_wait(LilvWorld* world)
+{
+	LilvPreload* const preload = &world->preload;
+	if (preload->running) {
+		zix_thread_join(preload->thread, NULL);
+		preload->running = false;
 	}
 }
+
+void
+lilv_lib_preload_join(LilvWorld* world)
+{
+	lilv_lib_preload_wait(world);
+
+	LilvPreload* const preload = &world->preload;
+	zix_mutex_lock(&world->libs_mutex);
+	for (unsigned i = 0; i < preload->n_paths; ++i) {
+		if (preload->handles[i]) {
+			dlclose(preload->handles[i]);
+		}
+		lilv_free(preload->paths[i]);
+	}
+
+	free(preload->paths);
+	free(preload->handles);
+	free(preload->released);
+	preload->paths    = NULL;
+	preload->handles  = NULL;
+	preload->released = NULL;
+	preload->n_paths  = 0;
+	zix_mutex_unlock(&world->libs_mutex);
+}
+
+LILV_API int
+lilv_world_preload_libraries(LilvWorld* world)
+{
+	lilv_lib_preload_join(world);
+
+	// Find all library paths here, since plugin data is not thread-safe
+	const unsigned n_plugins = lilv_plugins_size(world->plugins);
+	char** const   paths     = (char**)calloc(n_plugins, sizeof(char*));
+	unsigned       n_paths   = 0;
+	LILV_FOREACH(plugins, i, world->plugins) {
+		const LilvPlugin* p = lilv_plugins_get(world->plugins, i);
+		lilv_plugin_load_if_necessary(p);
+		if (!lilv_world_ask_internal(
+			    world, p->plugin_uri->node, world->uris.lv2_binary, NULL)) {
+			continue;
+		}
+
+		const LilvNode* uri  = lilv_plugin_get_library_uri(p);
+		char*           path = uri ? lilv_file_uri_parse(
+			lilv_node_as_uri(uri), NULL) : NULL;
+		if (!path) {
+			continue;
+		}
+
+		// Skip libraries shared by several plugins
+		bool dup = false;
+		for (unsigned j = 0; j < n_paths && !dup; ++j) {
+			dup = !strcmp(paths[j], path);
+		}
+		if (dup) {
+			lilv_free(path);
+		} else {
+			paths[n_paths++] = path;
+		}
+	}
+
+	// Publish paths under the lock, since libraries may be opened meanwhile
+	LilvPreload* const preload = &world->preload;
+	zix_mutex_lock(&world->libs_mutex);
+	preload->paths    = paths;
+	preload->handles  = (void**)calloc(n_plugins, sizeof(void*));
+	preload->released = (bool*)calloc(n_plugins, sizeof(bool));
+	preload->n_paths  = n_paths;
+	zix_mutex_unlock(&world->libs_mutex);
+
+	if (zix_thread_create(&preload->thread, 0,
+	                      lilv_lib_preload_thread, world)) {
+		LILV_ERROR("Failed to create library preload thread\n");
+		lilv_lib_preload_join(world);
+		return -1;
+	}
+
+	preload->running = true;
+	return 0;
+}
@@ -52,15 +52,36 @@ static inline char* dlerror(void) { return "Unknown error"; }
 #include "serd/serd.h"
 #include "sord/sord.h"
 
+#include "zix/ring.h"
+#include "zix/sem.h"
+#include "zix/thread.h"
 #include "zix/tree.h"
 
 #include "lilv_config.h"
 #include "lilv/lilv.h"
+#include "lilv/portbuffers.h"
 
 #ifdef LILV_DYN_MANIFEST
 #    include "lv2/lv2plug.in/ns/ext/dynmanifest/dynmanifest.h"
 #endif
 
+/* Minimal atomic operations, for lock-free communication between threads. */
+#ifdef _WIN32
+typedef volatile LONG LilvAtomic;
+#    define LILV_ATOMIC_ADD(ptr, val) (InterlockedExchangeAdd((ptr), (val)))
+#    define LILV_ATOMIC_DEC(ptr)      (InterlockedDecrement(ptr))
+#    define LILV_ATOMIC_CAS(ptr, old, new) \
+	(InterlockedCompareExchange((ptr), (new), (old)) == (old))
+#    define LILV_BARRIER()            MemoryBarrier()
+#else
+typedef volatile long LilvAtomic;
+#    define LILV_ATOMIC_ADD(ptr, val) (__sync_fetch_and_add((ptr), (val)))
+#    define LILV_ATOMIC_DEC(ptr)      (__sync_sub_and_fetch((ptr), 1))
+#    define LILV_ATOMIC_CAS(ptr, old, new) \
+	(__sync_bool_compare_and_swap((ptr), (old), (new)))
+#    define LILV_BARRIER()            __sync_synchronize()
+#endif
+
 /*
  *
  * Types
@@ -111,9 +132,33 @@ typedef struct {
 	void*                     lib;
 	LV2_Descriptor_Function   lv2_descriptor;
 	const LV2_Lib_Descriptor* desc;
+	ZixTree*                  plugins;    ///< Index of LilvLibPlugin by URI
+	size_t                    size;       ///< Size of library file in bytes
+	uint64_t                  last_used;  ///< World library clock at close
 	uint32_t                  refs;
 } LilvLib;
 
+typedef struct {
+	char*                 uri;   ///< Absolute plugin URI
+	const LV2_Descriptor* desc;
+} LilvLibPlugin;
+
+/**
+   Everything needed to instantiate a plugin without touching plugin data.
+
+   This is gathered on the calling thread, since plugin data is loaded lazily
+   and is not thread-safe, so instantiation itself can run on any thread.
+*/
+typedef struct {
+	LilvWorld*      world;
+	const LilvNode* lib_uri;
+	const char*     bundle_uri;
+	char*           bundle_path;
+	const char*     plugin_uri;
+	uint32_t        num_ports;
+	bool            worker;  ///< True iff plugin supports work:schedule
+} LilvInstanceInfo;
+
 struct LilvPluginImpl {
 	LilvWorld*             world;
 	LilvNode*              plugin_uri;
@@ -138,16 +183,39 @@ struct LilvPluginClassImpl {
 	LilvNode*  label;
 };
 
+typedef struct LilvWorkerImpl     LilvWorker;
+typedef struct LilvWorkerPoolImpl LilvWorkerPool;
+typedef struct LilvRunStatsImpl   LilvRunStatsImpl;
+
 struct LilvInstancePimpl {
-	LilvWorld* world;
-	LilvLib*   lib;
+	LilvWorld*        world;
+	LilvLib*          lib;
+	LilvWorker*       worker;  ///< Worker provided by lilv, or NULL
+	LilvRunStatsImpl* stats;   ///< Run statistics if enabled, or NULL
 };
 
 typedef struct {
-	bool dyn_manifest;
-	bool filter_language;
+	bool     dyn_manifest;
+	bool     filter_language;
+	unsigned keep_libs;       ///< Maximum number of unused libraries to keep
+	size_t   keep_libs_size;  ///< Maximum size of unused libraries, or zero
+	unsigned worker_threads;  ///< Number of threads in shared worker pool
 } LilvOptions;
 
+typedef struct {
+	ZixThread thread;
+	char**    paths;     ///< Library paths to open
+	void**    handles;   ///< Handles opened by the preload thread
+	bool*     released;  ///< True for handles that are no longer wanted
+	unsigned  n_paths;
+	bool      running;   ///< True iff thread has been started but not joined
+} LilvPreload;
+
+typedef struct {
+	char*  tag;          ///< Normalised language tag, e.g. "en-ca"
+	size_t primary_len;  ///< Length of primary language subtag of tag
+} LilvLang;
+
 struct LilvWorldImpl {
 	SordWorld*         world;
 	SordModel*         model;
@@ -160,10 +228,32 @@ struct LilvWorldImpl {
 	LilvPlugins*       zombies;
 	LilvNodes*         loaded_files;
 	ZixTree*           libs;
+	ZixMutex           libs_mutex;   ///< Protects libs and their contents
+	uint64_t           lib_clock;    ///< Incremented when a library is unused
+	LilvPreload        preload;
+	LilvWorkerPool*    workers;      ///< Shared worker threads, or NULL
+	ZixMutex           nodes_mutex;  ///< Protects node creation if frozen
+	LilvPresetInfo*    presets;      ///< Preset index, see preset.c
+	unsigned           n_presets;
+	unsigned           presets_cap;
+	bool               presets_sorted;
+	bool               frozen;
 	struct {
+		SordNode* atom_AtomPort;
+		SordNode* atom_supports;
 		SordNode* dc_replaces;
 		SordNode* dman_DynManifest;
+		SordNode* doap_maintainer;
 		SordNode* doap_name;
+		SordNode* ev_supportsEvent;
+		SordNode* foaf_homepage;
+		SordNode* foaf_mbox;
+		SordNode* foaf_name;
+		SordNode* lv2_AudioPort;
+		SordNode* lv2_CVPort;
+		SordNode* lv2_ControlPort;
+		SordNode* lv2_InputPort;
+		SordNode* lv2_OutputPort;
 		SordNode* lv2_Plugin;
 		SordNode* lv2_Specification;
 		SordNode* lv2_appliesTo;
@@ -181,11 +271,15 @@ struct LilvWorldImpl {
 		SordNode* lv2_optionalFeature;
 		SordNode* lv2_port;
 		SordNode* lv2_portProperty;
+		SordNode* lv2_project;
 		SordNode* lv2_reportsLatency;
 		SordNode* lv2_requiredFeature;
+		SordNode* lv2_scalePoint;
 		SordNode* lv2_symbol;
 		SordNode* lv2_prototype;
 		SordNode* owl_Ontology;
+		SordNode* pset_Preset;
+		SordNode* pset_bank;
 		SordNode* pset_value;
 		SordNode* rdf_a;
 		SordNode* rdf_value;
@@ -193,6 +287,10 @@ struct LilvWorldImpl {
 		SordNode* rdfs_label;
 		SordNode* rdfs_seeAlso;
 		SordNode* rdfs_subClassOf;
+		SordNode* rsz_minimumSize;
+		SordNode* ui_binary;
+		SordNode* ui_ui;
+		SordNode* work_schedule;
 		SordNode* xsd_base64Binary;
 		SordNode* xsd_boolean;
 		SordNode* xsd_decimal;
@@ -201,6 +299,7 @@ struct LilvWorldImpl {
 		SordNode* null_uri;
 	} uris;
 	LilvOptions opt;
+	LilvLang    lang;
 };
 
 typedef enum {
@@ -217,6 +316,7 @@ struct LilvNodeImpl {
 	LilvWorld*   world;
 	SordNode*    node;
 	LilvNodeType type;
+	bool         pinned;  ///< Node is kept by a frozen world, not referenced
 	union {
 		int   int_val;
 		float float_val;
@@ -224,6 +324,23 @@ struct LilvNodeImpl {
 	} val;
 };
 
+typedef struct {
+	const LilvLang* lang;     ///< System language, or NULL
+	const SordNode* nolang;   ///< Untranslated value seen so far
+	const SordNode* partial;  ///< Partial language match seen so far
+} LilvLangFilter;
+
+struct LilvMatchesImpl {
+	LilvWorld*      world;
+	SordIter*       stream;     ///< Underlying model iterator
+	SordQuadIndex   field;      ///< Field of stream matches to return
+	const SordNode* current;    ///< Current match, or NULL at end
+	LilvNode        node;       ///< Borrowed view of current
+	unsigned        n_matches;  ///< Number of matches returned so far
+	bool            i18n;       ///< Filter literals by language
+	LilvLangFilter  filter;     ///< Language filter state, if i18n
+};
+
 struct LilvScalePointImpl {
 	LilvNode* value;
 	LilvNode* label;
@@ -253,6 +370,7 @@ LilvPort* lilv_port_new(LilvWorld*      world,
                         uint32_t        index,
                         const char*     symbol);
 void      lilv_port_free(const LilvPlugin* plugin, LilvPort* port);
+bool      lilv_port_has_class(const LilvPort* port, const SordNode* port_class);
 
 LilvPlugin* lilv_plugin_new(LilvWorld* world,
                             LilvNode*  uri,
@@ -283,7 +401,54 @@ lilv_lib_open(LilvWorld*               world,
               const LV2_Feature*const* features);
 
 const LV2_Descriptor* lilv_lib_get_plugin(LilvLib* lib, uint32_t index);
+const LV2_Descriptor* lilv_lib_get_plugin_by_uri(LilvLib*    lib,
+                                                 const char* base_uri,
+                                                 const char* plugin_uri);
 void                  lilv_lib_close(LilvLib* lib);
+void                  lilv_lib_trim(LilvWorld* world, const char* bundle_path);
+void                  lilv_lib_preload_wait(LilvWorld* world);
+void                  lilv_lib_preload_join(LilvWorld* world);
+
+LilvInstantiateStatus
+lilv_instance_info_init(LilvInstanceInfo* info, const LilvPlugin* plugin);
+
+LilvInstance*
+lilv_instance_new(const LilvInstanceInfo*  info,
+                  double                   sample_rate,
+                  const LV2_Feature*const* features,
+                  LilvInstantiateStatus*   status);
+
+LilvWorker*         lilv_worker_new(LilvWorld* world);
+const LV2_Feature** lilv_worker_add_feature(LilvWorker*              worker,
+                                            const LV2_Feature*const* features);
+void                lilv_worker_attach(LilvWorker*           worker,
+                                       const LV2_Descriptor* descriptor,
+                                       LV2_Handle            handle);
+void                lilv_worker_emit_responses(LilvWorker* worker);
+void                lilv_worker_wait(LilvWorker* worker);
+void                lilv_worker_free(LilvWorker* worker);
+void                lilv_worker_pool_free(LilvWorkerPool* pool);
+
+LilvState* lilv_state_new_from_model(LilvWorld*      world,
+                                     LV2_URID_Map*   map,
+                                     SordModel*      model,
+                                     const SordNode* node,
+                                     const char*     dir);
+void       lilv_state_set_world(LilvState* state, LilvWorld* world);
+
+void lilv_world_index_presets(LilvWorld* world, const SordNode* bundle);
+void lilv_world_unindex_presets(LilvWorld* world, const LilvNode* bundle);
+void lilv_world_sort_presets(LilvWorld* world);
+
+/** Save state to a file without setting its URI or directory. */
+int
+lilv_state_save_file(LilvWorld*       world,
+                     LV2_URID_Map*    map,
+                     LV2_URID_Unmap*  unmap,
+                     const LilvState* state,
+                     const char*      uri,
+                     const char*      dir,
+                     const char*      filename);
 
 LilvNodes*         lilv_nodes_new(void);
 LilvPlugins*       lilv_plugins_new(void);
@@ -312,8 +477,37 @@ LilvUI* lilv_ui_new(LilvWorld* world,
 
 void lilv_ui_free(LilvUI* ui);
 
+/**
+   Lock the nodes of a frozen world.
+
+   Creating or freeing a node changes the node table and reference counts of
+   the underlying SordWorld, so this must be done with the nodes locked if
+   other threads may be querying a frozen world.  Otherwise, this does nothing.
+   Nodes from the model of a frozen world are pinned instead, so only new
+   nodes made from strings need this.
+*/
+static inline void
+lilv_world_lock_nodes(LilvWorld* world)
+{
+	if (world->frozen) {
+		zix_mutex_lock(&world->nodes_mutex);
+	}
+}
+
+static inline void
+lilv_world_unlock_nodes(LilvWorld* world)
+{
+	if (world->frozen) {
+		zix_mutex_unlock(&world->nodes_mutex);
+	}
+}
+
 LilvNode* lilv_node_new(LilvWorld* world, LilvNodeType type, const char* val);
 LilvNode* lilv_node_new_from_node(LilvWorld* world, const SordNode* node);
+LilvNode* lilv_node_copy_from_node(LilvWorld* world, const SordNode* node);
+void      lilv_node_init_borrowed(LilvNode*       val,
+                                  LilvWorld*      world,
+                                  const SordNode* node);
 
 int lilv_header_compare_by_uri(const void* a, const void* b, void* user_data);
 int lilv_lib_compare(const void* a, const void* b, void* user_data);
@@ -352,6 +546,13 @@ lilv_world_ask_internal(LilvWorld*      world,
                         const SordNode* predicate,
                         const SordNode* object);
 
+unsigned
+lilv_world_get_batch_internal(LilvWorld*             world,
+                              const SordNode*        subject,
+                              unsigned               n_predicates,
+                              const SordNode* const* predicates,
+                              const SordNode**       values);
+
 LilvNodes*
 lilv_world_find_nodes_internal(LilvWorld*      world,
                                const SordNode* subject,
@@ -366,6 +567,16 @@ lilv_world_filter_model(LilvWorld*      world,
                         const SordNode* object,
                         const SordNode* graph);
 
+void
+lilv_world_match_internal(LilvWorld*      world,
+                          LilvMatches*    matches,
+                          const SordNode* subject,
+                          const SordNode* predicate,
+                          const SordNode* object);
+
+void            lilv_lang_set(LilvLang* lang, const char* str);
+const LilvLang* lilv_world_get_lang(const LilvWorld* world);
+
 #define FOREACH_MATCH(iter) \
 	for (; !sord_iter_end(iter); sord_iter_next(iter))
 
@@ -373,16 +584,23 @@ LilvNodes* lilv_nodes_from_stream_objects(LilvWorld*    w,
                                           SordIter*     stream,
                                           SordQuadIndex field);
 
+void lilv_matches_init(LilvMatches*  matches,
+                       LilvWorld*    world,
+                       SordIter*     stream,
+                       SordQuadIndex field);
+void lilv_matches_filter_language(LilvMatches* matches);
+void lilv_matches_clear(LilvMatches* matches);
+
 char*  lilv_strjoin(const char* first, ...);
 char*  lilv_strdup(const char* str);
-char*  lilv_get_lang(void);
+char*  lilv_parse_lang(const char* str);
 char*  lilv_expand(const char* path);
 char*  lilv_dirname(const char* path);
 int    lilv_copy_file(const char* src, const char* dst);
+int    lilv_clone_file(const char* src, const char* dst);
 bool   lilv_path_exists(const char* path, void* ignored);
 char*  lilv_path_absolute(const char* path);
 bool   lilv_path_is_absolute(const char* path);
-char*  lilv_get_latest_copy(const char* path, const char* copy_path);
 char*  lilv_path_relative_to(const char* path, const char* base);
 bool   lilv_path_is_child(const char* path, const char* dir);
 int    lilv_flock(FILE* file, bool lock);
@@ -391,6 +609,34 @@ int    lilv_symlink(const char* oldpath, const char* newpath);
 int    lilv_mkdir_p(const char* path);
 char*  lilv_path_join(const char* a, const char* b);
 bool   lilv_file_equals(const char* a_path, const char* b_path);
+size_t lilv_file_size(const char* path);
+
+/** Atomically rename `src` to `dst`, replacing any existing file. */
+int lilv_replace_file(const char* src, const char* dst);
+
+/** Add a copy of `path` to a content-addressed store, return its path. */
+char* lilv_file_store_add(const char* store_dir, const char* path);
+
+typedef struct {
+	uint32_t state[8];
+	uint64_t length;     ///< Total number of bytes
+	uint8_t  block[64];  ///< Pending partial block
+	size_t   n_block;    ///< Number of bytes in block
+} LilvSha256;
+
+void lilv_sha256_init(LilvSha256* sha);
+void lilv_sha256_update(LilvSha256* sha, const uint8_t* data, size_t size);
+void lilv_sha256_finish(LilvSha256* sha, uint8_t* digest);
+
+/** Write the SHA-256 of a file to `hex` as a 64 character string. */
+int lilv_file_sha256(const char* path, char* hex);
+
+/** Map a whole file read-only into memory, or read it if mmap is missing. */
+void* lilv_map_file(const char* path, size_t* size);
+void  lilv_unmap_file(void* data, size_t size);
+
+/** Return the number of online processors, or 1 if unknown. */
+unsigned lilv_num_processors(void);
 
 char*
 lilv_find_free_path(const char* in_path,
@@ -52,10 +52,12 @@ LilvNode*
 lilv_node_new(LilvWorld* world, LilvNodeType type, const char* str)
 {
 	LilvNode* val = (LilvNode*)malloc(sizeof(LilvNode));
-	val->world = world;
-	val->type  = type;
+	val->world  = world;
+	val->type   = type;
+	val->pinned = false;
 
 	const uint8_t* ustr = (const uint8_t*)str;
+	lilv_world_lock_nodes(world);
 	switch (type) {
 	case LILV_VALUE_URI:
 		val->node = sord_new_uri(world->world, ustr);
@@ -83,6 +85,7 @@ lilv_node_new(LilvWorld* world, LilvNodeType type, const char* str)
 			world->world, world->uris.xsd_base64Binary, ustr, NULL);
 		break;
 	}
+	lilv_world_unlock_nodes(world);
 
 	if (!val->node) {
 		free(val);
@@ -92,50 +95,68 @@ lilv_node_new(LilvWorld* world, LilvNodeType type, const char* str)
 	return val;
 }
 
-/** Create a new LilvNode from `node`, or return NULL if impossible */
+/** Return the LilvNodeType corresponding to the datatype of literal `node` */
+static LilvNodeType
+lilv_node_literal_type(LilvWorld* world, const SordNode* node)
+{
+	const SordNode* datatype_uri = sord_node_get_datatype(node);
+	LilvNodeType    type         = LILV_VALUE_STRING;
+	if (datatype_uri) {
+		if (sord_node_equals(datatype_uri, world->uris.xsd_boolean))
+			type = LILV_VALUE_BOOL;
+		else if (sord_node_equals(datatype_uri, world->uris.xsd_decimal)
+		         || sord_node_equals(datatype_uri, world->uris.xsd_double))
+			type = LILV_VALUE_FLOAT;
+		else if (sord_node_equals(datatype_uri, world->uris.xsd_integer))
+			type = LILV_VALUE_INT;
+		else if (sord_node_equals(datatype_uri,
+		                          world->uris.xsd_base64Binary))
+			type = LILV_VALUE_BLOB;
+		else
+			LILV_ERRORF("Unknown datatype `%s'\n",
+			            sord_node_get_string(datatype_uri));
+	}
+	return type;
+}
+
+/**
+   Create a new LilvNode from `node`, or return NULL if impossible.
+
+   Unlike lilv_node_new_from_node(), this always references `node`, so it may
+   be in any model.
+*/
 LilvNode*
-lilv_node_new_from_node(LilvWorld* world, const SordNode* node)
+lilv_node_copy_from_node(LilvWorld* world, const SordNode* node)
 {
 	if (!node) {
 		return NULL;
 	}
 
-	LilvNode*    result       = NULL;
-	SordNode*    datatype_uri = NULL;
-	LilvNodeType type         = LILV_VALUE_STRING;
+	LilvNode* result = NULL;
 
 	switch (sord_node_get_type(node)) {
 	case SORD_URI:
-		result        = (LilvNode*)malloc(sizeof(LilvNode));
-		result->world = (LilvWorld*)world;
-		result->type  = LILV_VALUE_URI;
-		result->node  = sord_node_copy(node);
+		result         = (LilvNode*)malloc(sizeof(LilvNode));
+		result->world  = (LilvWorld*)world;
+		result->type   = LILV_VALUE_URI;
+		result->pinned = false;
+		lilv_world_lock_nodes(world);
+		result->node   = sord_node_copy(node);
+		lilv_world_unlock_nodes(world);
 		break;
 	case SORD_BLANK:
-		result        = (LilvNode*)malloc(sizeof(LilvNode));
-		result->world = (LilvWorld*)world;
-		result->type  = LILV_VALUE_BLANK;
-		result->node  = sord_node_copy(node);
+		result         = (LilvNode*)malloc(sizeof(LilvNode));
+		result->world  = (LilvWorld*)world;
+		result->type   = LILV_VALUE_BLANK;
+		result->pinned = false;
+		lilv_world_lock_nodes(world);
+		result->node   = sord_node_copy(node);
+		lilv_world_unlock_nodes(world);
 		break;
 	case SORD_LITERAL:
-		datatype_uri = sord_node_get_datatype(node);
-		if (datatype_uri) {
-			if (sord_node_equals(datatype_uri, world->uris.xsd_boolean))
-				type = LILV_VALUE_BOOL;
-			else if (sord_node_equals(datatype_uri, world->uris.xsd_decimal)
-			         || sord_node_equals(datatype_uri, world->uris.xsd_double))
-				type = LILV_VALUE_FLOAT;
-			else if (sord_node_equals(datatype_uri, world->uris.xsd_integer))
-				type = LILV_VALUE_INT;
-			else if (sord_node_equals(datatype_uri,
-			                          world->uris.xsd_base64Binary))
-				type = LILV_VALUE_BLOB;
-			else
-				LILV_ERRORF("Unknown datatype `%s'\n",
-				            sord_node_get_string(datatype_uri));
-		}
-		result = lilv_node_new(
-			world, type, (const char*)sord_node_get_string(node));
+		result = lilv_node_new(world,
+		                       lilv_node_literal_type(world, node),
+		                       (const char*)sord_node_get_string(node));
 		lilv_node_set_numerics_from_string(result);
 		break;
 	}
@@ -143,6 +164,51 @@ lilv_node_new_from_node(LilvWorld* world, const SordNode* node)
 	return result;
 }
 
+/**
+   Create a new LilvNode from `node` in the world model, or return NULL.
+
+   A frozen world never removes nodes from its model, so the node is pinned
+   rather than referenced, and it can be made, duplicated, and freed without
+   locking.  Nodes from other models must use lilv_node_copy_from_node().
+*/
+LilvNode*
+lilv_node_new_from_node(LilvWorld* world, const SordNode* node)
+{
+	if (!node || !world->frozen) {
+		return lilv_node_copy_from_node(world, node);
+	}
+
+	LilvNode* result = (LilvNode*)malloc(sizeof(LilvNode));
+	lilv_node_init_borrowed(result, world, node);
+	return result;
+}
+
+/**
+   Initialise `val` as a borrowed view of `node`.
+
+   No memory is allocated and `node` is not copied, so `val` is only valid as
+   long as `node` is, and must not be freed with lilv_node_free().
+*/
+void
+lilv_node_init_borrowed(LilvNode* val, LilvWorld* world, const SordNode* node)
+{
+	val->world  = world;
+	val->node   = (SordNode*)node;
+	val->pinned = world->frozen;
+	switch (sord_node_get_type(node)) {
+	case SORD_URI:
+		val->type = LILV_VALUE_URI;
+		break;
+	case SORD_BLANK:
+		val->type = LILV_VALUE_BLANK;
+		break;
+	case SORD_LITERAL:
+		val->type = lilv_node_literal_type(world, node);
+		lilv_node_set_numerics_from_string(val);
+		break;
+	}
+}
+
 LILV_API LilvNode*
 lilv_new_uri(LilvWorld* world, const char* uri)
 {
@@ -205,18 +271,29 @@ lilv_node_duplicate(const LilvNode* val)
 	}
 
 	LilvNode* result = (LilvNode*)malloc(sizeof(LilvNode));
-	result->world = val->world;
-	result->node  = sord_node_copy(val->node);
-	result->val   = val->val;
-	result->type  = val->type;
+	result->world  = val->world;
+	result->val    = val->val;
+	result->type   = val->type;
+	result->pinned = val->pinned;
+	if (val->pinned) {
+		result->node = val->node;
+	} else {
+		lilv_world_lock_nodes(val->world);
+		result->node = sord_node_copy(val->node);
+		lilv_world_unlock_nodes(val->world);
+	}
 	return result;
 }
 
 LILV_API void
 lilv_node_free(LilvNode* val)
 {
-	if (val) {
+	if (val && val->pinned) {
+		free(val);
+	} else if (val) {
+		lilv_world_lock_nodes(val->world);
 		sord_node_free(val->world->world, val->node);
+		lilv_world_unlock_nodes(val->world);
 		free(val);
 	}
 }
@@ -234,9 +311,12 @@ lilv_node_equals(const LilvNode* value, const LilvNode* other)
 	switch (value->type) {
 	case LILV_VALUE_URI:
 	case LILV_VALUE_BLANK:
-	case LILV_VALUE_STRING:
 	case LILV_VALUE_BLOB:
 		return sord_node_equals(value->node, other->node);
+	case LILV_VALUE_STRING:
+		// Pinned strings may have a language or datatype, which is ignored
+		return !strcmp((const char*)sord_node_get_string(value->node),
+		               (const char*)sord_node_get_string(other->node));
 	case LILV_VALUE_INT:
 		return (value->val.int_val == other->val.int_val);
 	case LILV_VALUE_FLOAT:
@@ -27,11 +27,6 @@
 #include "lilv_config.h"
 #include "lilv_internal.h"
 
-#include "lv2/lv2plug.in/ns/extensions/ui/ui.h"
-
-#define NS_DOAP (const uint8_t*)"http://usefulinc.com/ns/doap#"
-#define NS_FOAF (const uint8_t*)"http://xmlns.com/foaf/0.1/"
-
 /** Ownership of `uri` is taken */
 LilvPlugin*
 lilv_plugin_new(LilvWorld* world, LilvNode* uri, LilvNode* bundle_uri)
@@ -249,7 +244,7 @@ lilv_plugin_load_ports_if_necessary(const LilvPlugin* const_p)
 
 	lilv_plugin_load_if_necessary(p);
 
-	if (!p->ports) {
+	if (!p->ports && !p->world->frozen) {
 		p->ports = (LilvPort**)malloc(sizeof(LilvPort*));
 		p->ports[0] = NULL;
 
@@ -449,9 +444,8 @@ lilv_plugin_verify(const LilvPlugin* plugin)
 		return false;
 	}
 
-	LilvNode*  rdf_type = lilv_new_uri(plugin->world, LILV_NS_RDF "type");
-	LilvNodes* results  = lilv_plugin_get_value(plugin, rdf_type);
-	lilv_node_free(rdf_type);
+	LilvNodes* results = lilv_plugin_get_value_internal(
+		plugin, plugin->world->uris.rdf_a);
 	if (!results) {
 		return false;
 	}
@@ -464,9 +458,8 @@ lilv_plugin_verify(const LilvPlugin* plugin)
 	}
 
 	lilv_nodes_free(results);
-	LilvNode* lv2_port = lilv_new_uri(plugin->world, LV2_CORE__port);
-	results = lilv_plugin_get_value(plugin, lv2_port);
-	lilv_node_free(lv2_port);
+	results = lilv_plugin_get_value_internal(plugin,
+	                                         plugin->world->uris.lv2_port);
 	if (!results) {
 		return false;
 	}
@@ -504,6 +497,17 @@ lilv_plugin_get_value(const LilvPlugin* p,
 	return lilv_world_find_nodes(p->world, p->plugin_uri, predicate, NULL);
 }
 
+LILV_API unsigned
+lilv_plugin_foreach_value(const LilvPlugin* p,
+                          const LilvNode*   predicate,
+                          LilvMatchFunc     func,
+                          void*             data)
+{
+	lilv_plugin_load_if_necessary(p);
+	return lilv_world_foreach(
+		p->world, p->plugin_uri, predicate, NULL, func, data);
+}
+
 LILV_API uint32_t
 lilv_plugin_get_num_ports(const LilvPlugin* p)
 {
@@ -817,16 +821,11 @@ lilv_plugin_get_project(const LilvPlugin* p)
 {
 	lilv_plugin_load_if_necessary(p);
 
-	SordNode* lv2_project = sord_new_uri(p->world->world,
-	                                     (const uint8_t*)LV2_CORE__project);
-
 	SordIter* projects = lilv_world_query_internal(p->world,
 	                                               p->plugin_uri->node,
-	                                               lv2_project,
+	                                               p->world->uris.lv2_project,
 	                                               NULL);
 
-	sord_node_free(p->world->world, lv2_project);
-
 	if (sord_iter_end(projects)) {
 		sord_iter_free(projects);
 		return NULL;
@@ -843,56 +842,29 @@ lilv_plugin_get_author(const LilvPlugin* p)
 {
 	lilv_plugin_load_if_necessary(p);
 
-	SordNode* doap_maintainer = sord_new_uri(
-		p->world->world, NS_DOAP "maintainer");
-
-	SordIter* maintainers = lilv_world_query_internal(
-		p->world,
-		p->plugin_uri->node,
-		doap_maintainer,
-		NULL);
-
-	if (sord_iter_end(maintainers)) {
-		sord_iter_free(maintainers);
-
-		LilvNode* project = lilv_plugin_get_project(p);
-		if (!project) {
-			sord_node_free(p->world->world, doap_maintainer);
-			return NULL;
-		}
-
-		maintainers = lilv_world_query_internal(
-			p->world,
-			project->node,
-			doap_maintainer,
-			NULL);
-
-		lilv_node_free(project);
+	// Get the maintainer and project of the plugin in a single scan
+	const SordNode* preds[] = { p->world->uris.doap_maintainer,
+	                            p->world->uris.lv2_project };
+	const SordNode* values[2];
+	lilv_world_get_batch_internal(
+		p->world, p->plugin_uri->node, 2, preds, values);
+
+	const SordNode* author = values[0];
+	if (!author && values[1]) {
+		// No plugin maintainer, use the project maintainer
+		lilv_world_get_batch_internal(p->world, values[1], 1, preds, &author);
 	}
 
-	sord_node_free(p->world->world, doap_maintainer);
-
-	if (sord_iter_end(maintainers)) {
-		sord_iter_free(maintainers);
-		return NULL;
-	}
-
-	const SordNode* author = sord_iter_get_node(maintainers, SORD_OBJECT);
-
-	sord_iter_free(maintainers);
 	return author;
 }
 
 static LilvNode*
-lilv_plugin_get_author_property(const LilvPlugin* plugin, const uint8_t* uri)
+lilv_plugin_get_author_property(const LilvPlugin* plugin,
+                                const SordNode*   predicate)
 {
 	const SordNode* author = lilv_plugin_get_author(plugin);
 	if (author) {
-		SordWorld* sworld = plugin->world->world;
-		SordNode*  pred   = sord_new_uri(sworld, uri);
-		LilvNode*  ret    = lilv_plugin_get_one(plugin, author, pred);
-		sord_node_free(sworld, pred);
-		return ret;
+		return lilv_plugin_get_one(plugin, author, predicate);
 	}
 	return NULL;
 }
@@ -900,19 +872,22 @@ lilv_plugin_get_author_property(const LilvPlugin* plugin, const uint8_t* uri)
 LILV_API LilvNode*
 lilv_plugin_get_author_name(const LilvPlugin* plugin)
 {
-	return lilv_plugin_get_author_property(plugin, NS_FOAF "name");
+	return lilv_plugin_get_author_property(
+		plugin, plugin->world->uris.foaf_name);
 }
 
 LILV_API LilvNode*
 lilv_plugin_get_author_email(const LilvPlugin* plugin)
 {
-	return lilv_plugin_get_author_property(plugin, NS_FOAF "mbox");
+	return lilv_plugin_get_author_property(
+		plugin, plugin->world->uris.foaf_mbox);
 }
 
 LILV_API LilvNode*
 lilv_plugin_get_author_homepage(const LilvPlugin* plugin)
 {
-	return lilv_plugin_get_author_property(plugin, NS_FOAF "homepage");
+	return lilv_plugin_get_author_property(
+		plugin, plugin->world->uris.foaf_homepage);
 }
 
 LILV_API bool
@@ -926,15 +901,10 @@ lilv_plugin_get_uis(const LilvPlugin* p)
 {
 	lilv_plugin_load_if_necessary(p);
 
-	SordNode* ui_ui_node = sord_new_uri(p->world->world,
-	                                    (const uint8_t*)LV2_UI__ui);
-	SordNode* ui_binary_node = sord_new_uri(p->world->world,
-	                                        (const uint8_t*)LV2_UI__binary);
-
 	LilvUIs*  result = lilv_uis_new();
 	SordIter* uis    = lilv_world_query_internal(p->world,
 	                                             p->plugin_uri->node,
-	                                             ui_ui_node,
+	                                             p->world->uris.ui_ui,
 	                                             NULL);
 
 	FOREACH_MATCH(uis) {
@@ -943,7 +913,7 @@ lilv_plugin_get_uis(const LilvPlugin* p)
 		LilvNode* type   = lilv_plugin_get_unique(p, ui, p->world->uris.rdf_a);
 		LilvNode* binary = lilv_plugin_get_one(p, ui, p->world->uris.lv2_binary);
 		if (!binary) {
-			binary = lilv_plugin_get_unique(p, ui, ui_binary_node);
+			binary = lilv_plugin_get_unique(p, ui, p->world->uris.ui_binary);
 		}
 
 		if (sord_node_get_type(ui) != SORD_URI
@@ -965,9 +935,6 @@ lilv_plugin_get_uis(const LilvPlugin* p)
 	}
 	sord_iter_free(uis);
 
-	sord_node_free(p->world->world, ui_binary_node);
-	sord_node_free(p->world->world, ui_ui_node);
-
 	if (lilv_uis_size(result) > 0) {
 		return result;
 	} else {
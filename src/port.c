@@ -20,9 +20,6 @@
 #include <stdlib.h>
 #include <string.h>
 
-#include "lv2/lv2plug.in/ns/ext/atom/atom.h"
-#include "lv2/lv2plug.in/ns/ext/event/event.h"
-
 #include "lilv_internal.h"
 
 LilvPort*
@@ -62,6 +59,17 @@ lilv_port_is_a(const LilvPlugin* plugin,
 	return false;
 }
 
+bool
+lilv_port_has_class(const LilvPort* port, const SordNode* port_class)
+{
+	LILV_FOREACH(nodes, i, port->classes) {
+		if (lilv_nodes_get(port->classes, i)->node == port_class) {
+			return true;
+		}
+	}
+	return false;
+}
+
 LILV_API bool
 lilv_port_has_property(const LilvPlugin* p,
                        const LilvPort*   port,
@@ -78,14 +86,14 @@ lilv_port_supports_event(const LilvPlugin* p,
                          const LilvPort*   port,
                          const LilvNode*   event)
 {
-	const uint8_t* predicates[] = { (const uint8_t*)LV2_EVENT__supportsEvent,
-	                                (const uint8_t*)LV2_ATOM__supports,
-	                                NULL };
+	const SordNode* predicates[] = { p->world->uris.ev_supportsEvent,
+	                                 p->world->uris.atom_supports,
+	                                 NULL };
 
-	for (const uint8_t** pred = predicates; *pred; ++pred) {
+	for (const SordNode** pred = predicates; *pred; ++pred) {
 		if (lilv_world_ask_internal(p->world,
 		                            port->node->node,
-		                            sord_new_uri(p->world->world, *pred),
+		                            *pred,
 		                            event->node)) {
 			return true;
 		}
@@ -125,6 +133,16 @@ lilv_port_get_value(const LilvPlugin* p,
 	return lilv_port_get_value_by_node(p, port, predicate->node);
 }
 
+LILV_API unsigned
+lilv_port_foreach_value(const LilvPlugin* p,
+                        const LilvPort*   port,
+                        const LilvNode*   predicate,
+                        LilvMatchFunc     func,
+                        void*             data)
+{
+	return lilv_world_foreach(p->world, port->node, predicate, NULL, func, data);
+}
+
 LILV_API LilvNode*
 lilv_port_get(const LilvPlugin* p,
               const LilvPort*   port,
@@ -157,15 +175,14 @@ LILV_API LilvNode*
 lilv_port_get_name(const LilvPlugin* p,
                    const LilvPort*   port)
 {
-	LilvNodes* results = lilv_port_get_value_by_node(
-		p, port, p->world->uris.lv2_name);
-
-	LilvNode* ret = NULL;
-	if (results) {
-		LilvNode* val = lilv_nodes_get_first(results);
-		if (lilv_node_is_string(val))
-			ret = lilv_node_duplicate(val);
-		lilv_nodes_free(results);
+	const SordNode* preds[] = { p->world->uris.lv2_name };
+	const SordNode* name    = NULL;
+	lilv_world_get_batch_internal(p->world, port->node->node, 1, preds, &name);
+
+	LilvNode* ret = lilv_node_new_from_node(p->world, name);
+	if (ret && !lilv_node_is_string(ret)) {
+		lilv_node_free(ret);
+		ret = NULL;
 	}
 
 	if (!ret)
@@ -189,29 +206,20 @@ lilv_port_get_range(const LilvPlugin* p,
                     LilvNode**        min,
                     LilvNode**        max)
 {
+	const SordNode* preds[] = { p->world->uris.lv2_default,
+	                            p->world->uris.lv2_minimum,
+	                            p->world->uris.lv2_maximum };
+	const SordNode* values[3];
+	lilv_world_get_batch_internal(p->world, port->node->node, 3, preds, values);
+
 	if (def) {
-		LilvNodes* defaults = lilv_port_get_value_by_node(
-			p, port, p->world->uris.lv2_default);
-		*def = defaults
-			? lilv_node_duplicate(lilv_nodes_get_first(defaults))
-			: NULL;
-		lilv_nodes_free(defaults);
+		*def = lilv_node_new_from_node(p->world, values[0]);
 	}
 	if (min) {
-		LilvNodes* minimums = lilv_port_get_value_by_node(
-			p, port, p->world->uris.lv2_minimum);
-		*min = minimums
-			? lilv_node_duplicate(lilv_nodes_get_first(minimums))
-			: NULL;
-		lilv_nodes_free(minimums);
+		*min = lilv_node_new_from_node(p->world, values[1]);
 	}
 	if (max) {
-		LilvNodes* maximums = lilv_port_get_value_by_node(
-			p, port, p->world->uris.lv2_maximum);
-		*max = maximums
-			? lilv_node_duplicate(lilv_nodes_get_first(maximums))
-			: NULL;
-		lilv_nodes_free(maximums);
+		*max = lilv_node_new_from_node(p->world, values[2]);
 	}
 }
 
@@ -222,7 +230,7 @@ lilv_port_get_scale_points(const LilvPlugin* p,
 	SordIter* points = lilv_world_query_internal(
 		p->world,
 		port->node->node,
-		sord_new_uri(p->world->world, (const uint8_t*)LV2_CORE__scalePoint),
+		p->world->uris.lv2_scalePoint,
 		NULL);
 
 	LilvScalePoints* ret = NULL;
@@ -0,0 +1,275 @@
+/*
+  Copyright 2016 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef _POSIX_C_SOURCE
+#    define _POSIX_C_SOURCE 200112L  /* for posix_memalign */
+#endif
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#    include <malloc.h>
+#endif
+
+#include "lilv_internal.h"
+
+#define LILV_BUFFER_ALIGN          64
+#define LILV_DEFAULT_ATOM_CAPACITY 8192
+
+typedef struct {
+	LilvPortBufferType type;
+	bool               is_output;
+	size_t             offset;  ///< Offset of buffer in arena
+	size_t             size;    ///< Size of buffer in bytes
+} LilvPortBuffer;
+
+struct LilvPortBuffersImpl {
+	char*           arena;       ///< Single aligned block of all buffers
+	LilvPortBuffer* ports;
+	uint32_t        n_ports;
+	LV2_URID        atom_Chunk;
+	LV2_URID        atom_Sequence;
+};
+
+static size_t
+align_size(size_t size)
+{
+	return (size + LILV_BUFFER_ALIGN - 1) & ~(size_t)(LILV_BUFFER_ALIGN - 1);
+}
+
+static void*
+aligned_calloc(size_t size)
+{
+	void* ptr = NULL;
+#ifdef _WIN32
+	ptr = _aligned_malloc(size, LILV_BUFFER_ALIGN);
+#else
+	if (posix_memalign(&ptr, LILV_BUFFER_ALIGN, size)) {
+		ptr = NULL;
+	}
+#endif
+	if (ptr) {
+		memset(ptr, 0, size);
+	}
+	return ptr;
+}
+
+static void
+aligned_free(void* ptr)
+{
+#ifdef _WIN32
+	_aligned_free(ptr);
+#else
+	free(ptr);
+#endif
+}
+
+static size_t
+atom_port_size(const LilvPlugin* plugin,
+               const LilvPort*   port,
+               uint32_t          atom_capacity)
+{
+	LilvWorld* world = plugin->world;
+	size_t     size  = atom_capacity ? atom_capacity
+	                                 : LILV_DEFAULT_ATOM_CAPACITY;
+
+	const SordNode* pred     = world->uris.rsz_minimumSize;
+	const SordNode* min_size = NULL;
+	if (lilv_world_get_batch_internal(
+		    world, port->node->node, 1, &pred, &min_size) &&
+	    sord_node_get_type(min_size) == SORD_LITERAL) {
+		const long min = atol((const char*)sord_node_get_string(min_size));
+		if (min > 0 && (size_t)min > size) {
+			size = (size_t)min;
+		}
+	}
+
+	return size < sizeof(LV2_Atom_Sequence) ? sizeof(LV2_Atom_Sequence) : size;
+}
+
+LILV_API LilvPortBuffers*
+lilv_port_buffers_new(const LilvPlugin* plugin,
+                      LV2_URID_Map*     map,
+                      uint32_t          block_length,
+                      uint32_t          atom_capacity)
+{
+	LilvWorld* const world   = plugin->world;
+	const uint32_t   n_ports = lilv_plugin_get_num_ports(plugin);
+
+	LilvPortBuffers* buffers = (LilvPortBuffers*)calloc(
+		1, sizeof(LilvPortBuffers));
+	buffers->ports   = (LilvPortBuffer*)calloc(n_ports, sizeof(LilvPortBuffer));
+	buffers->n_ports = n_ports;
+	if (map) {
+		buffers->atom_Chunk    = map->map(map->handle, LV2_ATOM__Chunk);
+		buffers->atom_Sequence = map->map(map->handle, LV2_ATOM__Sequence);
+	}
+
+	// Classify ports and lay out buffers in the arena
+	size_t arena_size = 0;
+	for (uint32_t i = 0; i < n_ports; ++i) {
+		const LilvPort* port = plugin->ports[i];
+		LilvPortBuffer* buf  = &buffers->ports[i];
+
+		buf->is_output = lilv_port_has_class(port,
+		                                     world->uris.lv2_OutputPort);
+		if (lilv_port_has_class(port, world->uris.lv2_AudioPort) ||
+		    lilv_port_has_class(port, world->uris.lv2_CVPort)) {
+			buf->type = LILV_PORT_BUFFER_AUDIO;
+			buf->size = block_length * sizeof(float);
+		} else if (lilv_port_has_class(port, world->uris.lv2_ControlPort)) {
+			buf->type = LILV_PORT_BUFFER_CONTROL;
+			buf->size = sizeof(float);
+		} else if (lilv_port_has_class(port, world->uris.atom_AtomPort)) {
+			buf->type = LILV_PORT_BUFFER_ATOM;
+			buf->size = atom_port_size(plugin, port, atom_capacity);
+		} else {
+			continue;
+		}
+
+		buf->offset = arena_size;
+		arena_size += align_size(buf->size);
+	}
+
+	buffers->arena = (char*)aligned_calloc(
+		arena_size ? arena_size : LILV_BUFFER_ALIGN);
+	if (!buffers->arena) {
+		lilv_port_buffers_free(buffers);
+		return NULL;
+	}
+
+	// Set controls to default values
+	float* defaults = (float*)malloc(n_ports * sizeof(float));
+	lilv_plugin_get_port_ranges_float(plugin, NULL, NULL, defaults);
+	for (uint32_t i = 0; i < n_ports; ++i) {
+		if (buffers->ports[i].type == LILV_PORT_BUFFER_CONTROL) {
+			*lilv_port_buffers_get_control(buffers, i) =
+				isnan(defaults[i]) ? 0.0f : defaults[i];
+		}
+	}
+	free(defaults);
+
+	lilv_port_buffers_reset(buffers);
+	return buffers;
+}
+
+LILV_API void
+lilv_port_buffers_free(LilvPortBuffers* buffers)
+{
+	if (buffers) {
+		aligned_free(buffers->arena);
+		free(buffers->ports);
+		free(buffers);
+	}
+}
+
+LILV_API void
+lilv_port_buffers_connect(const LilvPortBuffers* buffers,
+                          LilvInstance*          instance)
+{
+	for (uint32_t i = 0; i < buffers->n_ports; ++i) {
+		instance->lv2_descriptor->connect_port(
+			instance->lv2_handle, i, lilv_port_buffers_get(buffers, i));
+	}
+}
+
+LILV_API void
+lilv_port_buffers_reset(LilvPortBuffers* buffers)
+{
+	for (uint32_t i = 0; i < buffers->n_ports; ++i) {
+		const LilvPortBuffer* buf = &buffers->ports[i];
+		if (buf->type != LILV_PORT_BUFFER_ATOM) {
+			continue;
+		}
+
+		LV2_Atom_Sequence* seq = lilv_port_buffers_get_atom(buffers, i);
+		if (buf->is_output) {
+			seq->atom.size = buf->size - sizeof(LV2_Atom);
+			seq->atom.type = buffers->atom_Chunk;
+		} else {
+			seq->atom.size = sizeof(LV2_Atom_Sequence_Body);
+			seq->atom.type = buffers->atom_Sequence;
+			seq->body.unit = 0;
+			seq->body.pad  = 0;
+		}
+	}
+}
+
+LILV_API uint32_t
+lilv_port_buffers_get_num_ports(const LilvPortBuffers* buffers)
+{
+	return buffers->n_ports;
+}
+
+LILV_API LilvPortBufferType
+lilv_port_buffers_get_type(const LilvPortBuffers* buffers, uint32_t index)
+{
+	return (index < buffers->n_ports)
+		? buffers->ports[index].type : LILV_PORT_BUFFER_NONE;
+}
+
+static void*
+get_buffer(const LilvPortBuffers* buffers,
+           uint32_t               index,
+           LilvPortBufferType     type)
+{
+	if (index >= buffers->n_ports || buffers->ports[index].type != type) {
+		return NULL;
+	}
+	return buffers->arena + buffers->ports[index].offset;
+}
+
+LILV_API void*
+lilv_port_buffers_get(const LilvPortBuffers* buffers, uint32_t index)
+{
+	const LilvPortBufferType type = lilv_port_buffers_get_type(buffers, index);
+	return type ? get_buffer(buffers, index, type) : NULL;
+}
+
+LILV_API float*
+lilv_port_buffers_get_audio(const LilvPortBuffers* buffers, uint32_t index)
+{
+	return (float*)get_buffer(buffers, index, LILV_PORT_BUFFER_AUDIO);
+}
+
+LILV_API float*
+lilv_port_buffers_get_control(const LilvPortBuffers* buffers, uint32_t index)
+{
+	return (float*)get_buffer(buffers, index, LILV_PORT_BUFFER_CONTROL);
+}
+
+LILV_API LV2_Atom_Sequence*
+lilv_port_buffers_get_atom(const LilvPortBuffers* buffers, uint32_t index)
+{
+	return (LV2_Atom_Sequence*)get_buffer(
+		buffers, index, LILV_PORT_BUFFER_ATOM);
+}
+
+LILV_API LilvPortBuffers*
+lilv_instance_auto_connect(LilvInstance*     instance,
+                           const LilvPlugin* plugin,
+                           LV2_URID_Map*     map,
+                           uint32_t          block_length)
+{
+	LilvPortBuffers* buffers = lilv_port_buffers_new(
+		plugin, map, block_length, 0);
+	if (buffers) {
+		lilv_port_buffers_connect(buffers, instance);
+	}
+	return buffers;
+}
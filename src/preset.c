@@ -0,0 +1,364 @@
+/*
+  Copyright 2016 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lilv_internal.h"
+
+#define USTR(s) ((const uint8_t*)(s))
+
+/**
+   @file preset.c Preset index and bulk preset loading.
+
+   The index is an array of every preset described in a loaded manifest,
+   sorted by plugin and then preset URI.  Entries are appended as bundles
+   are loaded, and the array is sorted when it is next used (or when the
+   world is frozen), so loading many bundles does not sort repeatedly.
+*/
+
+/** Get the object of a statement about `preset` in the `bundle` graph. */
+static const LilvNode*
+lilv_preset_get(LilvWorld*      world,
+                const SordNode* preset,
+                const SordNode* predicate,
+                const SordNode* bundle)
+{
+	SordNode* node   = sord_get(world->model, preset, predicate, NULL, bundle);
+	LilvNode* result = lilv_node_new_from_node(world, node);
+	sord_node_free(world->world, node);
+	return result;
+}
+
+static void
+lilv_preset_info_free(LilvPresetInfo* info)
+{
+	lilv_node_free((LilvNode*)info->uri);
+	lilv_node_free((LilvNode*)info->plugin);
+	lilv_node_free((LilvNode*)info->bundle);
+	lilv_node_free((LilvNode*)info->label);
+	lilv_node_free((LilvNode*)info->bank);
+	lilv_node_free((LilvNode*)info->file);
+}
+
+static int
+lilv_preset_info_cmp(const void* a, const void* b)
+{
+	const LilvPresetInfo* pa = (const LilvPresetInfo*)a;
+	const LilvPresetInfo* pb = (const LilvPresetInfo*)b;
+	const int cmp = strcmp(lilv_node_as_string(pa->plugin),
+	                       lilv_node_as_string(pb->plugin));
+	return cmp ? cmp : strcmp(lilv_node_as_string(pa->uri),
+	                          lilv_node_as_string(pb->uri));
+}
+
+void
+lilv_world_index_presets(LilvWorld* world, const SordNode* bundle)
+{
+	// Drop entries from any previous load of this bundle
+	LilvNode bundle_uri;
+	lilv_node_init_borrowed(&bundle_uri, world, bundle);
+	lilv_world_unindex_presets(world, &bundle_uri);
+
+	SordIter* i = sord_search(world->model,
+	                          NULL,
+	                          world->uris.rdf_a,
+	                          world->uris.pset_Preset,
+	                          bundle);
+	FOREACH_MATCH(i) {
+		const SordNode* preset = sord_iter_get_node(i, SORD_SUBJECT);
+		const LilvNode* plugin = lilv_preset_get(
+			world, preset, world->uris.lv2_appliesTo, bundle);
+		if (!plugin) {
+			continue;  // Not related to any plugin, so never listed
+		}
+
+		if (world->n_presets == world->presets_cap) {
+			world->presets_cap = (world->presets_cap
+			                      ? world->presets_cap * 2 : 16);
+			world->presets     = (LilvPresetInfo*)realloc(
+				world->presets, world->presets_cap * sizeof(LilvPresetInfo));
+		}
+
+		LilvPresetInfo* info = &world->presets[world->n_presets++];
+		info->uri    = lilv_node_new_from_node(world, preset);
+		info->plugin = plugin;
+		info->bundle = lilv_node_new_from_node(world, bundle);
+		info->label  = lilv_preset_get(
+			world, preset, world->uris.rdfs_label, bundle);
+		info->bank   = lilv_preset_get(
+			world, preset, world->uris.pset_bank, bundle);
+		info->file   = lilv_preset_get(
+			world, preset, world->uris.rdfs_seeAlso, bundle);
+
+		world->presets_sorted = false;
+	}
+	sord_iter_free(i);
+}
+
+void
+lilv_world_unindex_presets(LilvWorld* world, const LilvNode* bundle)
+{
+	// Remove in place, which keeps the remaining entries sorted
+	unsigned n_kept = 0;
+	for (unsigned i = 0; i < world->n_presets; ++i) {
+		LilvPresetInfo* const info = &world->presets[i];
+		if (!bundle || lilv_node_equals(info->bundle, bundle)) {
+			lilv_preset_info_free(info);
+		} else {
+			world->presets[n_kept++] = *info;
+		}
+	}
+
+	world->n_presets = n_kept;
+	if (!n_kept) {
+		free(world->presets);
+		world->presets        = NULL;
+		world->presets_cap    = 0;
+		world->presets_sorted = true;
+	}
+}
+
+void
+lilv_world_sort_presets(LilvWorld* world)
+{
+	if (!world->presets_sorted) {
+		qsort(world->presets, world->n_presets, sizeof(LilvPresetInfo),
+		      lilv_preset_info_cmp);
+		world->presets_sorted = true;
+	}
+}
+
+LILV_API unsigned
+lilv_plugin_get_presets(const LilvPlugin*      plugin,
+                        const LilvPresetInfo** presets)
+{
+	LilvWorld* const  world = plugin->world;
+	const char* const uri   = lilv_node_as_string(plugin->plugin_uri);
+	lilv_world_sort_presets(world);
+
+	// Binary search for the first preset of plugin
+	unsigned lo = 0;
+	unsigned hi = world->n_presets;
+	while (lo < hi) {
+		const unsigned mid = lo + (hi - lo) / 2;
+		if (strcmp(lilv_node_as_string(world->presets[mid].plugin), uri) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	unsigned end = lo;
+	while (end < world->n_presets &&
+	       !strcmp(lilv_node_as_string(world->presets[end].plugin), uri)) {
+		++end;
+	}
+
+	*presets = (end > lo) ? world->presets + lo : NULL;
+	return end - lo;
+}
+
+typedef struct {
+	const LilvPresetInfo* info;
+	unsigned              index;  ///< Index in presets and states
+} PresetRef;
+
+typedef struct {
+	LilvWorld*    world;     ///< Main world
+	LV2_URID_Map* map;
+	LilvState**   states;
+	PresetRef*    refs;      ///< Presets sorted by file
+	unsigned*     files;     ///< Start of each file in refs, plus the end
+	unsigned      n_files;
+	unsigned      next;      ///< Index of next file to load
+	ZixMutex      mutex;     ///< Protects next
+} LilvPresetLoader;
+
+typedef struct {
+	LilvPresetLoader* loader;
+	LilvWorld*        world;   ///< World used only by this thread
+} LilvPresetThread;
+
+static const char*
+preset_file(const PresetRef* ref)
+{
+	return ref->info->file ? lilv_node_as_string(ref->info->file) : "";
+}
+
+static int
+preset_ref_cmp(const void* a, const void* b)
+{
+	return strcmp(preset_file((const PresetRef*)a),
+	              preset_file((const PresetRef*)b));
+}
+
+/** Parse file `f` once and load every preset in it. */
+static void
+lilv_preset_loader_load_file(LilvPresetLoader* loader,
+                             LilvWorld*        world,
+                             unsigned          f)
+{
+	const PresetRef* const begin    = &loader->refs[loader->files[f]];
+	const PresetRef* const end      = &loader->refs[loader->files[f + 1]];
+	const char* const      file_uri = preset_file(begin);
+	char* const            path     = lilv_file_uri_parse(file_uri, NULL);
+	if (!path) {
+		LILV_ERRORF("Preset file <%s> is not a file URI\n", file_uri);
+		return;
+	}
+
+	SerdNode    base   = serd_node_from_string(SERD_URI, USTR(file_uri));
+	SerdEnv*    env    = serd_env_new(&base);
+	SordModel*  model  = sord_new(world->world, SORD_SPO, false);
+	SerdReader* reader = sord_new_reader(model, env, SERD_TURTLE, NULL);
+
+	if (serd_reader_read_file(reader, USTR(file_uri)) > SERD_FAILURE) {
+		LILV_ERRORF("Error reading %s\n", path);
+	} else {
+		char* dirname   = lilv_dirname(path);
+		char* real_path = lilv_realpath(dirname);
+		for (const PresetRef* r = begin; r < end; ++r) {
+			SordNode* subject = sord_new_uri(
+				world->world, USTR(lilv_node_as_string(r->info->uri)));
+			loader->states[r->index] = lilv_state_new_from_model(
+				world, loader->map, model, subject, real_path);
+			sord_node_free(world->world, subject);
+		}
+		free(real_path);
+		free(dirname);
+	}
+
+	serd_reader_free(reader);
+	sord_free(model);
+	serd_env_free(env);
+	lilv_free(path);
+}
+
+static void*
+lilv_preset_loader_thread(void* data)
+{
+	LilvPresetThread* thread = (LilvPresetThread*)data;
+	LilvPresetLoader* loader = thread->loader;
+	for (;;) {
+		zix_mutex_lock(&loader->mutex);
+		const unsigned f = loader->next++;
+		zix_mutex_unlock(&loader->mutex);
+		if (f >= loader->n_files) {
+			break;
+		}
+
+		lilv_preset_loader_load_file(loader, thread->world, f);
+	}
+	return NULL;
+}
+
+LILV_API unsigned
+lilv_world_load_presets(LilvWorld*            world,
+                        LV2_URID_Map*         map,
+                        unsigned              n_presets,
+                        const LilvPresetInfo* presets,
+                        LilvState**           states,
+                        unsigned              n_threads)
+{
+	if (!n_presets) {
+		return 0;
+	}
+
+	LilvPresetLoader loader;
+	loader.world   = world;
+	loader.map     = map;
+	loader.states  = states;
+	loader.refs    = (PresetRef*)malloc(n_presets * sizeof(PresetRef));
+	loader.files   = (unsigned*)malloc((n_presets + 1) * sizeof(unsigned));
+	loader.n_files = 0;
+	loader.next    = 0;
+
+	// Group presets by file
+	for (unsigned i = 0; i < n_presets; ++i) {
+		loader.refs[i].info  = &presets[i];
+		loader.refs[i].index = i;
+		states[i]            = NULL;
+	}
+	qsort(loader.refs, n_presets, sizeof(PresetRef), preset_ref_cmp);
+
+	// Presets without a file are described in the world model
+	unsigned first = 0;
+	for (; first < n_presets && !loader.refs[first].info->file; ++first) {
+		const PresetRef* ref = &loader.refs[first];
+		states[ref->index] = lilv_state_new_from_world(
+			world, map, ref->info->uri);
+	}
+
+	for (unsigned i = first; i < n_presets; ++i) {
+		if (i == first ||
+		    preset_ref_cmp(&loader.refs[i - 1], &loader.refs[i])) {
+			loader.files[loader.n_files++] = i;
+		}
+	}
+	loader.files[loader.n_files] = n_presets;
+
+	if (!n_threads) {
+		n_threads = lilv_num_processors();
+	}
+	if (n_threads > loader.n_files) {
+		n_threads = loader.n_files;
+	}
+
+	// Run loaders, with this thread as the first one using the main world
+	zix_mutex_init(&loader.mutex);
+	LilvPresetThread* threads   = (LilvPresetThread*)calloc(
+		n_threads, sizeof(LilvPresetThread));
+	ZixThread*        handles   = (ZixThread*)calloc(
+		n_threads, sizeof(ZixThread));
+	unsigned          n_started = 0;
+	for (unsigned i = 1; i < n_threads; ++i) {
+		LilvPresetThread* thread = &threads[n_started];
+		thread->loader = &loader;
+		thread->world  = lilv_world_new();
+		if (zix_thread_create(&handles[n_started], 0,
+		                      lilv_preset_loader_thread, thread)) {
+			lilv_world_free(thread->world);
+			break;  // Carry on with the threads that were started
+		}
+		++n_started;
+	}
+
+	LilvPresetThread self = { &loader, world };
+	lilv_preset_loader_thread(&self);
+	for (unsigned i = 0; i < n_started; ++i) {
+		zix_thread_join(handles[i], NULL);
+	}
+	zix_mutex_destroy(&loader.mutex);
+
+	// Move states loaded by other threads to the main world
+	unsigned n_loaded = 0;
+	for (unsigned i = 0; i < n_presets; ++i) {
+		if (states[i]) {
+			lilv_state_set_world(states[i], world);
+			++n_loaded;
+		}
+	}
+
+	for (unsigned i = 0; i < n_started; ++i) {
+		lilv_world_free(threads[i].world);
+	}
+	free(handles);
+	free(threads);
+	free(loader.files);
+	free(loader.refs);
+	return n_loaded;
+}
@@ -26,92 +26,255 @@ typedef enum {
 	LILV_LANG_MATCH_EXACT     ///< Exact (language and country) match
 } LilvLangMatch;
 
+/**
+   Set `lang` to the normalised form of the language `str`.
+   If `str` is NULL or not a valid language, `lang` is set to no language.
+*/
+void
+lilv_lang_set(LilvLang* lang, const char* str)
+{
+	free(lang->tag);
+	lang->tag         = lilv_parse_lang(str);
+	lang->primary_len = lang->tag ? strcspn(lang->tag, "-") : 0;
+}
+
+/**
+   Return the language to filter by, which is NULL if there is none.
+   The language is resolved when the world is created or LILV_OPTION_LANG is
+   set, so this never reads the environment or modifies the world.
+*/
+const LilvLang*
+lilv_world_get_lang(const LilvWorld* world)
+{
+	return world->lang.tag ? &world->lang : NULL;
+}
+
+/**
+   Return how well the language tag `a` matches the language `b`.
+   This makes a single pass over `a`, since the primary language subtag length
+   of `b` is known in advance.
+*/
 static LilvLangMatch
-lilv_lang_matches(const char* a, const char* b)
+lilv_lang_matches(const char* a, const LilvLang* b)
 {
-	if (!strcmp(a, b)) {
-		return LILV_LANG_MATCH_EXACT;
+	size_t i = 0;
+	while (a[i] && a[i] == b->tag[i]) {
+		++i;
 	}
 
-	const char*  a_dash     = strchr(a, '-');
-	const size_t a_lang_len = a_dash ? (size_t)(a_dash - a) : strlen(a);
-	const char*  b_dash     = strchr(b, '-');
-	const size_t b_lang_len = b_dash ? (size_t)(b_dash - b) : strlen(b);
-
-	if (a_lang_len == b_lang_len && !strncmp(a, b, a_lang_len)) {
+	if (!a[i] && !b->tag[i]) {
+		return LILV_LANG_MATCH_EXACT;
+	} else if (i >= b->primary_len
+	           && (a[b->primary_len] == '-' || a[b->primary_len] == '\0')) {
 		return LILV_LANG_MATCH_PARTIAL;
 	}
 
 	return LILV_LANG_MATCH_NONE;
 }
 
-static LilvNodes*
-lilv_nodes_from_stream_objects_i18n(LilvWorld*    world,
-                                    SordIter*     stream,
-                                    SordQuadIndex field)
-{
-	LilvNodes*      values  = lilv_nodes_new();
-	const SordNode* nolang  = NULL;  // Untranslated value
-	const SordNode* partial = NULL;  // Partial language match
-	char*           syslang = lilv_get_lang();
-	FOREACH_MATCH(stream) {
-		const SordNode* value = sord_iter_get_node(stream, field);
-		if (sord_node_get_type(value) == SORD_LITERAL) {
-			const char*   lang = sord_node_get_language(value);
-			LilvLangMatch lm   = LILV_LANG_MATCH_NONE;
-			if (lang) {
-				lm = (syslang)
-					? lilv_lang_matches(lang, syslang)
-					: LILV_LANG_MATCH_PARTIAL;
-			} else {
-				nolang = value;
-				if (!syslang) {
-					lm = LILV_LANG_MATCH_EXACT;
-				}
-			}
+/**
+   Return true iff literal `value` is an acceptable language match.
 
-			if (lm == LILV_LANG_MATCH_EXACT) {
-				// Exact language match, add to results
-				zix_tree_insert((ZixTree*)values,
-				                lilv_node_new_from_node(world, value),
-				                NULL);
-			} else if (lm == LILV_LANG_MATCH_PARTIAL) {
-				// Partial language match, save in case we find no exact
-				partial = value;
-			}
-		} else {
-			zix_tree_insert((ZixTree*)values,
-			                lilv_node_new_from_node(world, value),
-			                NULL);
+   Values that are not accepted are remembered in `filter` as fallbacks, see
+   lilv_lang_filter_fallback().
+*/
+static bool
+lilv_lang_filter_accept(LilvLangFilter* filter, const SordNode* value)
+{
+	const char*   lang = sord_node_get_language(value);
+	LilvLangMatch lm   = LILV_LANG_MATCH_NONE;
+	if (lang) {
+		lm = (filter->lang)
+			? lilv_lang_matches(lang, filter->lang)
+			: LILV_LANG_MATCH_PARTIAL;
+	} else {
+		filter->nolang = value;
+		if (!filter->lang) {
+			lm = LILV_LANG_MATCH_EXACT;
 		}
 	}
-	sord_iter_free(stream);
-	free(syslang);
 
-	if (lilv_nodes_size(values) > 0) {
-		return values;
+	if (lm == LILV_LANG_MATCH_PARTIAL) {
+		// Partial language match, save in case we find no exact
+		filter->partial = value;
 	}
 
-	const SordNode* best = nolang;
-	if (syslang && partial) {
+	return lm == LILV_LANG_MATCH_EXACT;
+}
+
+/** Return the best language match to use if no value was accepted. */
+static const SordNode*
+lilv_lang_filter_fallback(const LilvLangFilter* filter)
+{
+	const SordNode* best = filter->nolang;
+	if (filter->lang && filter->partial) {
 		// Partial language match for system language
-		best = partial;
+		best = filter->partial;
 	} else if (!best) {
 		// No languages matches at all, and no untranslated value
 		// Use any value, if possible
-		best = partial;
+		best = filter->partial;
+	}
+	return best;
+}
+
+/**
+   Get the first value of several properties of `subject` in a single scan.
+
+   For each predicate, this is the first value that lilv_world_match() would
+   return, with the same language filtering, but only walks the subject's
+   range of the SPO index once.  Returned nodes are borrowed from the model.
+
+   @return The number of predicates that have a value.
+*/
+unsigned
+lilv_world_get_batch_internal(LilvWorld*             world,
+                              const SordNode*        subject,
+                              unsigned               n_predicates,
+                              const SordNode* const* predicates,
+                              const SordNode**       values)
+{
+	const bool      i18n    = world->opt.filter_language;
+	LilvLangFilter* filters = i18n
+		? (LilvLangFilter*)calloc(n_predicates, sizeof(LilvLangFilter))
+		: NULL;
+	if (i18n) {
+		const LilvLang* lang = lilv_world_get_lang(world);
+		for (unsigned p = 0; p < n_predicates; ++p) {
+			filters[p].lang = lang;
+		}
+	}
+
+	memset(values, '\0', n_predicates * sizeof(const SordNode*));
+
+	SordIter* i = lilv_world_query_internal(world, subject, NULL, NULL);
+	FOREACH_MATCH(i) {
+		const SordNode* pred  = sord_iter_get_node(i, SORD_PREDICATE);
+		const SordNode* value = sord_iter_get_node(i, SORD_OBJECT);
+		for (unsigned p = 0; p < n_predicates; ++p) {
+			if (!values[p] && sord_node_equals(pred, predicates[p])
+			    && (!i18n
+			        || sord_node_get_type(value) != SORD_LITERAL
+			        || lilv_lang_filter_accept(&filters[p], value))) {
+				values[p] = value;
+			}
+		}
 	}
+	sord_iter_free(i);
 
-	if (best) {
-		zix_tree_insert(
-			(ZixTree*)values, lilv_node_new_from_node(world, best), NULL);
+	unsigned n_found = 0;
+	for (unsigned p = 0; p < n_predicates; ++p) {
+		if (!values[p] && i18n) {
+			values[p] = lilv_lang_filter_fallback(&filters[p]);
+		}
+		n_found += values[p] ? 1 : 0;
+	}
+	free(filters);
+	return n_found;
+}
+
+/** Move to the first acceptable match at or after the stream position. */
+static void
+lilv_matches_seek(LilvMatches* matches)
+{
+	FOREACH_MATCH(matches->stream) {
+		const SordNode* value = sord_iter_get_node(
+			matches->stream, matches->field);
+		if (!matches->i18n
+		    || sord_node_get_type(value) != SORD_LITERAL
+		    || lilv_lang_filter_accept(&matches->filter, value)) {
+			matches->current = value;
+			break;
+		}
+	}
+
+	if (sord_iter_end(matches->stream)) {
+		matches->current = NULL;
+		if (matches->i18n && !matches->n_matches) {
+			// No exact matches, fall back to the best language match
+			matches->current = lilv_lang_filter_fallback(&matches->filter);
+		}
+	}
+
+	if (matches->current) {
+		++matches->n_matches;
+		lilv_node_init_borrowed(
+			&matches->node, matches->world, matches->current);
+	}
+}
+
+void
+lilv_matches_init(LilvMatches*  matches,
+                  LilvWorld*    world,
+                  SordIter*     stream,
+                  SordQuadIndex field)
+{
+	memset(matches, '\0', sizeof(LilvMatches));
+	matches->world  = world;
+	matches->stream = stream;
+	matches->field  = field;
+	lilv_matches_seek(matches);
+}
+
+/**
+   Only return literals that best match the system language.
+
+   This must be called before the first call to lilv_matches_next().
+*/
+void
+lilv_matches_filter_language(LilvMatches* matches)
+{
+	if (!matches->i18n && !sord_iter_end(matches->stream)) {
+		matches->i18n        = true;
+		matches->filter.lang = lilv_world_get_lang(matches->world);
+		matches->current     = NULL;
+		matches->n_matches   = 0;
+		lilv_matches_seek(matches);
+	}
+}
+
+void
+lilv_matches_clear(LilvMatches* matches)
+{
+	sord_iter_free(matches->stream);
+	matches->stream      = NULL;
+	matches->filter.lang = NULL;
+	matches->current     = NULL;
+}
+
+LILV_API bool
+lilv_matches_end(const LilvMatches* matches)
+{
+	return !matches || !matches->current;
+}
+
+LILV_API const LilvNode*
+lilv_matches_get(const LilvMatches* matches)
+{
+	return lilv_matches_end(matches) ? NULL : &matches->node;
+}
+
+LILV_API void
+lilv_matches_next(LilvMatches* matches)
+{
+	if (lilv_matches_end(matches)) {
+		return;
+	} else if (sord_iter_end(matches->stream)) {
+		matches->current = NULL;  // Returned language fallback, done
 	} else {
-		// No matches whatsoever
-		lilv_nodes_free(values);
-		values = NULL;
+		matches->current = NULL;
+		sord_iter_next(matches->stream);
+		lilv_matches_seek(matches);
 	}
+}
 
-	return values;
+LILV_API void
+lilv_matches_free(LilvMatches* matches)
+{
+	if (matches) {
+		lilv_matches_clear(matches);
+		free(matches);
+	}
 }
 
 LilvNodes*
@@ -122,18 +285,204 @@ lilv_nodes_from_stream_objects(LilvWorld*    world,
 	if (sord_iter_end(stream)) {
 		sord_iter_free(stream);
 		return NULL;
-	} else if (world->opt.filter_language) {
-		return lilv_nodes_from_stream_objects_i18n(world, stream, field);
-	} else {
-		LilvNodes* values = lilv_nodes_new();
-		FOREACH_MATCH(stream) {
-			const SordNode* value = sord_iter_get_node(stream, field);
-			LilvNode*       node  = lilv_node_new_from_node(world, value);
-			if (node) {
-				zix_tree_insert((ZixTree*)values, node, NULL);
+	}
+
+	LilvMatches matches;
+	lilv_matches_init(&matches, world, stream, field);
+	if (world->opt.filter_language) {
+		lilv_matches_filter_language(&matches);
+	}
+
+	LilvNodes* values = lilv_nodes_new();
+	for (; !lilv_matches_end(&matches); lilv_matches_next(&matches)) {
+		LilvNode* node = lilv_node_new_from_node(world, matches.current);
+		if (node) {
+			zix_tree_insert((ZixTree*)values, node, NULL);
+		}
+	}
+
+	const bool i18n = matches.i18n;
+	lilv_matches_clear(&matches);
+	if (i18n && lilv_nodes_size(values) == 0) {
+		// No matches whatsoever
+		lilv_nodes_free(values);
+		return NULL;
+	}
+
+	return values;
+}
+
+/** The state of a conjunctive query being evaluated by lilv_world_query(). */
+typedef struct {
+	LilvWorld*              world;
+	const LilvQueryPattern* patterns;
+	unsigned                n_patterns;
+	unsigned                n_vars;
+	bool*                   done;      ///< Pattern has been joined
+	bool*                   bound;     ///< Variables bound at each depth
+	const SordNode**        values;    ///< Bound variable values
+	LilvNode*               nodes;     ///< Borrowed views of values
+	const LilvNode**        bindings;  ///< Bindings passed to func
+	LilvQueryFunc           func;
+	void*                   data;
+	unsigned                n_solutions;
+	bool                    stop;
+} LilvQuery;
+
+/** Return the value of `term` with current bindings, or NULL if unbound. */
+static inline const SordNode*
+lilv_query_term_value(const LilvQuery* query, const LilvQueryTerm* term)
+{
+	return term->node ? term->node->node : query->values[term->var];
+}
+
+/**
+   Return the selectivity score of `pattern` with current bindings.
+
+   Bound subjects and objects are used to search the SPO and OPS indices
+   respectively, so they are far more selective than a bound predicate.
+*/
+static unsigned
+lilv_query_score(const LilvQuery* query, const LilvQueryPattern* pattern)
+{
+	return ((lilv_query_term_value(query, &pattern->subject) ? 4 : 0) +
+	        (lilv_query_term_value(query, &pattern->object) ? 3 : 0) +
+	        (lilv_query_term_value(query, &pattern->predicate) ? 1 : 0));
+}
+
+/** Bind `term` to `value`, or return false if it is bound to another value. */
+static bool
+lilv_query_bind(LilvQuery*           query,
+                const LilvQueryTerm* term,
+                const SordNode*      value,
+                bool*                bound)
+{
+	if (term->node) {
+		return true;
+	} else if (!query->values[term->var]) {
+		query->values[term->var] = value;
+		bound[term->var]         = true;
+		return true;
+	}
+	return sord_node_equals(query->values[term->var], value);
+}
+
+static void
+lilv_query_emit(LilvQuery* query)
+{
+	for (unsigned v = 0; v < query->n_vars; ++v) {
+		if (query->values[v]) {
+			lilv_node_init_borrowed(
+				&query->nodes[v], query->world, query->values[v]);
+			query->bindings[v] = &query->nodes[v];
+		} else {
+			query->bindings[v] = NULL;
+		}
+	}
+
+	++query->n_solutions;
+	if (query->func && query->func(query->bindings, query->data)) {
+		query->stop = true;
+	}
+}
+
+static void
+lilv_query_solve(LilvQuery* query, unsigned depth)
+{
+	if (depth == query->n_patterns) {
+		lilv_query_emit(query);
+		return;
+	}
+
+	// Choose the most selective pattern that has not been joined yet
+	unsigned best       = query->n_patterns;
+	unsigned best_score = 0;
+	for (unsigned i = 0; i < query->n_patterns; ++i) {
+		if (!query->done[i]) {
+			const unsigned score = lilv_query_score(query, &query->patterns[i]);
+			if (best == query->n_patterns || score > best_score) {
+				best       = i;
+				best_score = score;
 			}
 		}
-		sord_iter_free(stream);
-		return values;
 	}
+
+	const LilvQueryPattern* pat = &query->patterns[best];
+	SordIter*               i   = lilv_world_query_internal(
+		query->world,
+		lilv_query_term_value(query, &pat->subject),
+		lilv_query_term_value(query, &pat->predicate),
+		lilv_query_term_value(query, &pat->object));
+
+	bool* bound = query->bound + depth * query->n_vars;
+	query->done[best] = true;
+	FOREACH_MATCH(i) {
+		SordQuad quad;
+		sord_iter_get(i, quad);
+		if (lilv_query_bind(query, &pat->subject, quad[SORD_SUBJECT], bound) &&
+		    lilv_query_bind(query, &pat->predicate, quad[SORD_PREDICATE], bound) &&
+		    lilv_query_bind(query, &pat->object, quad[SORD_OBJECT], bound)) {
+			lilv_query_solve(query, depth + 1);
+		}
+
+		// Unbind variables bound by this pattern
+		for (unsigned v = 0; v < query->n_vars; ++v) {
+			if (bound[v]) {
+				query->values[v] = NULL;
+				bound[v]         = false;
+			}
+		}
+
+		if (query->stop) {
+			break;
+		}
+	}
+	query->done[best] = false;
+	sord_iter_free(i);
+}
+
+LILV_API unsigned
+lilv_world_query(LilvWorld*              world,
+                 unsigned                n_patterns,
+                 const LilvQueryPattern* patterns,
+                 unsigned                n_vars,
+                 LilvQueryFunc           func,
+                 void*                   data)
+{
+	for (unsigned i = 0; i < n_patterns; ++i) {
+		const LilvQueryTerm* terms[] = { &patterns[i].subject,
+		                                 &patterns[i].predicate,
+		                                 &patterns[i].object };
+		for (unsigned t = 0; t < 3; ++t) {
+			if (!terms[t]->node && terms[t]->var >= n_vars) {
+				LILV_ERRORF("Pattern %u uses unknown variable %u\n",
+				            i, terms[t]->var);
+				return 0;
+			}
+		}
+	}
+
+	if (n_patterns == 0) {
+		return 0;
+	}
+
+	const size_t n = n_vars ? n_vars : 1;
+	LilvQuery query = {
+		world, patterns, n_patterns, n_vars,
+		(bool*)calloc(n_patterns, sizeof(bool)),
+		(bool*)calloc(n_patterns * n, sizeof(bool)),
+		(const SordNode**)calloc(n, sizeof(const SordNode*)),
+		(LilvNode*)calloc(n, sizeof(LilvNode)),
+		(const LilvNode**)calloc(n, sizeof(const LilvNode*)),
+		func, data, 0, false
+	};
+
+	lilv_query_solve(&query, 0);
+
+	free(query.bindings);
+	free(query.nodes);
+	free(query.values);
+	free(query.bound);
+	free(query.done);
+	return query.n_solutions;
 }
@@ -0,0 +1,185 @@
+/*
+  Copyright 2016 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef _POSIX_C_SOURCE
+#    define _POSIX_C_SOURCE 200112L  /* for clock_gettime */
+#endif
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lilv_internal.h"
+
+#ifdef HAVE_CLOCK_GETTIME
+#    include <time.h>
+#endif
+
+/** Number of sub-buckets per power of two, as a power of two. */
+#define LILV_SUB_BUCKET_BITS 4
+#define LILV_SUB_BUCKETS     (1 << LILV_SUB_BUCKET_BITS)
+
+/**
+   Run statistics, written by the audio thread and read by any thread.
+
+   The audio thread is the only writer, so updates need no atomic operations.
+   Readers use `seq` to get a consistent snapshot: it is odd while an update
+   is in progress, and changes whenever the statistics do.
+*/
+struct LilvRunStatsImpl {
+	LilvAtomic   seq;
+	uint64_t     budget_ns;
+	LilvRunStats stats;
+};
+
+static uint64_t
+lilv_now_ns(void)
+{
+#if defined(HAVE_CLOCK_GETTIME)
+	struct timespec ts;
+#    ifdef CLOCK_MONOTONIC_RAW
+	clock_gettime(CLOCK_MONOTONIC_RAW, &ts);
+#    else
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+#    endif
+	return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+#elif defined(_WIN32)
+	LARGE_INTEGER count;
+	LARGE_INTEGER freq;
+	QueryPerformanceCounter(&count);
+	QueryPerformanceFrequency(&freq);
+	return (uint64_t)(count.QuadPart * (1000000000.0 / freq.QuadPart));
+#else
+	return 0;
+#endif
+}
+
+/**
+   Return the histogram bucket for a duration.
+
+   Buckets are log-linear like an HDR histogram: each power of two is split
+   into LILV_SUB_BUCKETS linear buckets, so the relative error is bounded by
+   1 / LILV_SUB_BUCKETS over the whole range.
+*/
+static unsigned
+lilv_run_stats_bucket(uint64_t ns)
+{
+	if (ns < LILV_SUB_BUCKETS) {
+		return (unsigned)ns;
+	}
+
+	unsigned msb = 0;
+	for (uint64_t v = ns; v >>= 1;) {
+		++msb;
+	}
+
+	const unsigned shift  = msb - LILV_SUB_BUCKET_BITS;
+	const unsigned sub    = (unsigned)(ns >> shift) & (LILV_SUB_BUCKETS - 1);
+	const unsigned bucket = (shift + 1) * LILV_SUB_BUCKETS + sub;
+	return (bucket < LILV_RUN_STATS_BUCKETS)
+		? bucket : LILV_RUN_STATS_BUCKETS - 1;
+}
+
+LILV_API uint64_t
+lilv_run_stats_bucket_min(unsigned bucket)
+{
+	if (bucket < LILV_SUB_BUCKETS) {
+		return bucket;
+	}
+
+	const unsigned exp = bucket / LILV_SUB_BUCKETS - 1;
+	const uint64_t sub = bucket % LILV_SUB_BUCKETS + LILV_SUB_BUCKETS;
+	return sub << exp;
+}
+
+LILV_API uint64_t
+lilv_run_stats_get_percentile(const LilvRunStats* stats, double percentile)
+{
+	const double target = stats->n_runs * percentile / 100.0;
+	uint64_t     count  = 0;
+	for (unsigned i = 0; i < LILV_RUN_STATS_BUCKETS; ++i) {
+		count += stats->histogram[i];
+		if (count && count >= target) {
+			return lilv_run_stats_bucket_min(i);
+		}
+	}
+	return stats->max_ns;
+}
+
+LILV_API void
+lilv_instance_enable_run_stats(LilvInstance* instance, uint64_t budget_ns)
+{
+	struct LilvInstancePimpl* pimpl =
+		(struct LilvInstancePimpl*)instance->pimpl;
+	if (!pimpl->stats) {
+		pimpl->stats = (LilvRunStatsImpl*)calloc(1, sizeof(LilvRunStatsImpl));
+	}
+	pimpl->stats->budget_ns = budget_ns;
+}
+
+LILV_API void
+lilv_instance_run_timed(LilvInstance* instance, uint32_t sample_count)
+{
+	LilvRunStatsImpl* const impl =
+		((struct LilvInstancePimpl*)instance->pimpl)->stats;
+	if (!impl) {
+		instance->lv2_descriptor->run(instance->lv2_handle, sample_count);
+		return;
+	}
+
+	const uint64_t start = lilv_now_ns();
+	instance->lv2_descriptor->run(instance->lv2_handle, sample_count);
+	const uint64_t ns = lilv_now_ns() - start;
+
+	LilvRunStats* const stats = &impl->stats;
+	++impl->seq;
+	LILV_BARRIER();
+	++stats->n_runs;
+	++stats->histogram[lilv_run_stats_bucket(ns)];
+	stats->total_ns += ns;
+	stats->last_ns   = ns;
+	if (ns > stats->max_ns) {
+		stats->max_ns = ns;
+	}
+	if (impl->budget_ns && ns > impl->budget_ns) {
+		++stats->n_overruns;
+	}
+	LILV_BARRIER();
+	++impl->seq;
+}
+
+LILV_API int
+lilv_instance_get_run_stats(const LilvInstance* instance,
+                            LilvRunStats*       stats)
+{
+	const LilvRunStatsImpl* const impl =
+		((const struct LilvInstancePimpl*)instance->pimpl)->stats;
+	if (!impl) {
+		return 1;
+	}
+
+	// Copy until no update happened during the copy
+	long before = 0;
+	long after  = 0;
+	do {
+		before = impl->seq;
+		LILV_BARRIER();
+		memcpy(stats, &impl->stats, sizeof(LilvRunStats));
+		LILV_BARRIER();
+		after = impl->seq;
+	} while ((before & 1) || before != after);
+
+	return 0;
+}
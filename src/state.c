@@ -17,6 +17,7 @@
 #include <errno.h>
 #include <stdio.h>
 #include <string.h>
+#include <time.h>
 
 #include "lv2/lv2plug.in/ns/ext/atom/atom.h"
 #include "lv2/lv2plug.in/ns/ext/atom/forge.h"
@@ -44,26 +45,85 @@ typedef struct {
 	uint32_t type;    ///< Type of value (URID)
 } PortValue;
 
+/** Header of a binary state file, all fields are in native byte order. */
+typedef struct {
+	char     magic[8];   ///< LILV_STATE_BINARY_MAGIC
+	uint32_t version;    ///< LILV_STATE_BINARY_VERSION
+	uint32_t endian;     ///< LILV_STATE_BINARY_ENDIAN as written
+	uint32_t n_strings;  ///< Number of entries in the string table
+	uint32_t n_values;   ///< Number of port value records
+	uint32_t n_props;    ///< Number of property records
+	uint32_t reserved;   ///< Zero
+	uint8_t  id[16];     ///< Random ID of this version of the file
+} BinaryHeader;
+
+/** Port value or property record in a binary state file, followed by body. */
+typedef struct {
+	uint32_t key;    ///< String index of port symbol or property key
+	uint32_t type;   ///< String index of value type
+	uint32_t flags;  ///< State flags (properties only)
+	uint32_t size;   ///< Size of body
+} BinaryRecord;
+
+#define LILV_STATE_BINARY_MAGIC   "LILVSTAT"
+#define LILV_STATE_BINARY_VERSION 4
+#define LILV_STATE_BINARY_ENDIAN  0x01020304
+
+/** Number of strings at the start of the string table, see below. */
+#define LILV_STATE_BINARY_N_FIXED 6
+
+/** Record flag for a port value or property removed from the base state. */
+#define LILV_STATE_BINARY_REMOVED 0x80000000u
+
+/** Maximum length of a chain of delta states. */
+#define LILV_STATE_MAX_DELTA_DEPTH 64
+
+/** Port values and properties to write to a binary state file. */
+typedef struct {
+	const PortValue* values;     ///< Values, removed ones have a NULL value
+	const Property*  props;      ///< Properties, removed ones have NULL value
+	uint32_t         n_values;
+	uint32_t         n_props;
+	const char*      base_path;  ///< Base state file of a delta, or NULL
+	const char*      base_uri;   ///< URI of base state, or NULL
+	const char*      base_id;    ///< ID of base state file, or NULL
+} BinaryContents;
+
+/** Block of memory that property and port values are allocated from. */
+typedef struct StateBlock {
+	struct StateBlock* prev;  ///< Previously allocated block
+	size_t             size;  ///< Size of data after header
+	size_t             used;  ///< Number of bytes allocated from data
+} StateBlock;
+
+#define STATE_BLOCK_HEADER_SIZE ((sizeof(StateBlock) + 7) & ~(size_t)7)
+#define STATE_BLOCK_MIN_SIZE    4096
+
 typedef struct {
 	char* abs;  ///< Absolute path of actual file
 	char* rel;  ///< Abstract path (relative path in state dir)
 } PathMap;
 
 struct LilvStateImpl {
-	LilvNode*  plugin_uri;  ///< Plugin URI
-	LilvNode*  uri;         ///< State/preset URI
-	char*      dir;         ///< Save directory (if saved)
-	char*      file_dir;    ///< Directory for files created by plugin
-	char*      copy_dir;    ///< Directory for snapshots of external files
-	char*      link_dir;    ///< Directory for links to external files
-	char*      label;       ///< State/Preset label
-	ZixTree*   abs2rel;     ///< PathMap sorted by abs
-	ZixTree*   rel2abs;     ///< PathMap sorted by rel
-	Property*  props;       ///< State properties
-	PortValue* values;      ///< Port values
-	uint32_t   atom_Path;   ///< atom:Path URID
-	uint32_t   n_props;     ///< Number of state properties
-	uint32_t   n_values;    ///< Number of port values
+	LilvNode*   plugin_uri;  ///< Plugin URI
+	LilvNode*   uri;         ///< State/preset URI
+	char*       dir;         ///< Save directory (if saved)
+	char*       file_dir;    ///< Directory for files created by plugin
+	char*       copy_dir;    ///< Directory for snapshots of external files
+	char*       link_dir;    ///< Directory for links to external files
+	char*       label;       ///< State/Preset label
+	ZixTree*    abs2rel;     ///< PathMap sorted by abs
+	ZixTree*    rel2abs;     ///< PathMap sorted by rel
+	Property*   props;       ///< State properties
+	PortValue*  values;      ///< Port values
+	StateBlock* arena;       ///< Last block of values and symbols
+	uint32_t    atom_Path;   ///< atom:Path URID
+	uint32_t    n_props;     ///< Number of state properties
+	uint32_t    n_values;    ///< Number of port values
+	uint32_t    props_cap;   ///< Allocated size of props
+	uint32_t    values_cap;  ///< Allocated size of values
+	uint32_t    n_paths;     ///< Number of atom:Path properties
+	uint8_t     hash[LILV_STATE_HASH_SIZE];  ///< Hash of all but label and files
 };
 
 static int
@@ -91,6 +151,63 @@ value_cmp(const void* a, const void* b)
 	              ((const PortValue*)b)->symbol);
 }
 
+static void
+hash_u32(LilvSha256* sha, uint32_t value)
+{
+	lilv_sha256_update(sha, (const uint8_t*)&value, sizeof(value));
+}
+
+static void
+hash_bytes(LilvSha256* sha, const void* data, size_t size)
+{
+	hash_u32(sha, (uint32_t)size);
+	lilv_sha256_update(sha, (const uint8_t*)data, size);
+}
+
+/**
+   Sort the values and properties of a newly made `state`, and hash them.
+
+   The hash covers port values and properties, except the contents of files
+   referred to by paths, which may change.  It is computed once here, and the
+   state is not modified afterwards (the label is not part of it), so it may
+   be read by any number of threads at once.
+*/
+static void
+lilv_state_finish(LilvState* state)
+{
+	qsort(state->props, state->n_props, sizeof(Property), property_cmp);
+	qsort(state->values, state->n_values, sizeof(PortValue), value_cmp);
+
+	// Values and properties are sorted, so equivalent states hash the same
+	LilvSha256 sha;
+	lilv_sha256_init(&sha);
+	hash_u32(&sha, state->n_values);
+	for (uint32_t i = 0; i < state->n_values; ++i) {
+		const PortValue* const v = &state->values[i];
+		hash_bytes(&sha, v->symbol, strlen(v->symbol));
+		hash_u32(&sha, v->type);
+		hash_bytes(&sha, v->value, v->size);
+	}
+
+	state->n_paths = 0;
+	hash_u32(&sha, state->n_props);
+	for (uint32_t i = 0; i < state->n_props; ++i) {
+		const Property* const p = &state->props[i];
+		hash_u32(&sha, p->key);
+		hash_u32(&sha, p->type);
+		hash_u32(&sha, p->flags);
+		if (p->type == state->atom_Path) {
+			++state->n_paths;  // Contents hashed when needed
+		} else {
+			hash_bytes(&sha, p->value, p->size);
+		}
+	}
+
+	uint8_t digest[32];
+	lilv_sha256_finish(&sha, digest);
+	memcpy(state->hash, digest, LILV_STATE_HASH_SIZE);
+}
+
 static void
 path_rel_free(void* ptr)
 {
@@ -99,6 +216,60 @@ path_rel_free(void* ptr)
 	free(ptr);
 }
 
+static size_t
+pad8(size_t size)
+{
+	return (size + 7) & ~(size_t)7;
+}
+
+/**
+   Allocate `size` bytes from the state arena.
+
+   Memory is never freed individually, blocks grow geometrically so a state
+   with many properties needs only a few allocations.
+*/
+static void*
+state_alloc(LilvState* state, size_t size)
+{
+	StateBlock* block = state->arena;
+	if (!block || block->size - block->used < pad8(size)) {
+		size_t block_size = block ? block->size * 2 : STATE_BLOCK_MIN_SIZE;
+		if (block_size < pad8(size)) {
+			block_size = pad8(size);
+		}
+
+		block = (StateBlock*)malloc(STATE_BLOCK_HEADER_SIZE + block_size);
+		block->prev  = state->arena;
+		block->size  = block_size;
+		block->used  = 0;
+		state->arena = block;
+	}
+
+	void* ptr = (uint8_t*)block + STATE_BLOCK_HEADER_SIZE + block->used;
+	block->used += pad8(size);
+	return ptr;
+}
+
+static void*
+state_copy(LilvState* state, const void* value, size_t size)
+{
+	void* copy = state_alloc(state, size);
+	memcpy(copy, value, size);
+	return copy;
+}
+
+/** Append a new uninitialised property to `state`. */
+static Property*
+append_property(LilvState* state)
+{
+	if (state->n_props == state->props_cap) {
+		state->props_cap = state->props_cap ? state->props_cap * 2 : 16;
+		state->props     = (Property*)realloc(
+			state->props, state->props_cap * sizeof(Property));
+	}
+	return &state->props[state->n_props++];
+}
+
 static PortValue*
 append_port_value(LilvState*  state,
                   const char* port_symbol,
@@ -107,14 +278,17 @@ append_port_value(LilvState*  state,
                   uint32_t    type)
 {
 	if (value) {
-		state->values = (PortValue*)realloc(
-			state->values, (++state->n_values) * sizeof(PortValue));
-		PortValue* pv = &state->values[state->n_values - 1];
-		pv->symbol = lilv_strdup(port_symbol);
-		pv->value  = malloc(size);
+		if (state->n_values == state->values_cap) {
+			state->values_cap = state->values_cap ? state->values_cap * 2 : 16;
+			state->values     = (PortValue*)realloc(
+				state->values, state->values_cap * sizeof(PortValue));
+		}
+		PortValue* pv = &state->values[state->n_values++];
+		pv->symbol = (char*)state_copy(
+			state, port_symbol, strlen(port_symbol) + 1);
+		pv->value  = state_copy(state, value, size);
 		pv->size   = size;
 		pv->type   = type;
-		memcpy(pv->value, value, size);
 		return pv;
 	}
 	return NULL;
@@ -140,13 +314,10 @@ store_callback(LV2_State_Handle handle,
                uint32_t         flags)
 {
 	LilvState* const state = (LilvState*)handle;
-	state->props = (Property*)realloc(
-		state->props, (++state->n_props) * sizeof(Property));
-	Property* const prop = &state->props[state->n_props - 1];
+	Property* const  prop  = append_property(state);
 
 	if ((flags & LV2_STATE_IS_POD) || type == state->atom_Path) {
-		prop->value = malloc(size);
-		memcpy(prop->value, value, size);
+		prop->value = state_copy(state, value, size);
 	} else {
 		LILV_WARN("Storing non-POD value\n");
 		prop->value = (void*)value;
@@ -209,7 +380,8 @@ abstract_path(LV2_State_Map_Path_Handle handle,
 	const PathMap key       = { (char*)real_path, NULL };
 	ZixTreeIter*  iter      = NULL;
 
-	if (abs_path[0] == '\0') {
+	if (abs_path[0] == '\0' || !state->abs2rel) {
+		free(real_path);
 		return lilv_strdup(abs_path);
 	} else if (!zix_tree_find(state->abs2rel, &key, &iter)) {
 		// Already mapped path in a previous call
@@ -223,25 +395,12 @@ abstract_path(LV2_State_Map_Path_Handle handle,
 		// File created by plugin earlier
 		path = lilv_path_relative_to(real_path, state->file_dir);
 		if (state->copy_dir) {
-			if (!lilv_path_exists(state->copy_dir, NULL)) {
-				lilv_mkdir_p(state->copy_dir);
+			// Refer to a copy with the same contents in the copy store
+			char* copy = lilv_file_store_add(state->copy_dir, real_path);
+			if (copy) {
+				free(real_path);
+				real_path = copy;
 			}
-			char* cpath = lilv_path_join(state->copy_dir, path);
-			char* copy  = lilv_get_latest_copy(real_path, cpath);
-			if (!copy || !lilv_file_equals(real_path, copy)) {
-				// No recent enough copy, make a new one
-				copy = lilv_find_free_path(cpath, lilv_path_exists, NULL);
-				const int st = lilv_copy_file(real_path, copy);
-				if (st) {
-					LILV_ERRORF("Error copying state file %s (%s)\n",
-					            copy, strerror(st));
-				}
-			}
-			free(real_path);
-			free(cpath);
-
-			// Refer to the latest copy in plugin state
-			real_path = copy;
 		}
 	} else if (state->link_dir) {
 		// New path outside state directory, make a link
@@ -258,11 +417,16 @@ abstract_path(LV2_State_Map_Path_Handle handle,
 	// Add record to path mapping
 	PathMap* pm = (PathMap*)malloc(sizeof(PathMap));
 	pm->abs = real_path;
-	pm->rel = lilv_strdup(path);
-	zix_tree_insert(state->abs2rel, pm, NULL);
-	zix_tree_insert(state->rel2abs, pm, NULL);
+	pm->rel = path;
+	if (zix_tree_insert(state->abs2rel, pm, &iter)) {
+		// Same stored copy as a file mapped earlier, so use the same path
+		path_rel_free(pm);
+		pm = (PathMap*)zix_tree_get(iter);
+	} else {
+		zix_tree_insert(state->rel2abs, pm, NULL);
+	}
 
-	return path;
+	return lilv_strdup(pm->rel);
 }
 
 static char*
@@ -327,37 +491,17 @@ state_strerror(LV2_State_Status st)
 	}
 }
 
-LILV_API LilvState*
-lilv_state_new_from_instance(const LilvPlugin*          plugin,
-                             LilvInstance*              instance,
-                             LV2_URID_Map*              map,
-                             const char*                file_dir,
-                             const char*                copy_dir,
-                             const char*                link_dir,
-                             const char*                save_dir,
-                             LilvGetPortValueFunc       get_value,
-                             void*                      user_data,
-                             uint32_t                   flags,
-                             const LV2_Feature *const * features)
+/** Store port values and plugin properties in `state`. */
+static void
+lilv_state_store_instance(LilvState*                 state,
+                          const LilvPlugin*          plugin,
+                          LilvInstance*              instance,
+                          LilvGetPortValueFunc       get_value,
+                          void*                      user_data,
+                          uint32_t                   flags,
+                          const LV2_Feature *const * features)
 {
-	const LV2_Feature** sfeatures = NULL;
-	LilvWorld* const    world     = plugin->world;
-	LilvState* const    state     = (LilvState*)calloc(1, sizeof(LilvState));
-	state->plugin_uri = lilv_node_duplicate(lilv_plugin_get_uri(plugin));
-	state->abs2rel    = zix_tree_new(false, abs_cmp, NULL, path_rel_free);
-	state->rel2abs    = zix_tree_new(false, rel_cmp, NULL, NULL);
-	state->file_dir   = file_dir ? absolute_dir(file_dir) : NULL;
-	state->copy_dir   = copy_dir ? absolute_dir(copy_dir) : NULL;
-	state->link_dir   = link_dir ? absolute_dir(link_dir) : NULL;
-	state->dir        = save_dir ? absolute_dir(save_dir) : NULL;
-	state->atom_Path  = map->map(map->handle, LV2_ATOM__Path);
-
-	LV2_State_Map_Path  pmap          = { state, abstract_path, absolute_path };
-	LV2_Feature         pmap_feature  = { LV2_STATE__mapPath, &pmap };
-	LV2_State_Make_Path pmake         = { state, make_path };
-	LV2_Feature         pmake_feature = { LV2_STATE__makePath, &pmake };
-	features = sfeatures = add_features(features, &pmap_feature,
-	                                    save_dir ? &pmake_feature : NULL);
+	LilvWorld* const world = plugin->world;
 
 	// Store port values
 	if (get_value) {
@@ -388,15 +532,72 @@ lilv_state_new_from_instance(const LilvPlugin*          plugin,
 			instance->lv2_handle, store_callback, state, flags, features);
 		if (st) {
 			LILV_ERRORF("Error saving plugin state: %s\n", state_strerror(st));
-			free(state->props);
-			state->props     = NULL;
 			state->n_props = 0;
-		} else {
-			qsort(state->props, state->n_props, sizeof(Property), property_cmp);
 		}
 	}
 
-	qsort(state->values, state->n_values, sizeof(PortValue), value_cmp);
+	lilv_state_finish(state);
+}
+
+LILV_API LilvState*
+lilv_state_new_from_instance(const LilvPlugin*          plugin,
+                             LilvInstance*              instance,
+                             LV2_URID_Map*              map,
+                             const char*                file_dir,
+                             const char*                copy_dir,
+                             const char*                link_dir,
+                             const char*                save_dir,
+                             LilvGetPortValueFunc       get_value,
+                             void*                      user_data,
+                             uint32_t                   flags,
+                             const LV2_Feature *const * features)
+{
+	const LV2_Feature** sfeatures = NULL;
+	LilvState* const    state     = (LilvState*)calloc(1, sizeof(LilvState));
+	state->plugin_uri = lilv_node_duplicate(lilv_plugin_get_uri(plugin));
+	state->abs2rel    = zix_tree_new(false, abs_cmp, NULL, path_rel_free);
+	state->rel2abs    = zix_tree_new(false, rel_cmp, NULL, NULL);
+	state->file_dir   = file_dir ? absolute_dir(file_dir) : NULL;
+	state->copy_dir   = copy_dir ? absolute_dir(copy_dir) : NULL;
+	state->link_dir   = link_dir ? absolute_dir(link_dir) : NULL;
+	state->dir        = save_dir ? absolute_dir(save_dir) : NULL;
+	state->atom_Path  = map->map(map->handle, LV2_ATOM__Path);
+
+	LV2_State_Map_Path  pmap          = { state, abstract_path, absolute_path };
+	LV2_Feature         pmap_feature  = { LV2_STATE__mapPath, &pmap };
+	LV2_State_Make_Path pmake         = { state, make_path };
+	LV2_Feature         pmake_feature = { LV2_STATE__makePath, &pmake };
+	features = sfeatures = add_features(features, &pmap_feature,
+	                                    save_dir ? &pmake_feature : NULL);
+
+	lilv_state_store_instance(
+		state, plugin, instance, get_value, user_data, flags, features);
+
+	free(sfeatures);
+	return state;
+}
+
+LILV_API LilvState*
+lilv_state_new_snapshot(const LilvPlugin*          plugin,
+                        LilvInstance*              instance,
+                        LV2_URID_Map*              map,
+                        LilvGetPortValueFunc       get_value,
+                        void*                      user_data,
+                        uint32_t                   flags,
+                        const LV2_Feature *const * features)
+{
+	LilvState* const state = (LilvState*)calloc(1, sizeof(LilvState));
+	state->plugin_uri = lilv_node_duplicate(lilv_plugin_get_uri(plugin));
+	state->atom_Path  = map->map(map->handle, LV2_ATOM__Path);
+
+	// Without path maps, abstract_path() leaves paths as they are
+	LV2_State_Map_Path  pmap         = { state, abstract_path, absolute_path };
+	LV2_Feature         pmap_feature = { LV2_STATE__mapPath, &pmap };
+	const LV2_Feature** sfeatures    = add_features(
+		features, &pmap_feature, NULL);
+
+	lilv_state_store_instance(
+		state, plugin, instance, get_value, user_data, flags, sfeatures);
 
 	free(sfeatures);
 	return state;
@@ -454,12 +655,12 @@ lilv_state_restore(const LilvState*           state,
 	}
 }
 
-static LilvState*
-new_state_from_model(LilvWorld*       world,
-                     LV2_URID_Map*    map,
-                     SordModel*       model,
-                     const SordNode*  node,
-                     const char*      dir)
+LilvState*
+lilv_state_new_from_model(LilvWorld*      world,
+                          LV2_URID_Map*   map,
+                          SordModel*      model,
+                          const SordNode* node,
+                          const char*     dir)
 {
 	// Check that we know at least something about this state subject
 	if (!sord_ask(model, node, 0, 0, 0)) {
@@ -470,14 +671,14 @@ new_state_from_model(LilvWorld*       world,
 	LilvState* const state = (LilvState*)calloc(1, sizeof(LilvState));
 	state->dir       = lilv_strdup(dir);
 	state->atom_Path = map->map(map->handle, LV2_ATOM__Path);
-	state->uri       = lilv_node_new_from_node(world, node);
+	state->uri       = lilv_node_copy_from_node(world, node);
 
 	// Get the plugin URI this state applies to
 	SordIter* i = sord_search(model, node, world->uris.lv2_appliesTo, 0, 0);
 	if (i) {
 		const SordNode* object = sord_iter_get_node(i, SORD_OBJECT);
 		const SordNode* graph  = sord_iter_get_node(i, SORD_GRAPH);
-		state->plugin_uri = lilv_node_new_from_node(world, object);
+		state->plugin_uri = lilv_node_copy_from_node(world, object);
 		if (!state->dir && graph) {
 			state->dir = lilv_strdup((const char*)sord_node_get_string(graph));
 		}
@@ -487,7 +688,7 @@ new_state_from_model(LilvWorld*       world,
 	                    world->uris.rdf_a,
 	                    world->uris.lv2_Plugin, 0)) {
 		// Loading plugin description as state (default state)
-		state->plugin_uri = lilv_node_new_from_node(world, node);
+		state->plugin_uri = lilv_node_copy_from_node(world, node);
 	} else {
 		LILV_ERRORF("State %s missing lv2:appliesTo property\n",
 		            sord_node_get_string(node));
@@ -569,17 +770,13 @@ new_state_from_model(LilvWorld*       world,
 			prop.key   = map->map(map->handle, key);
 			prop.type  = atom->type;
 			prop.size  = atom->size;
-			prop.value = malloc(atom->size);
-			memcpy(prop.value, LV2_ATOM_BODY_CONST(atom), atom->size);
+			prop.value = state_copy(
+				state, LV2_ATOM_BODY_CONST(atom), atom->size);
 			if (atom->type == forge.Path) {
 				prop.flags = LV2_STATE_IS_PORTABLE;
 			}
 
-			if (prop.value) {
-				state->props = (Property*)realloc(
-					state->props, (++state->n_props) * sizeof(Property));
-				state->props[state->n_props - 1] = prop;
-			}
+			*append_property(state) = prop;
 		}
 		sord_iter_free(props);
 	}
@@ -589,12 +786,32 @@ new_state_from_model(LilvWorld*       world,
 	free((void*)chunk.buf);
 	sratom_free(sratom);
 
-	qsort(state->props, state->n_props, sizeof(Property), property_cmp);
-	qsort(state->values, state->n_values, sizeof(PortValue), value_cmp);
+	lilv_state_finish(state);
 
 	return state;
 }
 
+/** Return a copy of `node` in `world`, and free `node` if it was elsewhere. */
+static LilvNode*
+lilv_node_move(LilvNode* node, LilvWorld* world)
+{
+	if (!node || node->world == world) {
+		return node;
+	}
+
+	LilvNode* copy = lilv_node_new(world, node->type, lilv_node_as_string(node));
+	lilv_node_free(node);
+	return copy;
+}
+
+/** Move the nodes of `state` to `world`, so another world can be freed. */
+void
+lilv_state_set_world(LilvState* state, LilvWorld* world)
+{
+	state->plugin_uri = lilv_node_move(state->plugin_uri, world);
+	state->uri        = lilv_node_move(state->uri, world);
+}
+
 LILV_API LilvState*
 lilv_state_new_from_world(LilvWorld*      world,
                           LV2_URID_Map*   map,
@@ -606,14 +823,299 @@ lilv_state_new_from_world(LilvWorld*      world,
 		return NULL;
 	}
 
-	return new_state_from_model(world, map, world->model, node->node, NULL);
+	return lilv_state_new_from_model(world, map, world->model, node->node, NULL);
 }
 
-LILV_API LilvState*
-lilv_state_new_from_file(LilvWorld*      world,
-                         LV2_URID_Map*   map,
-                         const LilvNode* subject,
-                         const char*     path)
+/** Return the next `size` bytes of `*ptr` and skip them with padding. */
+static const uint8_t*
+binary_read(const uint8_t** ptr, const uint8_t* end, size_t size)
+{
+	const uint8_t* data = *ptr;
+	if (size > (size_t)(end - data) || (size_t)(end - data) < pad8(size)) {
+		return NULL;
+	}
+	*ptr += pad8(size);
+	return data;
+}
+
+static LilvState*
+lilv_state_load_file(LilvWorld*      world,
+                     LV2_URID_Map*   map,
+                     const LilvNode* subject,
+                     const char*     path,
+                     unsigned        depth);
+
+/** Return the path of the base state of a delta saved in `dir`. */
+static char*
+delta_base_path(const char* dir, const char* base_path)
+{
+	return (lilv_path_is_absolute(base_path) || !dir)
+		? lilv_strdup(base_path)
+		: lilv_path_join(dir, base_path);
+}
+
+/**
+   Write the ID of the state file at `path` to `id` as a string.
+
+   This is the random ID in the header of a binary file, so only the header
+   is read.  Other files have no ID, so their SHA-256 is used instead.
+*/
+static int
+delta_base_id(const char* path, char* id)
+{
+	FILE* fd = fopen(path, "rb");
+	if (!fd) {
+		return errno;
+	}
+
+	BinaryHeader header;
+	const bool   binary = fread(&header, sizeof(header), 1, fd) == 1
+		&& !memcmp(header.magic, LILV_STATE_BINARY_MAGIC, 8)
+		&& header.version == LILV_STATE_BINARY_VERSION;
+	fclose(fd);
+	if (!binary) {
+		return lilv_file_sha256(path, id);
+	}
+
+	for (unsigned i = 0; i < sizeof(header.id); ++i) {
+		snprintf(id + i * 2, 3, "%02x", header.id[i]);
+	}
+	return 0;
+}
+
+/**
+   Load the base state of a delta, which is relative to `dir`.
+
+   The base file must still have the ID it had when the delta was saved,
+   otherwise the delta would be applied to a different state.
+*/
+static LilvState*
+load_delta_base(LilvWorld*    world,
+                LV2_URID_Map* map,
+                const char*   base_path,
+                const char*   base_uri,
+                const char*   base_id,
+                const char*   dir,
+                unsigned      depth)
+{
+	if (depth >= LILV_STATE_MAX_DELTA_DEPTH) {
+		LILV_ERRORF("Chain of delta states to %s is too long\n", base_path);
+		return NULL;
+	}
+
+	char* const path = delta_base_path(dir, base_path);
+	char        id[65];
+	if (delta_base_id(path, id) || strcmp(id, base_id)) {
+		LILV_ERRORF("Delta base %s has changed since the delta was saved\n",
+		            path);
+		free(path);
+		return NULL;
+	}
+
+	LilvNode* const subject = base_uri[0] ? lilv_new_uri(world, base_uri) : NULL;
+	LilvState* const base = lilv_state_load_file(
+		world, map, subject, path, depth + 1);
+	if (!base) {
+		LILV_ERRORF("Failed to load delta base %s\n", path);
+	}
+
+	lilv_node_free(subject);
+	free(path);
+	return base;
+}
+
+static int
+port_value_symbol_cmp(const void* key, const void* value)
+{
+	return strcmp((const char*)key, ((const PortValue*)value)->symbol);
+}
+
+static int
+property_key_cmp(const void* key, const void* prop)
+{
+	const uint32_t k = *(const uint32_t*)key;
+	const uint32_t p = ((const Property*)prop)->key;
+	return (k < p) ? -1 : (k > p) ? 1 : 0;
+}
+
+static LilvState*
+new_state_from_binary(LilvWorld*     world,
+                      LV2_URID_Map*  map,
+                      const uint8_t* buf,
+                      size_t         size,
+                      const char*    path,
+                      const char*    dir,
+                      unsigned       depth)
+{
+	const uint8_t* const end    = buf + size;
+	const uint8_t*       ptr    = buf;
+	const BinaryHeader*  header = (const BinaryHeader*)binary_read(
+		&ptr, end, sizeof(BinaryHeader));
+	if (!header || header->version != LILV_STATE_BINARY_VERSION
+	    || header->endian != LILV_STATE_BINARY_ENDIAN
+	    || header->n_strings < LILV_STATE_BINARY_N_FIXED
+	    || header->n_strings > size / 8) {
+		LILV_ERRORF("Unsupported binary state file %s\n", path);
+		return NULL;
+	}
+
+	// Read string table, each entry is a length then a terminated string
+	const char** strings = (const char**)calloc(
+		header->n_strings, sizeof(const char*));
+	for (uint32_t i = 0; i < header->n_strings; ++i) {
+		uint32_t len = 0;
+		if (end - ptr < (ptrdiff_t)sizeof(len)) {
+			break;
+		}
+		memcpy(&len, ptr, sizeof(len));
+		if (len >= (size_t)(end - ptr) - sizeof(len)) {
+			break;  // Checked first, since the size below may overflow
+		}
+		const uint8_t* str = binary_read(&ptr, end, sizeof(len) + len + 1);
+		if (!str || str[sizeof(len) + len]) {
+			break;
+		}
+		strings[i] = (const char*)str + sizeof(len);
+	}
+	if (!strings[header->n_strings - 1]) {
+		LILV_ERRORF("Corrupt string table in %s\n", path);
+		free(strings);
+		return NULL;
+	}
+
+	// Start with the base state for a delta, or an empty state
+	LilvState* state = NULL;
+	if (strings[3][0]) {
+		if (!(state = load_delta_base(
+			      world, map, strings[3], strings[4], strings[5], dir,
+			      depth))) {
+			free(strings);
+			return NULL;
+		}
+		free(state->dir);
+		free(state->label);
+		lilv_node_free(state->plugin_uri);
+		lilv_node_free(state->uri);
+		state->label = NULL;
+	} else {
+		state            = (LilvState*)calloc(1, sizeof(LilvState));
+		state->atom_Path = map->map(map->handle, LV2_ATOM__Path);
+	}
+
+	state->dir        = lilv_strdup(dir);
+	state->plugin_uri = lilv_new_uri(world, strings[0]);
+	if (strings[1][0]) {
+		state->uri = lilv_new_uri(world, strings[1]);
+	} else {
+		SerdNode file = serd_node_new_file_uri(USTR(path), NULL, NULL, false);
+		state->uri = lilv_new_uri(world, (const char*)file.buf);
+		serd_node_free(&file);
+	}
+	if (strings[2][0]) {
+		state->label = lilv_strdup(strings[2]);
+	}
+
+	// Base values are sorted, so they can be found while appending to them
+	const uint32_t n_base_values = state->n_values;
+	const uint32_t n_base_props  = state->n_props;
+	bool* const    removed       = (bool*)calloc(
+		n_base_values + n_base_props + 1, sizeof(bool));
+
+	// Read port values then properties, bodies are copied without decoding
+	const uint64_t n_records = (uint64_t)header->n_values + header->n_props;
+	bool           corrupt   = false;
+	for (uint64_t i = 0; i < n_records; ++i) {
+		const BinaryRecord* rec = (const BinaryRecord*)binary_read(
+			&ptr, end, sizeof(BinaryRecord));
+		const uint8_t* body = rec ? binary_read(&ptr, end, rec->size) : NULL;
+		if (!body || rec->key >= header->n_strings
+		    || rec->type >= header->n_strings) {
+			corrupt = true;
+			break;
+		}
+
+		const bool     is_removed = rec->flags & LILV_STATE_BINARY_REMOVED;
+		const uint32_t type       = is_removed
+			? 0 : map->map(map->handle, strings[rec->type]);
+		if (i < header->n_values) {
+			const char* const symbol = strings[rec->key];
+			PortValue* const  old    = (PortValue*)bsearch(
+				symbol, state->values, n_base_values, sizeof(PortValue),
+				port_value_symbol_cmp);
+			if (is_removed) {
+				if (old) {
+					removed[old - state->values] = true;
+				}
+			} else if (old) {
+				old->value = state_copy(state, body, rec->size);
+				old->size  = rec->size;
+				old->type  = type;
+			} else {
+				append_port_value(state, symbol, body, rec->size, type);
+			}
+		} else {
+			const uint32_t  key = map->map(map->handle, strings[rec->key]);
+			Property* const old = (Property*)bsearch(
+				&key, state->props, n_base_props, sizeof(Property),
+				property_key_cmp);
+			if (is_removed) {
+				if (old) {
+					removed[n_base_values + (old - state->props)] = true;
+				}
+				continue;
+			}
+
+			Property* const prop = old ? old : append_property(state);
+			prop->value = state_copy(state, body, rec->size);
+			prop->size  = rec->size;
+			prop->key   = key;
+			prop->type  = type;
+			prop->flags = rec->flags;
+		}
+	}
+	free(strings);
+	if (corrupt) {
+		LILV_ERRORF("Corrupt record in %s\n", path);
+		free(removed);
+		lilv_state_free(state);
+		return NULL;
+	}
+
+	// Drop values and properties removed by a delta
+	uint32_t n_values = 0;
+	for (uint32_t i = 0; i < state->n_values; ++i) {
+		if (i >= n_base_values || !removed[i]) {
+			state->values[n_values++] = state->values[i];
+		}
+	}
+	uint32_t n_props = 0;
+	for (uint32_t i = 0; i < state->n_props; ++i) {
+		if (i >= n_base_props || !removed[n_base_values + i]) {
+			state->props[n_props++] = state->props[i];
+		}
+	}
+	state->n_values = n_values;
+	state->n_props  = n_props;
+	free(removed);
+
+	lilv_state_finish(state);
+
+	return state;
+}
+
+static bool
+is_binary_state(const void* buf, size_t size)
+{
+	return size >= sizeof(BinaryHeader)
+		&& !memcmp(buf, LILV_STATE_BINARY_MAGIC, 8);
+}
+
+static LilvState*
+lilv_state_load_file(LilvWorld*      world,
+                     LV2_URID_Map*   map,
+                     const LilvNode* subject,
+                     const char*     path,
+                     unsigned        depth)
 {
 	if (subject && !lilv_node_is_uri(subject)
 	    && !lilv_node_is_blank(subject)) {
@@ -622,6 +1124,23 @@ lilv_state_new_from_file(LilvWorld*      world,
 		return NULL;
 	}
 
+	// Load binary state directly from the mapped file
+	size_t size = 0;
+	void*  buf  = lilv_map_file(path, &size);
+	if (buf && is_binary_state(buf, size)) {
+		char*      abs_path  = lilv_path_absolute(path);
+		char*      dirname   = lilv_dirname(path);
+		char*      real_path = lilv_realpath(dirname);
+		LilvState* state     = new_state_from_binary(
+			world, map, (const uint8_t*)buf, size, abs_path, real_path, depth);
+		free(dirname);
+		free(real_path);
+		free(abs_path);
+		lilv_unmap_file(buf, size);
+		return state;
+	}
+	lilv_unmap_file(buf, size);
+
 	uint8_t*    abs_path = (uint8_t*)lilv_path_absolute(path);
 	SerdNode    node     = serd_node_new_file_uri(abs_path, NULL, NULL, 0);
 	SerdEnv*    env      = serd_env_new(&node);
@@ -636,7 +1155,7 @@ lilv_state_new_from_file(LilvWorld*      world,
 
 	char* dirname   = lilv_dirname(path);
 	char* real_path = lilv_realpath(dirname);
-	LilvState* state = new_state_from_model(
+	LilvState* state = lilv_state_new_from_model(
 		world, map, model, subject_node, real_path);
 	free(dirname);
 	free(real_path);
@@ -649,6 +1168,15 @@ lilv_state_new_from_file(LilvWorld*      world,
 	return state;
 }
 
+LILV_API LilvState*
+lilv_state_new_from_file(LilvWorld*      world,
+                         LV2_URID_Map*   map,
+                         const LilvNode* subject,
+                         const char*     path)
+{
+	return lilv_state_load_file(world, map, subject, path, 0);
+}
+
 static void
 set_prefixes(SerdEnv* env)
 {
@@ -682,7 +1210,7 @@ lilv_state_new_from_string(LilvWorld*    world,
 	SordNode* o = sord_new_uri(world->world, USTR(LV2_PRESETS__Preset));
 	SordNode* s = sord_get(model, NULL, world->uris.rdf_a, o, NULL);
 
-	LilvState* state = new_state_from_model(world, map, model, s, NULL);
+	LilvState* state = lilv_state_new_from_model(world, map, model, s, NULL);
 
 	sord_node_free(world->world, s);
 	sord_node_free(world->world, o);
@@ -768,16 +1296,22 @@ remove_manifest_entry(SordWorld* world, SordModel* model, const char* subject)
 	sord_node_free(world, s);
 }
 
+/** A state to add to a manifest. */
+typedef struct {
+	const LilvNode* plugin_uri;  ///< URI of plugin the state applies to
+	const char*     state_uri;   ///< State URI, or NULL to use file URI
+	const char*     state_path;  ///< Absolute path of state file
+} ManifestEntry;
+
+/** Add entries to a manifest, reading and writing it only once. */
 static int
-add_state_to_manifest(LilvWorld*      lworld,
-                      const LilvNode* plugin_uri,
-                      const char*     manifest_path,
-                      const char*     state_uri,
-                      const char*     state_path)
+add_states_to_manifest(LilvWorld*           lworld,
+                       const char*          manifest_path,
+                       unsigned             n_entries,
+                       const ManifestEntry* entries)
 {
 	SordWorld*  world    = lworld->world;
 	SerdNode    manifest = serd_node_new_file_uri(USTR(manifest_path), 0, 0, 0);
-	SerdNode    file     = serd_node_new_file_uri(USTR(state_path), 0, 0, 0);
 	SerdEnv*    env      = serd_env_new(&manifest);
 	SordModel*  model    = sord_new(world, SORD_SPO, false);
 
@@ -790,41 +1324,46 @@ add_state_to_manifest(LilvWorld*      lworld,
 		serd_reader_free(reader);
 	}
 
-	// Choose state URI (use file URI if not given)
-	if (!state_uri) {
-		state_uri = (const char*)file.buf;
-	}
+	for (unsigned i = 0; i < n_entries; ++i) {
+		const ManifestEntry* const entry = &entries[i];
+		SerdNode file = serd_node_new_file_uri(
+			USTR(entry->state_path), 0, 0, 0);
 
-	// Remove any existing manifest entries for this state
-	remove_manifest_entry(world, model, state_uri);
-
-	// Add manifest entry for this state to model
-	SerdNode s = serd_node_from_string(SERD_URI, USTR(state_uri));
-
-	// <state> a pset:Preset
-	add_to_model(world, env, model,
-	             s,
-	             serd_node_from_string(SERD_URI, USTR(LILV_NS_RDF "type")),
-	             serd_node_from_string(SERD_URI, USTR(LV2_PRESETS__Preset)));
-
-	// <state> a pset:Preset
-	add_to_model(world, env, model,
-	             s,
-	             serd_node_from_string(SERD_URI, USTR(LILV_NS_RDF "type")),
-	             serd_node_from_string(SERD_URI, USTR(LV2_PRESETS__Preset)));
-
-	// <state> rdfs:seeAlso <file>
-	add_to_model(world, env, model,
-	             s,
-	             serd_node_from_string(SERD_URI, USTR(LILV_NS_RDFS "seeAlso")),
-	             file);
-
-	// <state> lv2:appliesTo <plugin>
-	add_to_model(world, env, model,
-	             s,
-	             serd_node_from_string(SERD_URI, USTR(LV2_CORE__appliesTo)),
-	             serd_node_from_string(SERD_URI,
-	                                   USTR(lilv_node_as_string(plugin_uri))));
+		// Choose state URI (use file URI if not given)
+		const char* state_uri = entry->state_uri;
+		if (!state_uri) {
+			state_uri = (const char*)file.buf;
+		}
+
+		// Remove any existing manifest entries for this state
+		remove_manifest_entry(world, model, state_uri);
+
+		// Add manifest entry for this state to model
+		SerdNode s = serd_node_from_string(SERD_URI, USTR(state_uri));
+
+		// <state> a pset:Preset
+		add_to_model(world, env, model,
+		             s,
+		             serd_node_from_string(SERD_URI, USTR(LILV_NS_RDF "type")),
+		             serd_node_from_string(SERD_URI, USTR(LV2_PRESETS__Preset)));
+
+		// <state> rdfs:seeAlso <file>
+		add_to_model(world, env, model,
+		             s,
+		             serd_node_from_string(SERD_URI,
+		                                   USTR(LILV_NS_RDFS "seeAlso")),
+		             file);
+
+		// <state> lv2:appliesTo <plugin>
+		add_to_model(world, env, model,
+		             s,
+		             serd_node_from_string(SERD_URI, USTR(LV2_CORE__appliesTo)),
+		             serd_node_from_string(
+			             SERD_URI,
+			             USTR(lilv_node_as_string(entry->plugin_uri))));
+
+		serd_node_free(&file);
+	}
 
 	// Write manifest model to file
 	FILE* wfd = fopen(manifest_path, "w");
@@ -839,7 +1378,6 @@ add_state_to_manifest(LilvWorld*      lworld,
 	}
 
 	sord_free(model);
-	serd_node_free(&file);
 	serd_node_free(&manifest);
 	serd_env_free(env);
 
@@ -974,9 +1512,278 @@ lilv_state_write(LilvWorld*       world,
 	return 0;
 }
 
+/** Write `size` bytes followed by zero padding to an 8 byte boundary. */
+static bool
+binary_write(FILE* fd, const void* buf, size_t size)
+{
+	static const uint8_t zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	const size_t         pad      = pad8(size) - size;
+	return fwrite(buf, 1, size, fd) == size
+		&& fwrite(zeros, 1, pad, fd) == pad;
+}
+
+static bool
+binary_write_string(FILE* fd, const char* str)
+{
+	const uint32_t len = (uint32_t)strlen(str);
+	const size_t   pad = pad8(sizeof(len) + len + 1) - sizeof(len) - len - 1;
+	static const uint8_t zeros[8] = { 0, 0, 0, 0, 0, 0, 0, 0 };
+	return fwrite(&len, sizeof(len), 1, fd) == 1
+		&& fwrite(str, 1, len + 1, fd) == len + 1
+		&& fwrite(zeros, 1, pad, fd) == pad;
+}
+
+/**
+   Set `id` to a new random binary state file ID.
+
+   This only needs to be unique, so if there is no system random source, a
+   hash of the time and a counter is used instead.
+*/
+static void
+binary_new_id(uint8_t* id)
+{
+	FILE* fd = fopen("/dev/urandom", "rb");
+	if (fd) {
+		const size_t n_read = fread(id, 1, 16, fd);
+		fclose(fd);
+		if (n_read == 16) {
+			return;
+		}
+	}
+
+	static uint32_t counter = 0;
+	const uint32_t  count   = LILV_ATOMIC_ADD(&counter, 1);
+	const time_t    now     = time(NULL);
+	const clock_t   ticks   = clock();
+	uint8_t         digest[32];
+	LilvSha256      sha;
+	lilv_sha256_init(&sha);
+	lilv_sha256_update(&sha, (const uint8_t*)&count, sizeof(count));
+	lilv_sha256_update(&sha, (const uint8_t*)&now, sizeof(now));
+	lilv_sha256_update(&sha, (const uint8_t*)&ticks, sizeof(ticks));
+	lilv_sha256_update(&sha, (const uint8_t*)&id, sizeof(id));
+	lilv_sha256_finish(&sha, digest);
+	memcpy(id, digest, 16);
+}
+
+static int
+urid_cmp(const void* a, const void* b)
+{
+	const uint32_t ua = *(const uint32_t*)a;
+	const uint32_t ub = *(const uint32_t*)b;
+	return (ua < ub) ? -1 : (ua > ub) ? 1 : 0;
+}
+
+/** Return the string index of `urid` in a binary state string table. */
+static uint32_t
+urid_index(const uint32_t* urids, uint32_t n_urids, uint32_t urid)
+{
+	const uint32_t* found = (const uint32_t*)bsearch(
+		&urid, urids, n_urids, sizeof(uint32_t), urid_cmp);
+	return LILV_STATE_BINARY_N_FIXED + (uint32_t)(found - urids);
+}
+
+/**
+   Write state to a binary file.
+
+   The header contains a new random ID, so a delta can detect that its base
+   file was overwritten without hashing it.  The string table starts with the
+   plugin URI, state URI, label, base file path, base state URI, and ID of
+   the base file (each empty if missing), followed by every URI
+   used as a key or type, then every port symbol.  Bodies are written raw, so
+   they can be used directly when loaded.
+
+   A file with a base path is a delta, which only contains the port values
+   and properties that differ from the base, and records with the
+   LILV_STATE_BINARY_REMOVED flag for those that were removed.
+*/
+static int
+lilv_state_write_binary(LV2_URID_Unmap*       unmap,
+                        const LilvState*      state,
+                        const BinaryContents* contents,
+                        FILE*                 fd,
+                        const char*           uri)
+{
+	const uint32_t n_values = contents->n_values;
+	const uint32_t n_props  = contents->n_props;
+
+	// Collect unique URIDs of keys and types
+	uint32_t* urids = (uint32_t*)malloc(
+		(n_values + 2 * n_props + 1) * sizeof(uint32_t));
+	uint32_t n_urids = 0;
+	for (uint32_t i = 0; i < n_values; ++i) {
+		if (contents->values[i].value) {
+			urids[n_urids++] = contents->values[i].type;
+		}
+	}
+	for (uint32_t i = 0; i < n_props; ++i) {
+		urids[n_urids++] = contents->props[i].key;
+		if (contents->props[i].value) {
+			urids[n_urids++] = contents->props[i].type;
+		}
+	}
+	qsort(urids, n_urids, sizeof(uint32_t), urid_cmp);
+	uint32_t n_unique = 0;
+	for (uint32_t i = 0; i < n_urids; ++i) {
+		if (!n_unique || urids[i] != urids[n_unique - 1]) {
+			urids[n_unique++] = urids[i];
+		}
+	}
+
+	const uint32_t     first_symbol = LILV_STATE_BINARY_N_FIXED + n_unique;
+	BinaryHeader       header       = {
+		LILV_STATE_BINARY_MAGIC, LILV_STATE_BINARY_VERSION,
+		LILV_STATE_BINARY_ENDIAN, first_symbol + n_values,
+		n_values, n_props, 0, { 0 } };
+	binary_new_id(header.id);
+
+	const char* base_path = contents->base_path;
+	const char* base_uri  = contents->base_uri;
+	const char* base_id   = contents->base_id;
+	bool success = binary_write(fd, &header, sizeof(header))
+		&& binary_write_string(fd, lilv_node_as_uri(state->plugin_uri))
+		&& binary_write_string(fd, uri ? uri : "")
+		&& binary_write_string(fd, state->label ? state->label : "")
+		&& binary_write_string(fd, base_path ? base_path : "")
+		&& binary_write_string(fd, base_uri ? base_uri : "")
+		&& binary_write_string(fd, base_id ? base_id : "");
+	for (uint32_t i = 0; success && i < n_unique; ++i) {
+		const char* str = unmap->unmap(unmap->handle, urids[i]);
+		success = binary_write_string(fd, str ? str : "");
+	}
+	for (uint32_t i = 0; success && i < n_values; ++i) {
+		success = binary_write_string(fd, contents->values[i].symbol);
+	}
+
+	for (uint32_t i = 0; success && i < n_values; ++i) {
+		const PortValue* const value = &contents->values[i];
+		const BinaryRecord     rec   = {
+			first_symbol + i,
+			value->value ? urid_index(urids, n_unique, value->type) : 0,
+			value->value ? 0 : LILV_STATE_BINARY_REMOVED,
+			value->size };
+		success = binary_write(fd, &rec, sizeof(rec))
+			&& binary_write(fd, value->value, value->size);
+	}
+
+	for (uint32_t i = 0; success && i < n_props; ++i) {
+		const Property* const prop = &contents->props[i];
+		const BinaryRecord    rec  = {
+			urid_index(urids, n_unique, prop->key),
+			prop->value ? urid_index(urids, n_unique, prop->type) : 0,
+			prop->value ? prop->flags : LILV_STATE_BINARY_REMOVED,
+			(uint32_t)prop->size };
+		success = binary_write(fd, &rec, sizeof(rec))
+			&& binary_write(fd, prop->value, prop->size);
+	}
+
+	free(urids);
+	return success ? 0 : 1;
+}
+
+static bool
+port_value_equals(const PortValue* a, const PortValue* b)
+{
+	return a->size == b->size && a->type == b->type
+		&& !memcmp(a->value, b->value, a->size);
+}
+
+static bool
+property_equals(const LilvState* a_state,
+                const Property*  a,
+                const LilvState* b_state,
+                const Property*  b)
+{
+	if (a->type != b->type || a->flags != b->flags) {
+		return false;
+	} else if (a->type == a_state->atom_Path) {
+		return lilv_file_equals(lilv_state_rel2abs(a_state, (char*)a->value),
+		                        lilv_state_rel2abs(b_state, (char*)b->value));
+	}
+	return a->size == b->size && !memcmp(a->value, b->value, a->size);
+}
+
+/**
+   Get the differences from `base` to `state` to write as a delta.
+
+   Both states are sorted, so this merges them in a single pass.  The
+   returned arrays refer to the values of `state` and must be freed.
+*/
+static BinaryContents
+lilv_state_diff(const LilvState* base, const LilvState* state)
+{
+	BinaryContents delta = { NULL, NULL, 0, 0, NULL, NULL, NULL };
+	PortValue*     values = (PortValue*)malloc(
+		(base->n_values + state->n_values + 1) * sizeof(PortValue));
+	Property*      props  = (Property*)malloc(
+		(base->n_props + state->n_props + 1) * sizeof(Property));
+
+	for (uint32_t i = 0, j = 0; i < base->n_values || j < state->n_values;) {
+		const PortValue* const bv  = &base->values[i];
+		const PortValue* const sv  = &state->values[j];
+		const int              cmp = (i == base->n_values) ? 1
+			: (j == state->n_values) ? -1
+			: strcmp(bv->symbol, sv->symbol);
+		if (cmp < 0) {
+			const PortValue removed = { bv->symbol, NULL, 0, 0 };
+			values[delta.n_values++] = removed;
+			++i;
+		} else if (cmp > 0) {
+			values[delta.n_values++] = *sv;
+			++j;
+		} else {
+			if (!port_value_equals(bv, sv)) {
+				values[delta.n_values++] = *sv;
+			}
+			++i;
+			++j;
+		}
+	}
+
+	for (uint32_t i = 0, j = 0; i < base->n_props || j < state->n_props;) {
+		const Property* const bp  = &base->props[i];
+		const Property* const sp  = &state->props[j];
+		const int             cmp = (i == base->n_props) ? 1
+			: (j == state->n_props) ? -1
+			: (bp->key < sp->key) ? -1
+			: (bp->key > sp->key) ? 1 : 0;
+		if (cmp < 0) {
+			const Property removed = { NULL, 0, bp->key, 0, 0 };
+			props[delta.n_props++] = removed;
+			++i;
+		} else if (cmp > 0) {
+			props[delta.n_props++] = *sp;
+			++j;
+		} else {
+			if (!property_equals(base, bp, state, sp)) {
+				props[delta.n_props++] = *sp;
+			}
+			++i;
+			++j;
+		}
+	}
+
+	delta.values = values;
+	delta.props  = props;
+	return delta;
+}
+
+static bool
+has_binary_extension(const char* filename)
+{
+	const size_t len     = strlen(filename);
+	const size_t ext_len = strlen(LILV_STATE_BINARY_EXTENSION);
+	return len >= ext_len && !strcmp(filename + len - ext_len,
+	                                 LILV_STATE_BINARY_EXTENSION);
+}
+
 static void
 lilv_state_make_links(const LilvState* state, const char* dir)
 {
+	if (!state->abs2rel) {
+		return;  // Loaded state, paths are already in the state directory
+	}
+
 	// Create symlinks to files
 	for (ZixTreeIter* i = zix_tree_begin(state->abs2rel);
 	     i != zix_tree_end(state->abs2rel);
@@ -1016,59 +1823,246 @@ lilv_state_make_links(const LilvState* state, const char* dir)
 	}
 }
 
-LILV_API int
-lilv_state_save(LilvWorld*       world,
-                LV2_URID_Map*    map,
-                LV2_URID_Unmap*  unmap,
-                const LilvState* state,
-                const char*      uri,
-                const char*      dir,
-                const char*      filename)
+/**
+   Write a state file without adding it to the manifest.
+
+   If `delta` is given, it is written as a binary delta regardless of the
+   file name.
+*/
+static int
+lilv_state_write_file(LilvWorld*            world,
+                      LV2_URID_Map*         map,
+                      LV2_URID_Unmap*       unmap,
+                      const LilvState*      state,
+                      const BinaryContents* delta,
+                      const char*           uri,
+                      const char*           dir,
+                      const char*           filename)
 {
 	if (!filename || !dir || lilv_mkdir_p(dir)) {
 		return 1;
 	}
 
-	char*       abs_dir = absolute_dir(dir);
-	char* const path    = lilv_path_join(abs_dir, filename);
-	FILE*       fd      = fopen(path, "w");
+	// Write to a temporary file so a crash never leaves a partial state file
+	char*       abs_dir  = absolute_dir(dir);
+	char* const path     = lilv_path_join(abs_dir, filename);
+	char* const tmp_path = lilv_strjoin(path, ".tmp", NULL);
+	FILE*       fd       = fopen(tmp_path, "w");
 	if (!fd) {
-		LILV_ERRORF("Failed to open %s (%s)\n", path, strerror(errno));
+		LILV_ERRORF("Failed to open %s (%s)\n", tmp_path, strerror(errno));
 		free(abs_dir);
 		free(path);
+		free(tmp_path);
 		return 4;
 	}
 
 	// Create symlinks to files if necessary
 	lilv_state_make_links(state, abs_dir);
 
-	// Write state to Turtle file
-	SerdNode    file = serd_node_new_file_uri(USTR(path), NULL, NULL, false);
-	SerdNode    node = uri ? serd_node_from_string(SERD_URI, USTR(uri)) : file;
-	SerdEnv*    env  = NULL;
-	SerdWriter* ttl  = ttl_file_writer(fd, &file, &env);
-	int         ret  = lilv_state_write(
-		world, map, unmap, state, ttl, (const char*)node.buf, dir);
+	int ret = 0;
+	if (delta) {
+		ret = lilv_state_write_binary(unmap, state, delta, fd, uri);
+	} else if (has_binary_extension(filename)) {
+		// Write state to binary file, which is not listed in the manifest
+		const BinaryContents contents = {
+			state->values, state->props, state->n_values, state->n_props,
+			NULL, NULL, NULL };
+		ret = lilv_state_write_binary(unmap, state, &contents, fd, uri);
+	} else {
+		// Write state to Turtle file
+		SerdNode    file = serd_node_new_file_uri(USTR(path), NULL, NULL, false);
+		SerdNode    node = uri ? serd_node_from_string(SERD_URI, USTR(uri)) : file;
+		SerdEnv*    env  = NULL;
+		SerdWriter* ttl  = ttl_file_writer(fd, &file, &env);
+		ret = lilv_state_write(
+			world, map, unmap, state, ttl, (const char*)node.buf, dir);
+
+		serd_node_free(&file);
+		serd_writer_free(ttl);
+		serd_env_free(env);
+	}
+
+	// Replace the state file only once the new one is complete
+	if (fclose(fd) || ret) {
+		LILV_ERRORF("Failed to write %s\n", tmp_path);
+		remove(tmp_path);
+		ret = ret ? ret : 5;
+	} else if (lilv_replace_file(tmp_path, path)) {
+		LILV_ERRORF("Failed to rename %s to %s\n", tmp_path, path);
+		remove(tmp_path);
+		ret = 5;
+	}
+
+	free(abs_dir);
+	free(path);
+	free(tmp_path);
+	return ret;
+}
+
+int
+lilv_state_save_file(LilvWorld*       world,
+                     LV2_URID_Map*    map,
+                     LV2_URID_Unmap*  unmap,
+                     const LilvState* state,
+                     const char*      uri,
+                     const char*      dir,
+                     const char*      filename)
+{
+	const int ret = lilv_state_write_file(
+		world, map, unmap, state, NULL, uri, dir, filename);
+	if (!ret && !has_binary_extension(filename)) {
+		// Add entry to manifest
+		char* const         abs_dir  = absolute_dir(dir);
+		char* const         path     = lilv_path_join(abs_dir, filename);
+		char* const         manifest = lilv_path_join(abs_dir, "manifest.ttl");
+		const ManifestEntry entry    = { state->plugin_uri, uri, path };
+		add_states_to_manifest(world, manifest, 1, &entry);
+		free(manifest);
+		free(path);
+		free(abs_dir);
+	}
+	return ret;
+}
 
-	// Set saved dir and uri (FIXME: const violation)
+/** Set the directory and URI of a state after it is saved. */
+static void
+set_saved(LilvWorld*       world,
+          const LilvState* state,
+          const char*      uri,
+          const char*      dir,
+          const char*      filename)
+{
+	char*       abs_dir = absolute_dir(dir);
+	char* const path    = lilv_path_join(abs_dir, filename);
+
+	// FIXME: const violation
+	SerdNode file    = serd_node_new_file_uri(USTR(path), NULL, NULL, false);
 	SerdNode dir_uri = serd_node_new_file_uri(USTR(abs_dir), NULL, NULL, false);
 	free(state->dir);
 	lilv_node_free(state->uri);
 	((LilvState*)state)->dir = (char*)dir_uri.buf;
-	((LilvState*)state)->uri = lilv_new_uri(world, (const char*)node.buf);
+	((LilvState*)state)->uri = lilv_new_uri(
+		world, uri ? uri : (const char*)file.buf);
 
 	serd_node_free(&file);
-	serd_writer_free(ttl);
-	serd_env_free(env);
-	fclose(fd);
+	free(abs_dir);
+	free(path);
+}
+
+LILV_API int
+lilv_state_save(LilvWorld*       world,
+                LV2_URID_Map*    map,
+                LV2_URID_Unmap*  unmap,
+                const LilvState* state,
+                const char*      uri,
+                const char*      dir,
+                const char*      filename)
+{
+	const int ret = lilv_state_save_file(
+		world, map, unmap, state, uri, dir, filename);
+	if (!ret) {
+		set_saved(world, state, uri, dir, filename);
+	}
+	return ret;
+}
 
-	// Add entry to manifest
-	char* const manifest = lilv_path_join(abs_dir, "manifest.ttl");
-	add_state_to_manifest(world, state->plugin_uri, manifest, uri, path);
+LILV_API int
+lilv_state_save_batch(LilvWorld*              world,
+                      LV2_URID_Map*           map,
+                      LV2_URID_Unmap*         unmap,
+                      unsigned                n_states,
+                      const LilvState* const* states,
+                      const char* const*      uris,
+                      const char*             dir,
+                      const char* const*      filenames)
+{
+	if (!dir) {
+		return 1;
+	}
 
-	free(manifest);
+	char* const    abs_dir   = absolute_dir(dir);
+	char** const   paths     = (char**)calloc(n_states, sizeof(char*));
+	ManifestEntry* entries   = (ManifestEntry*)calloc(
+		n_states, sizeof(ManifestEntry));
+	unsigned       n_entries = 0;
+	int            ret       = 0;
+	for (unsigned i = 0; i < n_states; ++i) {
+		const char* const uri = uris ? uris[i] : NULL;
+		const int         st  = lilv_state_write_file(
+			world, map, unmap, states[i], NULL, uri, dir, filenames[i]);
+		if (st) {
+			ret = ret ? ret : st;
+			continue;
+		}
+
+		paths[i] = lilv_path_join(abs_dir, filenames[i]);
+		if (!has_binary_extension(filenames[i])) {
+			const ManifestEntry entry = { states[i]->plugin_uri, uri, paths[i] };
+			entries[n_entries++] = entry;
+		}
+	}
+
+	// Add entries for all saved states to manifest at once
+	if (n_entries) {
+		char* const manifest = lilv_path_join(abs_dir, "manifest.ttl");
+		add_states_to_manifest(world, manifest, n_entries, entries);
+		free(manifest);
+	}
+
+	for (unsigned i = 0; i < n_states; ++i) {
+		if (paths[i]) {
+			set_saved(world, states[i], uris ? uris[i] : NULL,
+			          dir, filenames[i]);
+			free(paths[i]);
+		}
+	}
+
+	free(entries);
+	free(paths);
 	free(abs_dir);
-	free(path);
+	return ret;
+}
+
+LILV_API int
+lilv_state_save_delta(LilvWorld*       world,
+                      LV2_URID_Map*    map,
+                      LV2_URID_Unmap*  unmap,
+                      const LilvState* base,
+                      const char*      base_filename,
+                      const LilvState* state,
+                      const char*      uri,
+                      const char*      dir,
+                      const char*      filename)
+{
+	if (!base_filename || !lilv_node_equals(base->plugin_uri,
+	                                        state->plugin_uri)) {
+		LILV_ERROR("Delta base must be a saved state of the same plugin\n");
+		return 1;
+	}
+
+	// Record the ID of the base file, so a changed base is detected
+	char        base_id[65];
+	char* const base_path = delta_base_path(dir, base_filename);
+	if (delta_base_id(base_path, base_id)) {
+		LILV_ERRORF("Failed to read delta base %s\n", base_path);
+		free(base_path);
+		return 1;
+	}
+	free(base_path);
+
+	BinaryContents delta = lilv_state_diff(base, state);
+	delta.base_path = base_filename;
+	delta.base_uri  = base->uri ? lilv_node_as_string(base->uri) : NULL;
+	delta.base_id   = base_id;
+
+	const int ret = lilv_state_write_file(
+		world, map, unmap, state, &delta, uri, dir, filename);
+	if (!ret) {
+		set_saved(world, state, uri, dir, filename);
+	}
+
+	free((void*)delta.values);
+	free((void*)delta.props);
 	return ret;
 }
 
@@ -1170,19 +2164,17 @@ LILV_API void
 lilv_state_free(LilvState* state)
 {
 	if (state) {
-		for (uint32_t i = 0; i < state->n_props; ++i) {
-			free(state->props[i].value);
-		}
-		for (uint32_t i = 0; i < state->n_values; ++i) {
-			free(state->values[i].value);
-			free(state->values[i].symbol);
+		for (StateBlock* b = state->arena; b;) {
+			StateBlock* const prev = b->prev;
+			free(b);
+			b = prev;
 		}
+		free(state->props);
+		free(state->values);
 		lilv_node_free(state->plugin_uri);
 		lilv_node_free(state->uri);
 		zix_tree_free(state->abs2rel);
 		zix_tree_free(state->rel2abs);
-		free(state->props);
-		free(state->values);
 		free(state->label);
 		free(state->dir);
 		free(state->file_dir);
@@ -1192,6 +2184,41 @@ lilv_state_free(LilvState* state)
 	}
 }
 
+LILV_API void
+lilv_state_get_hash(const LilvState* state, uint8_t* hash)
+{
+	LilvSha256  sha;
+	const char* plugin_uri = (state->plugin_uri)
+		? lilv_node_as_string(state->plugin_uri) : "";
+	lilv_sha256_init(&sha);
+	hash_bytes(&sha, plugin_uri, strlen(plugin_uri));
+	hash_u32(&sha, state->label ? 1 : 0);
+	if (state->label) {
+		hash_bytes(&sha, state->label, strlen(state->label));
+	}
+	hash_bytes(&sha, state->hash, LILV_STATE_HASH_SIZE);
+
+	// Hash file contents, or the path if the file can not be read
+	for (uint32_t i = 0; i < state->n_props && state->n_paths; ++i) {
+		const Property* const p = &state->props[i];
+		if (p->type == state->atom_Path) {
+			const char* path = lilv_state_rel2abs(state, (const char*)p->value);
+			char        file_hash[65];
+			if (!lilv_file_sha256(path, file_hash)) {
+				hash_u32(&sha, 1);
+				hash_bytes(&sha, file_hash, 64);
+			} else {
+				hash_u32(&sha, 0);
+				hash_bytes(&sha, path, strlen(path));
+			}
+		}
+	}
+
+	uint8_t digest[32];
+	lilv_sha256_finish(&sha, digest);
+	memcpy(hash, digest, LILV_STATE_HASH_SIZE);
+}
+
 LILV_API bool
 lilv_state_equals(const LilvState* a, const LilvState* b)
 {
@@ -1200,34 +2227,15 @@ lilv_state_equals(const LilvState* a, const LilvState* b)
 	    || (b->label && !a->label)
 	    || (a->label && b->label && strcmp(a->label, b->label))
 	    || a->n_props != b->n_props
-	    || a->n_values != b->n_values) {
+	    || a->n_values != b->n_values
+	    || memcmp(a->hash, b->hash, LILV_STATE_HASH_SIZE)) {
 		return false;
 	}
 
-	for (uint32_t i = 0; i < a->n_values; ++i) {
-		PortValue* const av = &a->values[i];
-		PortValue* const bv = &b->values[i];
-		if (av->size != bv->size || av->type != bv->type
-		    || strcmp(av->symbol, bv->symbol)
-		    || memcmp(av->value, bv->value, av->size)) {
-			return false;
-		}
-	}
-
-	for (uint32_t i = 0; i < a->n_props; ++i) {
-		Property* const ap = &a->props[i];
-		Property* const bp = &b->props[i];
-		if (ap->key != bp->key
-		    || ap->type != bp->type
-		    || ap->flags != bp->flags) {
-			return false;
-		} else if (ap->type == a->atom_Path) {
-			if (!lilv_file_equals(lilv_state_rel2abs(a, (char*)ap->value),
-			                      lilv_state_rel2abs(b, (char*)bp->value))) {
-				return false;
-			}
-		} else if (ap->size != bp->size
-		           || memcmp(ap->value, bp->value, ap->size)) {
+	// Only the contents of files are not covered by the hash
+	for (uint32_t i = 0; i < a->n_props && a->n_paths; ++i) {
+		if (a->props[i].type == a->atom_Path
+		    && !property_equals(a, &a->props[i], b, &b->props[i])) {
 			return false;
 		}
 	}
@@ -0,0 +1,217 @@
+/*
+  Copyright 2016 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lilv_internal.h"
+
+typedef struct SaveJob {
+	struct SaveJob*    next;
+	LilvState*         state;      ///< State to save, owned by the job
+	char*              uri;        ///< State URI, or NULL
+	char*              dir;        ///< Bundle directory
+	char*              filename;   ///< State file name relative to dir
+	char*              path;       ///< Absolute path of state file
+	LilvStateSavedFunc func;       ///< Completion callback, or NULL
+	void*              user_data;  ///< Data for func
+	int                status;     ///< Result of save, or -1 if superseded
+} SaveJob;
+
+struct LilvStateSaverImpl {
+	LilvWorld*      world;    ///< Private world used only by the thread
+	LV2_URID_Map*   map;
+	LV2_URID_Unmap* unmap;
+	ZixThread       thread;
+	ZixMutex        mutex;    ///< Protects pending and done
+	ZixSem          sem;      ///< Posted once for every queued job
+	SaveJob*        pending;  ///< Jobs waiting to be saved, in order
+	SaveJob*        done;     ///< Finished jobs, in reverse order
+	bool            exit;
+};
+
+static void
+save_job_free(SaveJob* job)
+{
+	lilv_state_free(job->state);
+	free(job->uri);
+	free(job->dir);
+	free(job->filename);
+	free(job->path);
+	free(job);
+}
+
+/** Return true iff `a` and `b` save the same state, so `a` is redundant. */
+static bool
+save_job_matches(const SaveJob* a, const SaveJob* b)
+{
+	if (a->uri || b->uri) {
+		return a->uri && b->uri && !strcmp(a->uri, b->uri);
+	}
+	return !strcmp(a->path, b->path);
+}
+
+static void*
+lilv_state_saver_thread(void* data)
+{
+	LilvStateSaver* const saver = (LilvStateSaver*)data;
+	while (!zix_sem_wait(&saver->sem)) {
+		zix_mutex_lock(&saver->mutex);
+		SaveJob* const job  = saver->pending;
+		const bool     exit = saver->exit;
+		if (job) {
+			saver->pending = job->next;
+		}
+		zix_mutex_unlock(&saver->mutex);
+
+		if (!job) {
+			if (exit) {
+				break;
+			}
+			continue;  // Job was superseded after being queued
+		}
+
+		job->status = lilv_state_save_file(
+			saver->world, saver->map, saver->unmap,
+			job->state, job->uri, job->dir, job->filename);
+
+		zix_mutex_lock(&saver->mutex);
+		job->next   = saver->done;
+		saver->done = job;
+		zix_mutex_unlock(&saver->mutex);
+	}
+	return NULL;
+}
+
+LILV_API LilvStateSaver*
+lilv_state_saver_new(LV2_URID_Map* map, LV2_URID_Unmap* unmap)
+{
+	LilvStateSaver* saver = (LilvStateSaver*)calloc(1, sizeof(LilvStateSaver));
+	saver->world = lilv_world_new();
+	saver->map   = map;
+	saver->unmap = unmap;
+	zix_mutex_init(&saver->mutex);
+	zix_sem_init(&saver->sem, 0);
+	if (zix_thread_create(&saver->thread, 0, lilv_state_saver_thread, saver)) {
+		LILV_ERROR("Failed to create state saver thread\n");
+		zix_sem_destroy(&saver->sem);
+		zix_mutex_destroy(&saver->mutex);
+		lilv_world_free(saver->world);
+		free(saver);
+		return NULL;
+	}
+	return saver;
+}
+
+LILV_API void
+lilv_state_saver_free(LilvStateSaver* saver)
+{
+	if (!saver) {
+		return;
+	}
+
+	// Finish every queued save
+	zix_mutex_lock(&saver->mutex);
+	saver->exit = true;
+	zix_mutex_unlock(&saver->mutex);
+	zix_sem_post(&saver->sem);
+	zix_thread_join(saver->thread, NULL);
+
+	lilv_state_saver_dispatch(saver);
+
+	zix_sem_destroy(&saver->sem);
+	zix_mutex_destroy(&saver->mutex);
+	lilv_world_free(saver->world);
+	free(saver);
+}
+
+LILV_API int
+lilv_state_saver_save(LilvStateSaver*    saver,
+                      LilvState*         state,
+                      const char*        uri,
+                      const char*        dir,
+                      const char*        filename,
+                      LilvStateSavedFunc func,
+                      void*              user_data)
+{
+	if (!state || !dir || !filename) {
+		lilv_state_free(state);
+		return 1;
+	}
+
+	char*    abs_dir = lilv_path_absolute(dir);
+	SaveJob* job     = (SaveJob*)calloc(1, sizeof(SaveJob));
+	job->state     = state;
+	job->uri       = lilv_strdup(uri);
+	job->dir       = lilv_strdup(dir);
+	job->filename  = lilv_strdup(filename);
+	job->path      = lilv_path_join(abs_dir, filename);
+	job->func      = func;
+	job->user_data = user_data;
+	free(abs_dir);
+
+	zix_mutex_lock(&saver->mutex);
+
+	// Replace a queued save of the same state, which has not started yet
+	SaveJob** tail = &saver->pending;
+	for (; *tail; tail = &(*tail)->next) {
+		if (save_job_matches(*tail, job)) {
+			SaveJob* const old = *tail;
+			job->next   = old->next;
+			*tail       = job;
+			old->status = -1;
+			old->next   = saver->done;
+			saver->done = old;
+			zix_mutex_unlock(&saver->mutex);
+			return 0;
+		}
+	}
+
+	*tail = job;
+	zix_mutex_unlock(&saver->mutex);
+	zix_sem_post(&saver->sem);
+	return 0;
+}
+
+LILV_API unsigned
+lilv_state_saver_dispatch(LilvStateSaver* saver)
+{
+	zix_mutex_lock(&saver->mutex);
+	SaveJob* done = saver->done;
+	saver->done = NULL;
+	zix_mutex_unlock(&saver->mutex);
+
+	// Reverse to call callbacks in the order that jobs finished
+	SaveJob* ordered = NULL;
+	while (done) {
+		SaveJob* const next = done->next;
+		done->next = ordered;
+		ordered    = done;
+		done       = next;
+	}
+
+	unsigned n_done = 0;
+	while (ordered) {
+		SaveJob* const next = ordered->next;
+		if (ordered->func) {
+			ordered->func(ordered->path, ordered->status, ordered->user_data);
+		}
+		save_job_free(ordered);
+		ordered = next;
+		++n_done;
+	}
+	return n_done;
+}
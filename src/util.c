@@ -60,10 +60,26 @@ CreateSymbolicLink(LPCTSTR linkpath, LPCTSTR targetpath, DWORD flags)
 #    include <sys/file.h>
 #endif
 
-#ifndef PAGE_SIZE
-#   define PAGE_SIZE 4096
+#ifndef _WIN32
+#    include <fcntl.h>
 #endif
 
+#ifdef HAVE_MMAP
+#    include <sys/mman.h>
+#endif
+
+#ifdef __linux__
+#    include <linux/fs.h>
+#    include <sys/ioctl.h>
+#endif
+
+#ifdef HAVE_SENDFILE
+#    include <sys/sendfile.h>
+#endif
+
+/** Size of blocks for copying and comparing files. */
+#define LILV_IO_BLOCK_SIZE (1 << 18)
+
 void
 lilv_free(void* ptr)
 {
@@ -128,35 +144,34 @@ lilv_file_uri_parse(const char* uri, char** hostname)
 	return (char*)serd_file_uri_parse((const uint8_t*)uri, (uint8_t**)hostname);
 }
 
-/** Return the current LANG converted to Turtle (i.e. RFC3066) style.
- * For example, if LANG is set to "en_CA.utf-8", this returns "en-ca".
+/** Return a LANG style language converted to Turtle (i.e. RFC3066) style.
+ * For example, "en_CA.utf-8" returns "en-ca".
  */
 char*
-lilv_get_lang(void)
+lilv_parse_lang(const char* str)
 {
-	const char* const env_lang = getenv("LANG");
-	if (!env_lang || !strcmp(env_lang, "")
-	    || !strcmp(env_lang, "C") || !strcmp(env_lang, "POSIX")) {
+	if (!str || !strcmp(str, "")
+	    || !strcmp(str, "C") || !strcmp(str, "POSIX")) {
 		return NULL;
 	}
 
-	const size_t env_lang_len = strlen(env_lang);
-	char* const  lang         = (char*)malloc(env_lang_len + 1);
-	for (size_t i = 0; i < env_lang_len + 1; ++i) {
-		if (env_lang[i] == '_') {
+	const size_t len  = strlen(str);
+	char* const  lang = (char*)malloc(len + 1);
+	for (size_t i = 0; i < len + 1; ++i) {
+		if (str[i] == '_') {
 			lang[i] = '-';  // Convert _ to -
-		} else if (env_lang[i] >= 'A' && env_lang[i] <= 'Z') {
-			lang[i] = env_lang[i] + ('a' - 'A');  // Convert to lowercase
-		} else if (env_lang[i] >= 'a' && env_lang[i] <= 'z') {
-			lang[i] = env_lang[i];  // Lowercase letter, copy verbatim
-		} else if (env_lang[i] >= '0' && env_lang[i] <= '9') {
-			lang[i] = env_lang[i];  // Digit, copy verbatim
-		} else if (env_lang[i] == '\0' || env_lang[i] == '.') {
+		} else if (str[i] >= 'A' && str[i] <= 'Z') {
+			lang[i] = str[i] + ('a' - 'A');  // Convert to lowercase
+		} else if (str[i] >= 'a' && str[i] <= 'z') {
+			lang[i] = str[i];  // Lowercase letter, copy verbatim
+		} else if (str[i] >= '0' && str[i] <= '9') {
+			lang[i] = str[i];  // Digit, copy verbatim
+		} else if (str[i] == '\0' || str[i] == '.') {
 			// End, or start of suffix (e.g. en_CA.utf-8), finished
 			lang[i] = '\0';
 			break;
 		} else {
-			LILV_ERRORF("Illegal LANG `%s' ignored\n", env_lang);
+			LILV_ERRORF("Illegal language `%s' ignored\n", str);
 			free(lang);
 			return NULL;
 		}
@@ -289,21 +304,24 @@ lilv_find_free_path(const char* in_path,
 int
 lilv_copy_file(const char* src, const char* dst)
 {
-	FILE* in = fopen(src, "r");
+#ifdef _WIN32
+	FILE* in = fopen(src, "rb");
 	if (!in) {
 		return errno;
 	}
 
-	FILE* out = fopen(dst, "w");
+	FILE* out = fopen(dst, "wb");
 	if (!out) {
-		return errno;
+		const int st = errno;
+		fclose(in);
+		return st;
 	}
 
-	char*  page   = (char*)malloc(PAGE_SIZE);
+	char*  block  = (char*)malloc(LILV_IO_BLOCK_SIZE);
 	size_t n_read = 0;
 	int    st     = 0;
-	while ((n_read = fread(page, 1, PAGE_SIZE, in)) > 0) {
-		if (fwrite(page, 1, n_read, out) != n_read) {
+	while ((n_read = fread(block, 1, LILV_IO_BLOCK_SIZE, in)) > 0) {
+		if (fwrite(block, 1, n_read, out) != n_read) {
 			st = errno;
 			break;
 		}
@@ -313,11 +331,92 @@ lilv_copy_file(const char* src, const char* dst)
 		st = EBADF;
 	}
 
-	free(page);
+	free(block);
 	fclose(in);
-	fclose(out);
+	if (fclose(out) && !st) {
+		st = errno;
+	}
+	return st;
+#else
+	const int in = open(src, O_RDONLY);
+	if (in < 0) {
+		return errno;
+	}
+
+	struct stat buf;
+	const int   out = open(dst, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+	if (out < 0 || fstat(in, &buf)) {
+		const int st = errno;
+		if (out >= 0) {
+			close(out);
+		}
+		close(in);
+		return st;
+	}
+
+	int   st        = 0;
+	off_t remaining = buf.st_size;
+#ifdef HAVE_SENDFILE
+	// Copy in the kernel, which may fail for some file systems
+	while (remaining > 0) {
+		const ssize_t n = sendfile(out, in, NULL, remaining);
+		if (n <= 0) {
+			break;
+		}
+		remaining -= n;
+	}
+#endif
+
+	// Copy the rest (normally everything if sendfile is unavailable)
+	if (remaining > 0) {
+		char* const block = (char*)malloc(LILV_IO_BLOCK_SIZE);
+		ssize_t     n     = 0;
+		while ((n = read(in, block, LILV_IO_BLOCK_SIZE)) > 0) {
+			for (ssize_t written = 0; written < n;) {
+				const ssize_t w = write(out, block + written, n - written);
+				if (w < 0) {
+					st = errno;
+					break;
+				}
+				written += w;
+			}
+			if (st) {
+				break;
+			}
+		}
+		if (n < 0 && !st) {
+			st = errno;
+		}
+		free(block);
+	}
 
+	close(in);
+	if (close(out) && !st) {
+		st = errno;
+	}
 	return st;
+#endif
+}
+
+int
+lilv_clone_file(const char* src, const char* dst)
+{
+#ifdef FICLONE
+	// Try to make a copy-on-write clone which shares storage with src
+	const int in = open(src, O_RDONLY);
+	if (in >= 0) {
+		const int out = open(dst, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+		const int st  = (out >= 0) ? ioctl(out, FICLONE, in) : -1;
+		if (out >= 0) {
+			close(out);
+		}
+		close(in);
+		if (!st) {
+			return 0;
+		}
+	}
+#endif
+	return lilv_copy_file(src, dst);
 }
 
 bool
@@ -370,65 +469,6 @@ lilv_path_join(const char* a, const char* b)
 	return path;
 }
 
-static void
-lilv_size_mtime(const char* path, off_t* size, time_t* time)
-{
-	struct stat buf;
-	if (stat(path, &buf)) {
-		LILV_ERRORF("stat(%s) (%s)\n", path, strerror(errno));
-		return;
-	}
-
-	if (size) {
-		*size = buf.st_size;
-	}
-	if (time) {
-		*time = buf.st_mtime;
-	}
-}
-
-typedef struct {
-	char*  pattern;
-	off_t  orig_size;
-	time_t time;
-	char*  latest;
-} Latest;
-
-static void
-update_latest(const char* path, const char* name, void* data)
-{
-	Latest* latest     = (Latest*)data;
-	char*   entry_path = lilv_path_join(path, name);
-	unsigned num;
-	if (sscanf(entry_path, latest->pattern, &num) == 1) {
-		off_t  entry_size = 0;
-		time_t entry_time = 0;
-		lilv_size_mtime(entry_path, &entry_size, &entry_time);
-		if (entry_size == latest->orig_size && entry_time >= latest->time) {
-			free(latest->latest);
-			latest->latest = entry_path;
-		}
-	}
-	if (entry_path != latest->latest) {
-		free(entry_path);
-	}
-}
-
-/** Return the latest copy of the file at `path` that is newer. */
-char*
-lilv_get_latest_copy(const char* path, const char* copy_path)
-{
-	char*  copy_dir = lilv_dirname(copy_path);
-	Latest latest   = { lilv_strjoin(copy_path, "%u", NULL), 0, 0, NULL };
-	lilv_size_mtime(path, &latest.orig_size, &latest.time);
-
-	lilv_dir_for_each(copy_dir, &latest, update_latest);
-
-	free(latest.pattern);
-	free(copy_dir);
-	return latest.latest;
-}
-
 char*
 lilv_realpath(const char* path)
 {
@@ -589,7 +629,7 @@ lilv_mkdir_p(const char* dir_path)
 	return 0;
 }
 
-static off_t
+size_t
 lilv_file_size(const char* path)
 {
 	struct stat buf;
@@ -597,7 +637,110 @@ lilv_file_size(const char* path)
 		LILV_ERRORF("stat(%s) (%s)\n", path, strerror(errno));
 		return 0;
 	}
-	return buf.st_size;
+	return (size_t)buf.st_size;
+}
+
+int
+lilv_replace_file(const char* src, const char* dst)
+{
+#ifdef _WIN32
+	return MoveFileEx(src, dst, MOVEFILE_REPLACE_EXISTING) ? 0 : EIO;
+#else
+	return rename(src, dst) ? errno : 0;
+#endif
+}
+
+unsigned
+lilv_num_processors(void)
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+	const long n = sysconf(_SC_NPROCESSORS_ONLN);
+	return n > 0 ? (unsigned)n : 1;
+#else
+	return 1;
+#endif
+}
+
+void*
+lilv_map_file(const char* path, size_t* size)
+{
+	*size = 0;
+#ifdef HAVE_MMAP
+	const int fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		return NULL;
+	}
+
+	struct stat buf;
+	void*       data = NULL;
+	if (!fstat(fd, &buf) && buf.st_size > 0) {
+		data = mmap(NULL, (size_t)buf.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data == MAP_FAILED) {
+			data = NULL;
+		} else {
+			*size = (size_t)buf.st_size;
+		}
+	}
+	close(fd);
+	return data;
+#else
+	FILE* fd = fopen(path, "rb");
+	if (!fd) {
+		return NULL;
+	}
+
+	void* data = NULL;
+	if (!fseek(fd, 0, SEEK_END)) {
+		const long len = ftell(fd);
+		if (len > 0 && !fseek(fd, 0, SEEK_SET)) {
+			data = malloc((size_t)len);
+			if (fread(data, 1, (size_t)len, fd) == (size_t)len) {
+				*size = (size_t)len;
+			} else {
+				free(data);
+				data = NULL;
+			}
+		}
+	}
+	fclose(fd);
+	return data;
+#endif
+}
+
+void
+lilv_unmap_file(void* data, size_t size)
+{
+#ifdef HAVE_MMAP
+	if (data) {
+		munmap(data, size);
+	}
+#else
+	free(data);
+#endif
+}
+
+/** Compare the contents of two open files of the same size. */
+static bool
+lilv_stream_equals(FILE* a_file, FILE* b_file)
+{
+	char* const a_block = (char*)malloc(LILV_IO_BLOCK_SIZE);
+	char* const b_block = (char*)malloc(LILV_IO_BLOCK_SIZE);
+	bool        match   = true;
+	size_t      n_read  = 0;
+	while (match &&
+	       (n_read = fread(a_block, 1, LILV_IO_BLOCK_SIZE, a_file)) > 0) {
+		match = (fread(b_block, 1, n_read, b_file) == n_read &&
+		         !memcmp(a_block, b_block, n_read));
+	}
+
+	match = match && !ferror(a_file) && fgetc(b_file) == EOF;
+	free(a_block);
+	free(b_block);
+	return match;
 }
 
 bool
@@ -607,39 +750,57 @@ lilv_file_equals(const char* a_path, const char* b_path)
 		return true;  // Paths match
 	}
 
-	bool        match  = false;
-	FILE*       a_file = NULL;
-	FILE*       b_file = NULL;
+	struct stat a_stat;
+	struct stat b_stat;
+	if (stat(a_path, &a_stat) || stat(b_path, &b_stat)) {
+		return false;  // Missing file matches nothing
+	} else if (a_stat.st_size != b_stat.st_size) {
+		return false;  // Sizes differ
+	} else if (a_stat.st_size == 0) {
+		return true;  // Both empty
+	}
+
+#ifdef _WIN32
 	char* const a_real = lilv_realpath(a_path);
 	char* const b_real = lilv_realpath(b_path);
-	if (!a_real || !b_real) {
-		match = false;  // Missing file matches nothing
-	} else if (!strcmp(a_real, b_real)) {
-		match = true;  // Real paths match
-	} else if (lilv_file_size(a_path) != lilv_file_size(b_path)) {
-		match = false;  // Sizes differ
-	} else if (!(a_file = fopen(a_real, "rb"))) {
-		match = false;  // Missing file matches nothing
-	} else if (!(b_file = fopen(b_real, "rb"))) {
-		match = false;  // Missing file matches nothing
-	} else {
-		match = true;
-		// TODO: Improve performance by reading chunks
-		while (!feof(a_file) && !feof(b_file)) {
-			if (fgetc(a_file) != fgetc(b_file)) {
-				match = false;
-				break;
-			}
-		}
+	const bool  same   = !strcmp(a_real, b_real);
+	free(a_real);
+	free(b_real);
+	if (same) {
+		return true;  // Real paths match
 	}
+#else
+	if (a_stat.st_dev == b_stat.st_dev && a_stat.st_ino == b_stat.st_ino) {
+		return true;  // Same file (links or the same path)
+	}
+#endif
+
+	bool match = false;
+#ifdef HAVE_MMAP
+	// Compare mapped files if possible, which avoids copying into buffers
+	size_t a_size = 0;
+	size_t b_size = 0;
+	void*  a_data = lilv_map_file(a_path, &a_size);
+	void*  b_data = a_data ? lilv_map_file(b_path, &b_size) : NULL;
+	if (a_data && b_data) {
+		match = a_size == b_size && !memcmp(a_data, b_data, a_size);
+		lilv_unmap_file(a_data, a_size);
+		lilv_unmap_file(b_data, b_size);
+		return match;
+	}
+	lilv_unmap_file(a_data, a_size);
+#endif
 
+	FILE* a_file = fopen(a_path, "rb");
+	FILE* b_file = a_file ? fopen(b_path, "rb") : NULL;
+	if (a_file && b_file) {
+		match = lilv_stream_equals(a_file, b_file);
+	}
 	if (a_file) {
 		fclose(a_file);
 	}
 	if (b_file) {
 		fclose(b_file);
 	}
-	free(a_real);
-	free(b_real);
 	return match;
 }
@@ -0,0 +1,335 @@
+/*
+  Copyright 2016 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "lv2/lv2plug.in/ns/ext/worker/worker.h"
+
+#include "lilv_internal.h"
+
+#define LILV_WORKER_RING_SIZE 8192
+
+/** Threads shared by every worker in a world. */
+struct LilvWorkerPoolImpl {
+	ZixThread*   threads;
+	unsigned     n_threads;
+	LilvWorker** workers;
+	unsigned     n_workers;
+	ZixMutex     mutex;      ///< Protects workers and their busy flags
+	ZixSem       sem;        ///< Posted whenever work is scheduled
+	bool         exit;
+};
+
+struct LilvWorkerImpl {
+	LilvWorkerPool*             pool;
+	ZixRing*                    requests;   ///< From audio thread to pool
+	ZixRing*                    responses;  ///< From pool to audio thread
+	void*                       request;    ///< Body of request being run
+	void*                       response;   ///< Body of response being emitted
+	LV2_Handle                  handle;
+	const LV2_Worker_Interface* iface;
+	LV2_Worker_Schedule         schedule;
+	LV2_Feature                 feature;
+	ZixSem                      done;       ///< Posted when idle if requested
+	bool                        busy;       ///< True while a thread runs work
+	bool                        waiting;    ///< Set while waiting for work
+	bool                        removing;   ///< Set when worker is being freed
+};
+
+/**
+   Write a message to `ring`, or fail if it does not fit.
+
+   The size is written before the body, so the reader must only read a
+   message once the whole body is available.
+*/
+static LV2_Worker_Status
+lilv_worker_write(ZixRing* ring, uint32_t size, const void* data)
+{
+	if (zix_ring_write_space(ring) < sizeof(size) + size) {
+		return LV2_WORKER_ERR_NO_SPACE;
+	}
+
+	zix_ring_write(ring, &size, sizeof(size));
+	zix_ring_write(ring, data, size);
+	return LV2_WORKER_SUCCESS;
+}
+
+/** Read the next complete message from `ring` into `body`. */
+static bool
+lilv_worker_read(ZixRing* ring, uint32_t* size, void* body)
+{
+	const uint32_t space = zix_ring_read_space(ring);
+	if (space < sizeof(*size) ||
+	    zix_ring_peek(ring, size, sizeof(*size)) != sizeof(*size) ||
+	    space < sizeof(*size) + *size) {
+		return false;
+	}
+
+	zix_ring_skip(ring, sizeof(*size));
+	zix_ring_read(ring, body, *size);
+	return true;
+}
+
+static LV2_Worker_Status
+lilv_worker_schedule(LV2_Worker_Schedule_Handle handle,
+                     uint32_t                   size,
+                     const void*                data)
+{
+	LilvWorker* const       worker = (LilvWorker*)handle;
+	const LV2_Worker_Status st     = lilv_worker_write(
+		worker->requests, size, data);
+	if (!st) {
+		zix_sem_post(&worker->pool->sem);
+	}
+	return st;
+}
+
+static LV2_Worker_Status
+lilv_worker_respond(LV2_Worker_Respond_Handle handle,
+                    uint32_t                  size,
+                    const void*               data)
+{
+	LilvWorker* const worker = (LilvWorker*)handle;
+	return lilv_worker_write(worker->responses, size, data);
+}
+
+/** Claim a worker with pending requests that no other thread is running. */
+static LilvWorker*
+lilv_worker_pool_claim(LilvWorkerPool* pool)
+{
+	LilvWorker* claimed = NULL;
+	zix_mutex_lock(&pool->mutex);
+	for (unsigned i = 0; i < pool->n_workers && !claimed; ++i) {
+		LilvWorker* const worker = pool->workers[i];
+		if (!worker->busy && !worker->removing &&
+		    zix_ring_read_space(worker->requests)) {
+			worker->busy = true;
+			claimed      = worker;
+		}
+	}
+	zix_mutex_unlock(&pool->mutex);
+	return claimed;
+}
+
+static void
+lilv_worker_pool_release(LilvWorkerPool* pool, LilvWorker* worker)
+{
+	zix_mutex_lock(&pool->mutex);
+	worker->busy = false;
+	if (worker->removing || worker->waiting) {
+		worker->waiting = false;
+		zix_sem_post(&worker->done);
+	}
+	zix_mutex_unlock(&pool->mutex);
+}
+
+static void*
+lilv_worker_pool_thread(void* data)
+{
+	LilvWorkerPool* const pool = (LilvWorkerPool*)data;
+	while (!zix_sem_wait(&pool->sem) && !pool->exit) {
+		// Run work until there is none left, a request may have arrived
+		// while another thread was running that worker
+		LilvWorker* worker = NULL;
+		while ((worker = lilv_worker_pool_claim(pool))) {
+			uint32_t size = 0;
+			while (lilv_worker_read(worker->requests, &size, worker->request)) {
+				if (worker->iface && worker->iface->work) {
+					worker->iface->work(worker->handle, lilv_worker_respond,
+					                    worker, size, worker->request);
+				}
+			}
+			lilv_worker_pool_release(pool, worker);
+		}
+	}
+	return NULL;
+}
+
+static LilvWorkerPool*
+lilv_worker_pool_new(unsigned n_threads)
+{
+	LilvWorkerPool* pool = (LilvWorkerPool*)calloc(1, sizeof(LilvWorkerPool));
+	zix_mutex_init(&pool->mutex);
+	zix_sem_init(&pool->sem, 0);
+
+	pool->threads = (ZixThread*)calloc(n_threads, sizeof(ZixThread));
+	for (unsigned i = 0; i < n_threads; ++i) {
+		if (zix_thread_create(&pool->threads[pool->n_threads], 0,
+		                      lilv_worker_pool_thread, pool)) {
+			LILV_ERROR("Failed to create worker thread\n");
+			break;
+		}
+		++pool->n_threads;
+	}
+	return pool;
+}
+
+void
+lilv_worker_pool_free(LilvWorkerPool* pool)
+{
+	if (!pool) {
+		return;
+	}
+
+	pool->exit = true;
+	for (unsigned i = 0; i < pool->n_threads; ++i) {
+		zix_sem_post(&pool->sem);
+	}
+	for (unsigned i = 0; i < pool->n_threads; ++i) {
+		zix_thread_join(pool->threads[i], NULL);
+	}
+
+	zix_sem_destroy(&pool->sem);
+	zix_mutex_destroy(&pool->mutex);
+	free(pool->threads);
+	free(pool->workers);
+	free(pool);
+}
+
+LilvWorker*
+lilv_worker_new(LilvWorld* world)
+{
+	// Start the shared pool when it is first needed
+	zix_mutex_lock(&world->libs_mutex);
+	if (!world->workers) {
+		world->workers = lilv_worker_pool_new(
+			world->opt.worker_threads ? world->opt.worker_threads : 1);
+	}
+	LilvWorkerPool* const pool = world->workers;
+	zix_mutex_unlock(&world->libs_mutex);
+
+	LilvWorker* worker = (LilvWorker*)calloc(1, sizeof(LilvWorker));
+	worker->pool      = pool;
+	worker->requests  = zix_ring_new(LILV_WORKER_RING_SIZE);
+	worker->responses = zix_ring_new(LILV_WORKER_RING_SIZE);
+	worker->request   = malloc(LILV_WORKER_RING_SIZE);
+	worker->response  = malloc(LILV_WORKER_RING_SIZE);
+	zix_ring_mlock(worker->requests);
+	zix_ring_mlock(worker->responses);
+	zix_sem_init(&worker->done, 0);
+
+	worker->schedule.handle        = worker;
+	worker->schedule.schedule_work = lilv_worker_schedule;
+	worker->feature.URI            = LV2_WORKER__schedule;
+	worker->feature.data           = &worker->schedule;
+
+	zix_mutex_lock(&pool->mutex);
+	pool->workers = (LilvWorker**)realloc(
+		pool->workers, (pool->n_workers + 1) * sizeof(LilvWorker*));
+	pool->workers[pool->n_workers++] = worker;
+	zix_mutex_unlock(&pool->mutex);
+
+	return worker;
+}
+
+const LV2_Feature**
+lilv_worker_add_feature(LilvWorker* worker, const LV2_Feature*const* features)
+{
+	size_t n_features = 0;
+	for (; features && features[n_features]; ++n_features) {}
+
+	const LV2_Feature** result = (const LV2_Feature**)calloc(
+		n_features + 2, sizeof(LV2_Feature*));
+	if (n_features) {
+		memcpy(result, features, n_features * sizeof(LV2_Feature*));
+	}
+	result[n_features] = &worker->feature;
+	return result;
+}
+
+void
+lilv_worker_attach(LilvWorker*           worker,
+                   const LV2_Descriptor* descriptor,
+                   LV2_Handle            handle)
+{
+	worker->handle = handle;
+	if (descriptor->extension_data) {
+		worker->iface = (const LV2_Worker_Interface*)
+			descriptor->extension_data(LV2_WORKER__interface);
+	}
+}
+
+void
+lilv_worker_emit_responses(LilvWorker* worker)
+{
+	if (!worker->iface) {
+		return;
+	}
+
+	uint32_t size = 0;
+	while (lilv_worker_read(worker->responses, &size, worker->response)) {
+		if (worker->iface->work_response) {
+			worker->iface->work_response(worker->handle, size,
+			                             worker->response);
+		}
+	}
+
+	if (worker->iface->end_run) {
+		worker->iface->end_run(worker->handle);
+	}
+}
+
+void
+lilv_worker_wait(LilvWorker* worker)
+{
+	LilvWorkerPool* const pool = worker->pool;
+	if (!pool->n_threads) {
+		return;  // Work will never be run
+	}
+
+	// Wait until no thread is running work and none is pending
+	zix_mutex_lock(&pool->mutex);
+	while (worker->busy || zix_ring_read_space(worker->requests)) {
+		worker->waiting = true;
+		zix_mutex_unlock(&pool->mutex);
+		zix_sem_wait(&worker->done);
+		zix_mutex_lock(&pool->mutex);
+	}
+	zix_mutex_unlock(&pool->mutex);
+}
+
+void
+lilv_worker_free(LilvWorker* worker)
+{
+	if (!worker) {
+		return;
+	}
+
+	// Wait for any thread running this worker, then unregister it
+	LilvWorkerPool* const pool = worker->pool;
+	zix_mutex_lock(&pool->mutex);
+	worker->removing = true;
+	if (worker->busy) {
+		zix_mutex_unlock(&pool->mutex);
+		zix_sem_wait(&worker->done);
+		zix_mutex_lock(&pool->mutex);
+	}
+	for (unsigned i = 0; i < pool->n_workers; ++i) {
+		if (pool->workers[i] == worker) {
+			pool->workers[i] = pool->workers[--pool->n_workers];
+			break;
+		}
+	}
+	zix_mutex_unlock(&pool->mutex);
+
+	zix_sem_destroy(&worker->done);
+	zix_ring_free(worker->requests);
+	zix_ring_free(worker->responses);
+	free(worker->request);
+	free(worker->response);
+	free(worker);
+}
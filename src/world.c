@@ -19,7 +19,12 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "lv2/lv2plug.in/ns/ext/atom/atom.h"
+#include "lv2/lv2plug.in/ns/ext/event/event.h"
 #include "lv2/lv2plug.in/ns/ext/presets/presets.h"
+#include "lv2/lv2plug.in/ns/ext/resize-port/resize-port.h"
+#include "lv2/lv2plug.in/ns/ext/worker/worker.h"
+#include "lv2/lv2plug.in/ns/extensions/ui/ui.h"
 
 #include "lilv_internal.h"
 
@@ -43,17 +48,41 @@ lilv_world_new(void)
 	world->loaded_files   = zix_tree_new(
 		false, lilv_resource_node_cmp, NULL, (ZixDestroyFunc)lilv_node_free);
 
-	world->libs = zix_tree_new(false, lilv_lib_compare, NULL, NULL);
+	world->libs      = zix_tree_new(false, lilv_lib_compare, NULL, NULL);
+	world->lib_clock = 0;
+	zix_mutex_init(&world->libs_mutex);
+	memset(&world->preload, 0, sizeof(world->preload));
+
+	zix_mutex_init(&world->nodes_mutex);
+	world->presets        = NULL;
+	world->n_presets      = 0;
+	world->presets_cap    = 0;
+	world->presets_sorted = true;
+	world->frozen         = false;
+	world->workers        = NULL;
 
 #define NS_DCTERMS "http://purl.org/dc/terms/"
 #define NS_DYNMAN  "http://lv2plug.in/ns/ext/dynmanifest#"
 #define NS_OWL     "http://www.w3.org/2002/07/owl#"
+#define NS_FOAF    "http://xmlns.com/foaf/0.1/"
 
 #define NEW_URI(uri) sord_new_uri(world->world, (const uint8_t*)uri)
 
+	world->uris.atom_AtomPort       = NEW_URI(LV2_ATOM__AtomPort);
+	world->uris.atom_supports       = NEW_URI(LV2_ATOM__supports);
 	world->uris.dc_replaces         = NEW_URI(NS_DCTERMS   "replaces");
 	world->uris.dman_DynManifest    = NEW_URI(NS_DYNMAN    "DynManifest");
+	world->uris.doap_maintainer     = NEW_URI(LILV_NS_DOAP "maintainer");
 	world->uris.doap_name           = NEW_URI(LILV_NS_DOAP "name");
+	world->uris.ev_supportsEvent    = NEW_URI(LV2_EVENT__supportsEvent);
+	world->uris.foaf_homepage       = NEW_URI(NS_FOAF      "homepage");
+	world->uris.foaf_mbox           = NEW_URI(NS_FOAF      "mbox");
+	world->uris.foaf_name           = NEW_URI(NS_FOAF      "name");
+	world->uris.lv2_AudioPort       = NEW_URI(LV2_CORE__AudioPort);
+	world->uris.lv2_CVPort          = NEW_URI(LV2_CORE__CVPort);
+	world->uris.lv2_ControlPort     = NEW_URI(LV2_CORE__ControlPort);
+	world->uris.lv2_InputPort       = NEW_URI(LV2_CORE__InputPort);
+	world->uris.lv2_OutputPort      = NEW_URI(LV2_CORE__OutputPort);
 	world->uris.lv2_Plugin          = NEW_URI(LV2_CORE__Plugin);
 	world->uris.lv2_Specification   = NEW_URI(LV2_CORE__Specification);
 	world->uris.lv2_appliesTo       = NEW_URI(LV2_CORE__appliesTo);
@@ -71,11 +100,15 @@ lilv_world_new(void)
 	world->uris.lv2_optionalFeature = NEW_URI(LV2_CORE__optionalFeature);
 	world->uris.lv2_port            = NEW_URI(LV2_CORE__port);
 	world->uris.lv2_portProperty    = NEW_URI(LV2_CORE__portProperty);
+	world->uris.lv2_project         = NEW_URI(LV2_CORE__project);
 	world->uris.lv2_reportsLatency  = NEW_URI(LV2_CORE__reportsLatency);
 	world->uris.lv2_requiredFeature = NEW_URI(LV2_CORE__requiredFeature);
+	world->uris.lv2_scalePoint      = NEW_URI(LV2_CORE__scalePoint);
 	world->uris.lv2_symbol          = NEW_URI(LV2_CORE__symbol);
 	world->uris.lv2_prototype       = NEW_URI(LV2_CORE__prototype);
 	world->uris.owl_Ontology        = NEW_URI(NS_OWL "Ontology");
+	world->uris.pset_Preset         = NEW_URI(LV2_PRESETS__Preset);
+	world->uris.pset_bank           = NEW_URI(LV2_PRESETS__bank);
 	world->uris.pset_value          = NEW_URI(LV2_PRESETS__value);
 	world->uris.rdf_a               = NEW_URI(LILV_NS_RDF  "type");
 	world->uris.rdf_value           = NEW_URI(LILV_NS_RDF  "value");
@@ -83,6 +116,10 @@ lilv_world_new(void)
 	world->uris.rdfs_label          = NEW_URI(LILV_NS_RDFS "label");
 	world->uris.rdfs_seeAlso        = NEW_URI(LILV_NS_RDFS "seeAlso");
 	world->uris.rdfs_subClassOf     = NEW_URI(LILV_NS_RDFS "subClassOf");
+	world->uris.rsz_minimumSize     = NEW_URI(LV2_RESIZE_PORT__minimumSize);
+	world->uris.ui_binary           = NEW_URI(LV2_UI__binary);
+	world->uris.ui_ui               = NEW_URI(LV2_UI__ui);
+	world->uris.work_schedule       = NEW_URI(LV2_WORKER__schedule);
 	world->uris.xsd_base64Binary    = NEW_URI(LILV_NS_XSD  "base64Binary");
 	world->uris.xsd_boolean         = NEW_URI(LILV_NS_XSD  "boolean");
 	world->uris.xsd_decimal         = NEW_URI(LILV_NS_XSD  "decimal");
@@ -97,6 +134,13 @@ lilv_world_new(void)
 	world->n_read_files        = 0;
 	world->opt.filter_language = true;
 	world->opt.dyn_manifest    = true;
+	world->opt.keep_libs       = 0;
+	world->opt.keep_libs_size  = 0;
+	world->opt.worker_threads  = 1;
+
+	world->lang.tag         = NULL;
+	world->lang.primary_len = 0;
+	lilv_lang_set(&world->lang, getenv("LANG"));
 
 	return world;
 
@@ -146,6 +190,17 @@ lilv_world_free(LilvWorld* world)
 	zix_tree_free((ZixTree*)world->loaded_files);
 	world->loaded_files = NULL;
 
+	lilv_world_unindex_presets(world, NULL);
+
+	lilv_worker_pool_free(world->workers);
+	world->workers = NULL;
+
+	// Close unused libraries kept open by LILV_OPTION_KEEP_LIBS
+	lilv_lib_preload_join(world);
+	world->opt.keep_libs      = 0;
+	world->opt.keep_libs_size = 0;
+	lilv_lib_trim(world, NULL);
+
 	zix_tree_free((ZixTree*)world->libs);
 	world->libs = NULL;
 
@@ -158,6 +213,9 @@ lilv_world_free(LilvWorld* world)
 	sord_world_free(world->world);
 	world->world = NULL;
 
+	free(world->lang.tag);
+	zix_mutex_destroy(&world->libs_mutex);
+	zix_mutex_destroy(&world->nodes_mutex);
 	free(world);
 }
 
@@ -166,6 +224,10 @@ lilv_world_set_option(LilvWorld*      world,
                       const char*     option,
                       const LilvNode* value)
 {
+	if (world->frozen) {
+		LILV_ERROR("World is frozen\n");
+		return;
+	}
 	if (!strcmp(option, LILV_OPTION_DYN_MANIFEST)) {
 		if (lilv_node_is_bool(value)) {
 			world->opt.dyn_manifest = lilv_node_as_bool(value);
@@ -176,26 +238,93 @@ lilv_world_set_option(LilvWorld*      world,
 			world->opt.filter_language = lilv_node_as_bool(value);
 			return;
 		}
+	} else if (!strcmp(option, LILV_OPTION_KEEP_LIBS)) {
+		if (lilv_node_is_int(value) && lilv_node_as_int(value) >= 0) {
+			world->opt.keep_libs = (unsigned)lilv_node_as_int(value);
+			lilv_lib_trim(world, NULL);
+			return;
+		}
+	} else if (!strcmp(option, LILV_OPTION_KEEP_LIBS_SIZE)) {
+		if (lilv_node_is_int(value) && lilv_node_as_int(value) >= 0) {
+			world->opt.keep_libs_size = (size_t)lilv_node_as_int(value)
+				* 1024 * 1024;
+			lilv_lib_trim(world, NULL);
+			return;
+		}
+	} else if (!strcmp(option, LILV_OPTION_WORKER_THREADS)) {
+		if (lilv_node_is_int(value) && lilv_node_as_int(value) > 0) {
+			world->opt.worker_threads = (unsigned)lilv_node_as_int(value);
+			return;
+		}
+	} else if (!strcmp(option, LILV_OPTION_LANG)) {
+		if (!value || lilv_node_is_string(value)) {
+			lilv_lang_set(&world->lang,
+			              value ? lilv_node_as_string(value) : getenv("LANG"));
+			return;
+		}
 	}
 	LILV_WARNF("Unrecognized or invalid option `%s'\n", option);
 }
 
-LILV_API LilvNodes*
-lilv_world_find_nodes(LilvWorld*      world,
-                      const LilvNode* subject,
-                      const LilvNode* predicate,
-                      const LilvNode* object)
+LILV_API int
+lilv_world_freeze(LilvWorld* world)
+{
+	if (world->frozen) {
+		return 0;
+	}
+
+	// Load all plugin data and fill every lazily initialised field
+	LILV_FOREACH(plugins, i, world->plugins) {
+		const LilvPlugin* p = lilv_plugins_get(world->plugins, i);
+		lilv_plugin_get_class(p);
+		lilv_plugin_get_num_ports(p);
+		if (lilv_world_ask_internal(
+			    world, p->plugin_uri->node, world->uris.lv2_binary, NULL)) {
+			lilv_plugin_get_library_uri(p);
+		}
+	}
+
+	// Sort the preset index now, since it is sorted lazily
+	lilv_world_sort_presets(world);
+
+	world->frozen = true;
+	return 0;
+}
+
+LILV_API bool
+lilv_world_is_frozen(const LilvWorld* world)
+{
+	return world->frozen;
+}
+
+/** Return true iff a find_nodes style pattern is valid, or print an error. */
+static bool
+lilv_world_check_pattern(const LilvNode* subject,
+                         const LilvNode* predicate,
+                         const LilvNode* object)
 {
 	if (subject && !lilv_node_is_uri(subject) && !lilv_node_is_blank(subject)) {
 		LILV_ERRORF("Subject `%s' is not a resource\n",
-		            sord_node_get_string(subject->node));
-		return NULL;
+		            subject ? lilv_node_as_string(subject) : "(null)");
+		return false;
 	} else if (!lilv_node_is_uri(predicate)) {
 		LILV_ERRORF("Predicate `%s' is not a URI\n",
 		            sord_node_get_string(predicate->node));
-		return NULL;
+		return false;
 	} else if (!subject && !object) {
 		LILV_ERROR("Both subject and object are NULL\n");
+		return false;
+	}
+	return true;
+}
+
+LILV_API LilvNodes*
+lilv_world_find_nodes(LilvWorld*      world,
+                      const LilvNode* subject,
+                      const LilvNode* predicate,
+                      const LilvNode* object)
+{
+	if (!lilv_world_check_pattern(subject, predicate, object)) {
 		return NULL;
 	}
 
@@ -205,22 +334,115 @@ lilv_world_find_nodes(LilvWorld*      world,
 	                                      object ? object->node : NULL);
 }
 
+LILV_API LilvMatches*
+lilv_world_match(LilvWorld*      world,
+                 const LilvNode* subject,
+                 const LilvNode* predicate,
+                 const LilvNode* object)
+{
+	if (!lilv_world_check_pattern(subject, predicate, object)) {
+		return NULL;
+	}
+
+	LilvMatches* matches = (LilvMatches*)malloc(sizeof(LilvMatches));
+	lilv_world_match_internal(world,
+	                          matches,
+	                          subject ? subject->node : NULL,
+	                          predicate->node,
+	                          object ? object->node : NULL);
+	return matches;
+}
+
+LILV_API unsigned
+lilv_world_foreach(LilvWorld*      world,
+                   const LilvNode* subject,
+                   const LilvNode* predicate,
+                   const LilvNode* object,
+                   LilvMatchFunc   func,
+                   void*           data)
+{
+	if (!lilv_world_check_pattern(subject, predicate, object)) {
+		return 0;
+	}
+
+	LilvMatches matches;
+	lilv_world_match_internal(world,
+	                          &matches,
+	                          subject ? subject->node : NULL,
+	                          predicate->node,
+	                          object ? object->node : NULL);
+
+	unsigned n_matches = 0;
+	for (; !lilv_matches_end(&matches); lilv_matches_next(&matches)) {
+		++n_matches;
+		if (func(lilv_matches_get(&matches), data)) {
+			break;
+		}
+	}
+
+	lilv_matches_clear(&matches);
+	return n_matches;
+}
+
 LILV_API LilvNode*
 lilv_world_get(LilvWorld*      world,
                const LilvNode* subject,
                const LilvNode* predicate,
                const LilvNode* object)
 {
-	SordNode* snode = sord_get(world->model,
-	                           subject   ? subject->node   : NULL,
-	                           predicate ? predicate->node : NULL,
-	                           object    ? object->node    : NULL,
-	                           NULL);
-	LilvNode* lnode = lilv_node_new_from_node(world, snode);
-	sord_node_free(world->world, snode);
+	if (!!subject + !!predicate + !!object != 2) {
+		return NULL;
+	}
+
+	SordIter* i = sord_search(world->model,
+	                          subject   ? subject->node   : NULL,
+	                          predicate ? predicate->node : NULL,
+	                          object    ? object->node    : NULL,
+	                          NULL);
+
+	const SordQuadIndex field = (!subject)   ? SORD_SUBJECT
+	                          : (!predicate) ? SORD_PREDICATE
+	                                         : SORD_OBJECT;
+
+	LilvNode* lnode = sord_iter_end(i)
+		? NULL
+		: lilv_node_new_from_node(world, sord_iter_get_node(i, field));
+	sord_iter_free(i);
 	return lnode;
 }
 
+LILV_API unsigned
+lilv_world_get_batch(LilvWorld*             world,
+                     const LilvNode*        subject,
+                     unsigned               n_predicates,
+                     const LilvNode* const* predicates,
+                     LilvNode**             values)
+{
+	if (!lilv_node_is_uri(subject) && !lilv_node_is_blank(subject)) {
+		LILV_ERRORF("Subject `%s' is not a resource\n",
+		            subject ? lilv_node_as_string(subject) : "(null)");
+		return 0;
+	}
+
+	const SordNode** preds = (const SordNode**)malloc(
+		n_predicates * sizeof(const SordNode*));
+	const SordNode** nodes = (const SordNode**)malloc(
+		n_predicates * sizeof(const SordNode*));
+	for (unsigned p = 0; p < n_predicates; ++p) {
+		preds[p] = predicates[p] ? predicates[p]->node : NULL;
+	}
+
+	const unsigned n_found = lilv_world_get_batch_internal(
+		world, subject->node, n_predicates, preds, nodes);
+	for (unsigned p = 0; p < n_predicates; ++p) {
+		values[p] = lilv_node_new_from_node(world, nodes[p]);
+	}
+
+	free(nodes);
+	free(preds);
+	return n_found;
+}
+
 SordIter*
 lilv_world_query_internal(LilvWorld*      world,
                           const SordNode* subject,
@@ -283,6 +505,23 @@ lilv_world_find_nodes_internal(LilvWorld*      world,
 		(object == NULL) ? SORD_OBJECT : SORD_SUBJECT);
 }
 
+void
+lilv_world_match_internal(LilvWorld*      world,
+                          LilvMatches*    matches,
+                          const SordNode* subject,
+                          const SordNode* predicate,
+                          const SordNode* object)
+{
+	lilv_matches_init(
+		matches,
+		world,
+		lilv_world_query_internal(world, subject, predicate, object),
+		(object == NULL) ? SORD_OBJECT : SORD_SUBJECT);
+	if (world->opt.filter_language) {
+		lilv_matches_filter_language(matches);
+	}
+}
+
 static SerdNode
 lilv_new_uri_relative_to_base(const uint8_t* uri_str,
                               const uint8_t* base_uri_str)
@@ -678,6 +917,10 @@ get_version(LilvWorld* world, SordModel* model, const LilvNode* subject)
 LILV_API void
 lilv_world_load_bundle(LilvWorld* world, const LilvNode* bundle_uri)
 {
+	if (world->frozen) {
+		LILV_ERROR("World is frozen\n");
+		return;
+	}
 	if (!lilv_node_is_uri(bundle_uri)) {
 		LILV_ERRORF("Bundle URI `%s' is not a URI\n",
 		            sord_node_get_string(bundle_uri->node));
@@ -783,6 +1026,9 @@ lilv_world_load_bundle(LilvWorld* world, const LilvNode* bundle_uri)
 
 	lilv_world_load_dyn_manifest(world, bundle_node, manifest);
 
+	// ?preset a pset:Preset
+	lilv_world_index_presets(world, bundle_node);
+
 	// ?spec a lv2:Specification
 	// ?spec a owl:Ontology
 	const SordNode* spec_preds[] = { world->uris.lv2_Specification,
@@ -833,6 +1079,10 @@ lilv_world_unload_file(LilvWorld* world, const LilvNode* file)
 LILV_API int
 lilv_world_unload_bundle(LilvWorld* world, const LilvNode* bundle_uri)
 {
+	if (world->frozen) {
+		LILV_ERROR("World is frozen\n");
+		return -1;
+	}
 	if (!bundle_uri) {
 		return 0;
 	}
@@ -877,6 +1127,15 @@ lilv_world_unload_bundle(LilvWorld* world, const LilvNode* bundle_uri)
 		i = next;
 	}
 
+	// Close unused libraries so a reloaded bundle gets fresh code
+	char* bundle_path = lilv_file_uri_parse(lilv_node_as_uri(bundle_uri), NULL);
+	if (bundle_path) {
+		lilv_lib_trim(world, bundle_path);
+		lilv_free(bundle_path);
+	}
+
+	lilv_world_unindex_presets(world, bundle_uri);
+
 	// Drop everything in bundle graph
 	return lilv_world_drop_graph(world, bundle_uri);
 }
@@ -949,6 +1208,10 @@ lilv_world_load_path(LilvWorld*  world,
 void
 lilv_world_load_specifications(LilvWorld* world)
 {
+	if (world->frozen) {
+		LILV_ERROR("World is frozen\n");
+		return;
+	}
 	for (LilvSpec* spec = world->specs; spec; spec = spec->next) {
 		LILV_FOREACH(nodes, f, spec->data_uris) {
 			LilvNode* file = (LilvNode*)lilv_collection_get(spec->data_uris, f);
@@ -960,6 +1223,10 @@ lilv_world_load_specifications(LilvWorld* world)
 void
 lilv_world_load_plugin_classes(LilvWorld* world)
 {
+	if (world->frozen) {
+		LILV_ERROR("World is frozen\n");
+		return;
+	}
 	/* FIXME: This loads all classes, not just lv2:Plugin subclasses.
 	   However, if the host gets all the classes via lilv_plugin_class_get_children
 	   starting with lv2:Plugin as the root (which is e.g. how a host would build
@@ -1003,6 +1270,10 @@ lilv_world_load_plugin_classes(LilvWorld* world)
 LILV_API void
 lilv_world_load_all(LilvWorld* world)
 {
+	if (world->frozen) {
+		LILV_ERROR("World is frozen\n");
+		return;
+	}
 	const char* lv2_path = getenv("LV2_PATH");
 	if (!lv2_path)
 		lv2_path = LILV_DEFAULT_LV2_PATH;
@@ -1056,6 +1327,10 @@ LILV_API int
 lilv_world_load_resource(LilvWorld*      world,
                          const LilvNode* resource)
 {
+	if (world->frozen) {
+		LILV_ERROR("World is frozen\n");
+		return -1;
+	}
 	if (!lilv_node_is_uri(resource) && !lilv_node_is_blank(resource)) {
 		LILV_ERRORF("Node `%s' is not a resource\n",
 		            sord_node_get_string(resource->node));
@@ -1091,6 +1366,10 @@ LILV_API int
 lilv_world_unload_resource(LilvWorld*      world,
                            const LilvNode* resource)
 {
+	if (world->frozen) {
+		LILV_ERROR("World is frozen\n");
+		return -1;
+	}
 	if (!lilv_node_is_uri(resource) && !lilv_node_is_blank(resource)) {
 		LILV_ERRORF("Node `%s' is not a resource\n",
 		            sord_node_get_string(resource->node));
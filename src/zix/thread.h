@@ -0,0 +1,210 @@
+/*
+  Copyright 2012-2016 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#ifndef ZIX_THREAD_H
+#define ZIX_THREAD_H
+
+#ifdef _WIN32
+#    include <windows.h>
+#else
+#    include <errno.h>
+#    include <pthread.h>
+#endif
+
+#include "zix/common.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+   @addtogroup zix
+   @{
+   @name Thread
+   @{
+*/
+
+#ifdef _WIN32
+typedef HANDLE           ZixThread;
+typedef CRITICAL_SECTION ZixMutex;
+#else
+typedef pthread_t        ZixThread;
+typedef pthread_mutex_t  ZixMutex;
+#endif
+
+/**
+   Initialize `thread` to a new thread.
+
+   The thread will immediately be launched, calling `function` with `arg`
+   as the only parameter.  If `stack_size` is zero, the default is used.
+*/
+static inline ZixStatus
+zix_thread_create(ZixThread* thread,
+                  size_t     stack_size,
+                  void*      (*function)(void*),
+                  void*      arg);
+
+/**
+   Join `thread` (block until `thread` exits).
+*/
+static inline ZixStatus
+zix_thread_join(ZixThread thread, void** retval);
+
+/**
+   Initialize `mutex`.
+*/
+static inline ZixStatus
+zix_mutex_init(ZixMutex* mutex);
+
+/**
+   Destroy `mutex`.
+*/
+static inline void
+zix_mutex_destroy(ZixMutex* mutex);
+
+/**
+   Lock `mutex`, blocking until it is available.
+*/
+static inline void
+zix_mutex_lock(ZixMutex* mutex);
+
+/**
+   Unlock `mutex`.
+*/
+static inline void
+zix_mutex_unlock(ZixMutex* mutex);
+
+#ifdef _WIN32
+
+static inline ZixStatus
+zix_thread_create(ZixThread* thread,
+                  size_t     stack_size,
+                  void*      (*function)(void*),
+                  void*      arg)
+{
+	*thread = CreateThread(NULL, stack_size,
+	                       (LPTHREAD_START_ROUTINE)function, arg,
+	                       0, NULL);
+	return *thread ? ZIX_STATUS_SUCCESS : ZIX_STATUS_ERROR;
+}
+
+static inline ZixStatus
+zix_thread_join(ZixThread thread, void** retval)
+{
+	const DWORD ret = WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+	return (ret == WAIT_OBJECT_0) ? ZIX_STATUS_SUCCESS : ZIX_STATUS_ERROR;
+}
+
+static inline ZixStatus
+zix_mutex_init(ZixMutex* mutex)
+{
+	InitializeCriticalSection(mutex);
+	return ZIX_STATUS_SUCCESS;
+}
+
+static inline void
+zix_mutex_destroy(ZixMutex* mutex)
+{
+	DeleteCriticalSection(mutex);
+}
+
+static inline void
+zix_mutex_lock(ZixMutex* mutex)
+{
+	EnterCriticalSection(mutex);
+}
+
+static inline void
+zix_mutex_unlock(ZixMutex* mutex)
+{
+	LeaveCriticalSection(mutex);
+}
+
+#else  /* !defined(_WIN32) */
+
+static inline ZixStatus
+zix_thread_create(ZixThread* thread,
+                  size_t     stack_size,
+                  void*      (*function)(void*),
+                  void*      arg)
+{
+	pthread_attr_t attr;
+	pthread_attr_init(&attr);
+	if (stack_size) {
+		pthread_attr_setstacksize(&attr, stack_size);
+	}
+
+	const int ret = pthread_create(thread, &attr, function, arg);
+	pthread_attr_destroy(&attr);
+
+	if (ret == EAGAIN) {
+		return ZIX_STATUS_NO_MEM;
+	} else if (ret == EINVAL) {
+		return ZIX_STATUS_BAD_ARG;
+	} else if (ret == EPERM) {
+		return ZIX_STATUS_BAD_PERMS;
+	} else if (ret) {
+		return ZIX_STATUS_ERROR;
+	}
+
+	return ZIX_STATUS_SUCCESS;
+}
+
+static inline ZixStatus
+zix_thread_join(ZixThread thread, void** retval)
+{
+	return pthread_join(thread, retval)
+		? ZIX_STATUS_ERROR : ZIX_STATUS_SUCCESS;
+}
+
+static inline ZixStatus
+zix_mutex_init(ZixMutex* mutex)
+{
+	return pthread_mutex_init(mutex, NULL)
+		? ZIX_STATUS_ERROR : ZIX_STATUS_SUCCESS;
+}
+
+static inline void
+zix_mutex_destroy(ZixMutex* mutex)
+{
+	pthread_mutex_destroy(mutex);
+}
+
+static inline void
+zix_mutex_lock(ZixMutex* mutex)
+{
+	pthread_mutex_lock(mutex);
+}
+
+static inline void
+zix_mutex_unlock(ZixMutex* mutex)
+{
+	pthread_mutex_unlock(mutex);
+}
+
+#endif
+
+/**
+   @}
+   @}
+*/
+
+#ifdef __cplusplus
+}  /* extern "C" */
+#endif
+
+#endif  /* ZIX_THREAD_H */
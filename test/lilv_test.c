@@ -39,6 +39,7 @@
 #endif
 
 #include "lilv/lilv.h"
+#include "lilv/portbuffers.h"
 #include "../src/lilv_internal.h"
 
 #include "lv2/lv2plug.in/ns/ext/presets/presets.h"
@@ -1020,6 +1021,22 @@ test_prototype(void)
 
 /*****************************************************************************/
 
+static void
+set_test_lang(LilvWorld* world, const char* lang)
+{
+	LilvNode* value = lang ? lilv_new_string(world, lang) : NULL;
+	lilv_world_set_option(world, LILV_OPTION_LANG, value);
+	lilv_node_free(value);
+}
+
+static int
+store_last_match(const LilvNode* node, void* data)
+{
+	const char** last = (const char**)data;
+	*last = lilv_node_as_string(node);
+	return 0;
+}
+
 static int
 test_port(void)
 {
@@ -1108,43 +1125,59 @@ test_port(void)
 	lilv_node_free(name);
 
 	// Exact language match
-	setenv("LANG", "fr_FR", 1);
+	set_test_lang(world, "fr_FR");
 	name = lilv_port_get_name(plug, p);
 	TEST_ASSERT(!strcmp(lilv_node_as_string(name), "épicerie"));
 	lilv_node_free(name);
 
 	// Exact language match (with charset suffix)
-	setenv("LANG", "fr_CA.utf8", 1);
+	set_test_lang(world, "fr_CA.utf8");
 	name = lilv_port_get_name(plug, p);
 	TEST_ASSERT(!strcmp(lilv_node_as_string(name), "dépanneur"));
 	lilv_node_free(name);
 
 	// Partial language match (choose value translated for different country)
-	setenv("LANG", "fr_BE", 1);
+	set_test_lang(world, "fr_BE");
 	name = lilv_port_get_name(plug, p);
 	TEST_ASSERT((!strcmp(lilv_node_as_string(name), "dépanneur"))
 	            ||(!strcmp(lilv_node_as_string(name), "épicerie")));
 	lilv_node_free(name);
 
 	// Partial language match (choose country-less language tagged value)
-	setenv("LANG", "es_MX", 1);
+	set_test_lang(world, "es_MX");
 	name = lilv_port_get_name(plug, p);
 	TEST_ASSERT(!strcmp(lilv_node_as_string(name), "tienda"));
 	lilv_node_free(name);
 
 	// No language match (choose untranslated value)
-	setenv("LANG", "cn", 1);
+	set_test_lang(world, "cn");
 	name = lilv_port_get_name(plug, p);
 	TEST_ASSERT(!strcmp(lilv_node_as_string(name), "store"));
 	lilv_node_free(name);
 
 	// Invalid language
-	setenv("LANG", "1!", 1);
+	set_test_lang(world, "1!");
 	name = lilv_port_get_name(plug, p);
 	TEST_ASSERT(!strcmp(lilv_node_as_string(name), "store"));
 	lilv_node_free(name);
 
-	setenv("LANG", "en_CA.utf-8", 1);
+	// Language set explicitly, overriding LANG
+	setenv("LANG", "cn", 1);
+	LilvNode* fr_fr = lilv_new_string(world, "fr_FR");
+	lilv_world_set_option(world, LILV_OPTION_LANG, fr_fr);
+	name = lilv_port_get_name(plug, p);
+	TEST_ASSERT(!strcmp(lilv_node_as_string(name), "épicerie"));
+	lilv_node_free(name);
+	lilv_node_free(fr_fr);
+
+	// Language from LANG again, which is read when the option is reset
+	lilv_world_set_option(world, LILV_OPTION_LANG, NULL);
+	name = lilv_port_get_name(plug, p);
+	TEST_ASSERT(!strcmp(lilv_node_as_string(name), "store"));
+	lilv_node_free(name);
+	setenv("LANG", "C", 1);
+
+	set_test_lang(world, "en_CA.utf-8");
 
 	// Language tagged value with no untranslated values
 	LilvNode*  rdfs_comment = lilv_new_uri(world, LILV_NS_RDFS "comment");
@@ -1156,22 +1189,46 @@ test_port(void)
 	lilv_node_free(comment);
 	lilv_nodes_free(comments);
 
-	setenv("LANG", "fr", 1);
+	set_test_lang(world, "fr");
 
 	comments = lilv_port_get_value(plug, p, rdfs_comment);
 	TEST_ASSERT(!strcmp(lilv_node_as_string(lilv_nodes_get_first(comments)),
 	                    "commentaires"));
 	lilv_nodes_free(comments);
 
-	setenv("LANG", "cn", 1);
+	set_test_lang(world, "cn");
 
 	comments = lilv_port_get_value(plug, p, rdfs_comment);
 	TEST_ASSERT(!comments);
 	lilv_nodes_free(comments);
 
+	// Borrowed language filtered iteration
+	set_test_lang(world, "fr_FR");
+	LilvNode*   lv2_name  = lilv_new_uri(world, LILV_NS_LV2 "name");
+	const char* last_name = NULL;
+	TEST_ASSERT(lilv_port_foreach_value(
+		            plug, p, lv2_name, store_last_match, &last_name) == 1);
+	TEST_ASSERT(!strcmp(last_name, "épicerie"));
+
+	set_test_lang(world, "cn");
+	LilvMatches* m = lilv_world_match(
+		world, lilv_port_get_node(plug, p), rdfs_comment, NULL);
+	TEST_ASSERT(lilv_matches_end(m));
+	TEST_ASSERT(!lilv_matches_get(m));
+	lilv_matches_free(m);
+
+	set_test_lang(world, "C");
+	m = lilv_world_match(world, lilv_port_get_node(plug, p), lv2_name, NULL);
+	TEST_ASSERT(!lilv_matches_end(m));
+	TEST_ASSERT(!strcmp(lilv_node_as_string(lilv_matches_get(m)), "store"));
+	lilv_matches_next(m);
+	TEST_ASSERT(lilv_matches_end(m));
+	lilv_matches_free(m);
+	lilv_node_free(lv2_name);
+
 	lilv_node_free(rdfs_comment);
 
-	setenv("LANG", "C", 1);  // Reset locale
+	set_test_lang(world, NULL);
 
 	LilvScalePoints* points = lilv_port_get_scale_points(plug, p);
 	TEST_ASSERT(lilv_scale_points_size(points) == 2);
@@ -1211,6 +1268,40 @@ test_port(void)
 	TEST_ASSERT(lilv_node_as_float(min) == -1.0);
 	TEST_ASSERT(lilv_node_as_float(max) == 1.0);
 
+	LilvNode* lv2_symbol  = lilv_new_uri(world, LILV_NS_LV2 "symbol");
+	LilvNode* lv2_latency = lilv_new_uri(world, LILV_NS_LV2 "latency");
+	LilvNode* lv2_minimum = lilv_new_uri(world, LILV_NS_LV2 "minimum");
+	const LilvNode* batch_preds[] = { lv2_symbol, lv2_latency, lv2_minimum };
+	LilvNode*       batch_vals[3];
+	TEST_ASSERT(lilv_world_get_batch(world, lilv_port_get_node(plug, p),
+	                                 3, batch_preds, batch_vals) == 2);
+	TEST_ASSERT(!strcmp(lilv_node_as_string(batch_vals[0]), "foo"));
+	TEST_ASSERT(!batch_vals[1]);
+	TEST_ASSERT(lilv_node_equals(batch_vals[2], min));
+	for (unsigned i = 0; i < 3; ++i) {
+		lilv_node_free(batch_vals[i]);
+	}
+	TEST_ASSERT(!lilv_world_get_batch(world, NULL, 3, batch_preds, batch_vals));
+
+	// Values are filtered by language like lilv_world_match()
+	set_test_lang(world, "fr_FR");
+	LilvNode*       lv2_port_name = lilv_new_uri(world, LILV_NS_LV2 "name");
+	const LilvNode* name_preds[]  = { lv2_port_name };
+	LilvNode*       batch_name    = NULL;
+	LilvMatches*    name_matches  = lilv_world_match(
+		world, lilv_port_get_node(plug, p), lv2_port_name, NULL);
+	TEST_ASSERT(lilv_world_get_batch(world, lilv_port_get_node(plug, p), 1,
+	                                 name_preds, &batch_name) == 1);
+	TEST_ASSERT(lilv_node_equals(batch_name, lilv_matches_get(name_matches)));
+	TEST_ASSERT(!strcmp(lilv_node_as_string(batch_name), "épicerie"));
+	set_test_lang(world, NULL);
+	lilv_matches_free(name_matches);
+	lilv_node_free(batch_name);
+	lilv_node_free(lv2_port_name);
+	lilv_node_free(lv2_minimum);
+	lilv_node_free(lv2_latency);
+	lilv_node_free(lv2_symbol);
+
 	LilvNode* integer_prop = lilv_new_uri(world, "http://lv2plug.in/ns/lv2core#integer");
 	LilvNode* toggled_prop = lilv_new_uri(world, "http://lv2plug.in/ns/lv2core#toggled");
 
@@ -1297,6 +1388,123 @@ test_port(void)
 
 /*****************************************************************************/
 
+/** Start a bundle with a plugin that has control, event, and audio ports. */
+static int
+start_audio_bundle(void)
+{
+	return start_bundle(MANIFEST_PREFIXES
+			":plug a lv2:Plugin ; lv2:binary <foo" SHLIB_EXT "> ; rdfs:seeAlso <plugin.ttl> .\n",
+			BUNDLE_PREFIXES PREFIX_LV2EV
+			":plug a lv2:Plugin ; "
+			PLUGIN_NAME("Test plugin") " ; "
+			LICENSE_GPL " ; "
+			"lv2:port [ "
+			"  a lv2:ControlPort ; a lv2:InputPort ; "
+			"  lv2:index 0 ; lv2:symbol \"foo\" ; lv2:name \"Foo\" ; "
+			"  lv2:minimum -1.0 ; lv2:maximum 1.0 ; lv2:default 0.5 "
+			"] , [\n"
+			"  a lv2:EventPort ; a lv2:InputPort ; "
+			"  lv2:index 1 ; lv2:symbol \"event_in\" ; "
+			"  lv2:name \"Event Input\" ; "
+			"  lv2ev:supportsEvent <http://example.org/event> "
+			"] , [\n"
+			"  a lv2:AudioPort ; a lv2:InputPort ; "
+			"  lv2:index 2 ; lv2:symbol \"audio_in\" ; "
+			"  lv2:name \"Audio Input\" ; "
+			"] , [\n"
+			"  a lv2:AudioPort ; a lv2:OutputPort ; "
+			"  lv2:index 3 ; lv2:symbol \"audio_out\" ; "
+			"  lv2:name \"Audio Output\" ; "
+			"] .");
+}
+
+static int
+test_port_buffers(void)
+{
+	if (!start_audio_bundle())
+		return 0;
+
+	init_uris();
+	const LilvPlugins* plugins = lilv_world_get_all_plugins(world);
+	const LilvPlugin*  plug    = lilv_plugins_get_by_uri(plugins, plugin_uri_value);
+	TEST_ASSERT(plug);
+
+	LilvPortBuffers* buffers = lilv_port_buffers_new(plug, NULL, 64, 0);
+	TEST_ASSERT(buffers);
+	TEST_ASSERT(lilv_port_buffers_get_num_ports(buffers) == 4);
+	TEST_ASSERT(lilv_port_buffers_get_type(buffers, 0) == LILV_PORT_BUFFER_CONTROL);
+	TEST_ASSERT(lilv_port_buffers_get_type(buffers, 1) == LILV_PORT_BUFFER_NONE);
+	TEST_ASSERT(lilv_port_buffers_get_type(buffers, 2) == LILV_PORT_BUFFER_AUDIO);
+	TEST_ASSERT(*lilv_port_buffers_get_control(buffers, 0) == 0.5f);
+	TEST_ASSERT(!lilv_port_buffers_get(buffers, 1));
+	TEST_ASSERT(!lilv_port_buffers_get_atom(buffers, 2));
+	TEST_ASSERT((uintptr_t)lilv_port_buffers_get_audio(buffers, 2) % 64 == 0);
+	TEST_ASSERT((uintptr_t)lilv_port_buffers_get_audio(buffers, 3) % 64 == 0);
+	lilv_port_buffers_free(buffers);
+
+	cleanup_uris();
+	return 1;
+}
+
+/*****************************************************************************/
+
+static int
+test_buffer_plan(void)
+{
+	if (!start_audio_bundle())
+		return 0;
+
+	init_uris();
+	const LilvPlugins* plugins = lilv_world_get_all_plugins(world);
+	const LilvPlugin*  plug    = lilv_plugins_get_by_uri(plugins, plugin_uri_value);
+	TEST_ASSERT(plug);
+
+	// Plan buffers for a chain, which can process in place
+	const LilvPlugin* gplugins[] = { plug, plug, plug, plug };
+	LilvGraph*        graph      = lilv_graph_new(1);
+	for (unsigned i = 0; i < 4; ++i) {
+		lilv_graph_add_node(graph, NULL);
+	}
+	lilv_graph_connect(graph, 0, 3, 1, 2);
+	lilv_graph_connect(graph, 1, 3, 2, 2);
+	TEST_ASSERT(!lilv_graph_plan_buffers(graph, gplugins));
+	TEST_ASSERT(!lilv_graph_compile(graph));
+	LilvBufferPlan* bplan = lilv_graph_plan_buffers(graph, gplugins);
+	TEST_ASSERT(lilv_buffer_plan_get_num_buffers(bplan) == 2);
+	TEST_ASSERT(lilv_buffer_plan_get_buffer(bplan, 0, 0) == -1);
+	TEST_ASSERT(lilv_buffer_plan_get_buffer(bplan, 0, 2) == 0);
+	TEST_ASSERT(lilv_buffer_plan_get_buffer(bplan, 0, 3) == 1);
+	TEST_ASSERT(lilv_buffer_plan_get_buffer(bplan, 1, 3) == 1);
+	TEST_ASSERT(lilv_buffer_plan_get_buffer(bplan, 2, 2) == 1);
+	TEST_ASSERT(lilv_buffer_plan_get_buffer(bplan, 2, 3) == 1);
+	lilv_buffer_plan_free(bplan);
+
+	// A fan out can not be overwritten until every reader has run
+	lilv_graph_connect(graph, 0, 3, 3, 2);
+	TEST_ASSERT(!lilv_graph_compile(graph));
+	bplan = lilv_graph_plan_buffers(graph, gplugins);
+	TEST_ASSERT(lilv_buffer_plan_get_num_buffers(bplan) == 4);
+	TEST_ASSERT(lilv_buffer_plan_get_buffer(bplan, 3, 2) == 1);
+	TEST_ASSERT(lilv_buffer_plan_get_buffer(bplan, 1, 3) == 2);
+	TEST_ASSERT(lilv_buffer_plan_get_buffer(bplan, 2, 2) == 2);
+
+	// Concurrent nodes do not share a buffer for unconnected outputs
+	TEST_ASSERT(lilv_buffer_plan_get_buffer(bplan, 2, 3) == 2);
+	TEST_ASSERT(lilv_buffer_plan_get_buffer(bplan, 3, 3) == 3);
+	lilv_buffer_plan_free(bplan);
+
+	// Inputs with several sources are not mixed
+	lilv_graph_connect(graph, 1, 3, 3, 2);
+	TEST_ASSERT(!lilv_graph_compile(graph));
+	TEST_ASSERT(!lilv_graph_plan_buffers(graph, gplugins));
+	lilv_graph_free(graph);
+
+	cleanup_uris();
+	return 1;
+}
+
+/*****************************************************************************/
+
 static unsigned
 ui_supported(const char* container_type_uri,
              const char* ui_type_uri)
@@ -1496,6 +1704,101 @@ lilv_make_path(LV2_State_Make_Path_Handle handle,
 	return lilv_path_join(temp_dir, path);
 }
 
+static LV2_URID_Map       test_map           = { NULL, map_uri };
+static LV2_Feature        test_map_feature   = { LV2_URID_MAP_URI, &test_map };
+static LV2_URID_Unmap     test_unmap         = { NULL, unmap_uri };
+static LV2_Feature        test_unmap_feature = { LV2_URID_UNMAP_URI,
+                                                 &test_unmap };
+static const LV2_Feature* test_features[]    = { &test_map_feature,
+                                                 &test_unmap_feature,
+                                                 NULL };
+
+/** Load the test plugin bundle into a new world and return the plugin. */
+static const LilvPlugin*
+load_test_plugin(void)
+{
+	init_world();
+
+	uint8_t*  abs_bundle = (uint8_t*)lilv_path_absolute(LILV_TEST_BUNDLE);
+	SerdNode  bundle     = serd_node_new_file_uri(abs_bundle, 0, 0, true);
+	LilvNode* bundle_uri = lilv_new_uri(world, (const char*)bundle.buf);
+	LilvNode* plugin_uri = lilv_new_uri(world,
+	                                    "http://example.org/lilv-test-plugin");
+	lilv_world_load_bundle(world, bundle_uri);
+	free(abs_bundle);
+	serd_node_free(&bundle);
+
+	const LilvPlugins* plugins = lilv_world_get_all_plugins(world);
+	const LilvPlugin*  plugin  = lilv_plugins_get_by_uri(plugins, plugin_uri);
+	lilv_node_free(plugin_uri);
+	lilv_node_free(bundle_uri);
+
+	atom_Float = map_uri(NULL, "http://lv2plug.in/ns/ext/atom#Float");
+	return plugin;
+}
+
+static void
+free_uri_map(void)
+{
+	for (size_t i = 0; i < n_uris; ++i) {
+		free(uris[i]);
+	}
+	free(uris);
+	uris   = NULL;
+	n_uris = 0;
+}
+
+/** Instantiate the test plugin, connected to `in` and `out`. */
+static LilvInstance*
+new_test_instance(const LilvPlugin* plugin)
+{
+	LilvInstance* instance = lilv_plugin_instantiate(
+		plugin, 48000.0, test_features);
+	if (instance) {
+		lilv_instance_connect_port(instance, 0, &in);
+		lilv_instance_connect_port(instance, 1, &out);
+	}
+	return instance;
+}
+
+static const LilvPlugin* fixture_plugin   = NULL;
+static LilvInstance*     fixture_instance = NULL;
+
+/** Load the test plugin and activate a new instance of it. */
+static bool
+start_test_instance(void)
+{
+	if (!(fixture_plugin = load_test_plugin()) ||
+	    !(fixture_instance = new_test_instance(fixture_plugin))) {
+		return false;
+	}
+
+	lilv_instance_activate(fixture_instance);
+	return true;
+}
+
+/** Free the instance from start_test_instance() and reset its ports. */
+static void
+cleanup_test_instance(void)
+{
+	lilv_instance_deactivate(fixture_instance);
+	lilv_instance_free(fixture_instance);
+	fixture_instance = NULL;
+	fixture_plugin   = NULL;
+	in               = 1.0f;
+	out              = 42.0f;
+	free_uri_map();
+}
+
+/** Return the state of the test instance, which changes every run. */
+static LilvState*
+new_test_state(void)
+{
+	return lilv_state_new_from_instance(
+		fixture_plugin, fixture_instance, &test_map, NULL, NULL, NULL, NULL,
+		get_port_value, NULL, 0, NULL);
+}
+
 static int
 test_state(void)
 {
@@ -1790,12 +2093,7 @@ test_state(void)
 	lilv_state_free(fstate7);
 	lilv_state_free(fstate72);
 
-	// Free URI map
-	for (size_t i = 0; i < n_uris; ++i) {
-		free(uris[i]);
-	}
-	free(uris);
-	n_uris = 0;
+	free_uri_map();
 
 	lilv_node_free(plugin_uri);
 	lilv_node_free(bundle_uri);
@@ -1809,6 +2107,645 @@ test_state(void)
 
 /*****************************************************************************/
 
+#define N_LOADER_PRESETS 4
+
+/** Map URIs with a lock, for functions that map from several threads. */
+static LV2_URID
+map_uri_locked(LV2_URID_Map_Handle handle,
+               const char*         uri)
+{
+	zix_mutex_lock((ZixMutex*)handle);
+	const LV2_URID urid = map_uri(NULL, uri);
+	zix_mutex_unlock((ZixMutex*)handle);
+	return urid;
+}
+
+static const char*
+unmap_uri_locked(LV2_URID_Unmap_Handle handle,
+                 LV2_URID              urid)
+{
+	zix_mutex_lock((ZixMutex*)handle);
+	const char* uri = unmap_uri(NULL, urid);
+	zix_mutex_unlock((ZixMutex*)handle);
+	return uri;
+}
+
+static int
+test_preset_loader(void)
+{
+	TEST_ASSERT(start_test_instance());
+
+	// Save presets to separate files, labelled with their URI
+	LilvState* state = new_test_state();
+	for (unsigned i = 0; i < N_LOADER_PRESETS; ++i) {
+		char uri[64];
+		char filename[32];
+		snprintf(uri, sizeof(uri), "http://example.org/loader%u", i);
+		snprintf(filename, sizeof(filename), "loader%u.ttl", i);
+		lilv_state_set_label(state, uri);
+		TEST_ASSERT(!lilv_state_save(world, &test_map, &test_unmap, state, uri,
+		                             "state/loader.lv2", filename));
+	}
+
+	uint8_t*  abs_bundle = (uint8_t*)lilv_path_absolute("state/loader.lv2/");
+	SerdNode  bundle     = serd_node_new_file_uri(abs_bundle, 0, 0, true);
+	LilvNode* bundle_uri = lilv_new_uri(world, (const char*)bundle.buf);
+	lilv_world_load_bundle(world, bundle_uri);
+	serd_node_free(&bundle);
+	free(abs_bundle);
+
+	// Load every file in its own thread, except the calling thread's first
+	const LilvPresetInfo* presets = NULL;
+	TEST_ASSERT(lilv_plugin_get_presets(fixture_plugin, &presets) ==
+	            N_LOADER_PRESETS);
+
+	ZixMutex     map_mutex;
+	LV2_URID_Map locked_map = { &map_mutex, map_uri_locked };
+	LilvState*   states[N_LOADER_PRESETS];
+	zix_mutex_init(&map_mutex);
+	TEST_ASSERT(lilv_world_load_presets(world, &locked_map, N_LOADER_PRESETS,
+	                                    presets, states, N_LOADER_PRESETS)
+	            == N_LOADER_PRESETS);
+	zix_mutex_destroy(&map_mutex);
+
+	// Check states after the loader has freed the worlds they were loaded in
+	for (unsigned i = 0; i < N_LOADER_PRESETS; ++i) {
+		TEST_ASSERT(states[i]);
+		TEST_ASSERT(lilv_node_equals(lilv_state_get_uri(states[i]),
+		                             presets[i].uri));
+		TEST_ASSERT(lilv_node_equals(lilv_state_get_plugin_uri(states[i]),
+		                             lilv_plugin_get_uri(fixture_plugin)));
+		TEST_ASSERT(!strcmp(lilv_state_get_label(states[i]),
+		                    lilv_node_as_string(presets[i].uri)));
+		TEST_ASSERT(lilv_state_get_num_properties(states[i]) ==
+		            lilv_state_get_num_properties(state));
+		lilv_state_free(states[i]);
+	}
+
+	// Load a single preset on the calling thread, like loading its file
+	TEST_ASSERT(presets[0].file);
+	char*      file_path = lilv_file_uri_parse(
+		lilv_node_as_uri(presets[0].file), NULL);
+	LilvState* from_file = lilv_state_new_from_file(
+		world, &test_map, presets[0].uri, file_path);
+	LilvState* indexed   = NULL;
+	TEST_ASSERT(lilv_world_load_presets(
+		            world, &test_map, 1, presets, &indexed, 1) == 1);
+	TEST_ASSERT(lilv_state_equals(from_file, indexed));
+	lilv_state_free(indexed);
+	lilv_state_free(from_file);
+	lilv_free(file_path);
+
+	lilv_world_unload_bundle(world, bundle_uri);
+	TEST_ASSERT(!lilv_plugin_get_presets(fixture_plugin, &presets));
+
+	lilv_node_free(bundle_uri);
+	lilv_state_free(state);
+	cleanup_test_instance();
+	return 1;
+}
+
+/*****************************************************************************/
+
+static int
+test_snapshot(void)
+{
+	TEST_ASSERT(start_test_instance());
+	LilvState* state = new_test_state();
+
+	// Take an in-memory snapshot
+	LilvState* snapshot = lilv_state_new_snapshot(
+		fixture_plugin, fixture_instance, &test_map,
+		get_port_value, NULL, 0, NULL);
+	TEST_ASSERT(lilv_state_equals(state, snapshot));
+	TEST_ASSERT(lilv_state_get_num_properties(snapshot) ==
+	            lilv_state_get_num_properties(state));
+
+	// Run, then restore the snapshot to undo the change
+	lilv_instance_run(fixture_instance, 1);
+	LilvState* changed = new_test_state();
+	TEST_ASSERT(!lilv_state_equals(state, changed));
+	lilv_state_restore(
+		snapshot, fixture_instance, set_port_value, NULL, 0, NULL);
+	LilvState* restored = new_test_state();
+	TEST_ASSERT(lilv_state_equals(state, restored));
+
+	lilv_state_free(restored);
+	lilv_state_free(changed);
+	lilv_state_free(snapshot);
+	lilv_state_free(state);
+	cleanup_test_instance();
+	return 1;
+}
+
+/*****************************************************************************/
+
+static void
+state_saved(const char* path, int status, void* user_data)
+{
+	*(int*)user_data = status;
+}
+
+static int
+test_state_saver(void)
+{
+	TEST_ASSERT(start_test_instance());
+
+	// Take snapshots first, since the saver thread uses the URI map
+	LilvState* snapshots[3];
+	snapshots[0] = lilv_state_new_snapshot(
+		fixture_plugin, fixture_instance, &test_map,
+		get_port_value, NULL, 0, NULL);
+	snapshots[1] = lilv_state_new_snapshot(
+		fixture_plugin, fixture_instance, &test_map,
+		get_port_value, NULL, 0, NULL);
+	lilv_instance_run(fixture_instance, 1);
+	snapshots[2] = lilv_state_new_snapshot(
+		fixture_plugin, fixture_instance, &test_map,
+		get_port_value, NULL, 0, NULL);
+	LilvState* last = new_test_state();
+
+	ZixMutex       map_mutex;
+	LV2_URID_Map   locked_map   = { &map_mutex, map_uri_locked };
+	LV2_URID_Unmap locked_unmap = { &map_mutex, unmap_uri_locked };
+	int            statuses[3]  = { 1, 1, 1 };
+	zix_mutex_init(&map_mutex);
+
+	LilvStateSaver* saver = lilv_state_saver_new(&locked_map, &locked_unmap);
+	TEST_ASSERT(saver);
+	TEST_ASSERT(lilv_state_saver_save(saver, NULL, NULL, "state/saver.lv2",
+	                                  "saver.ttl", state_saved, NULL) == 1);
+
+	/* Hold the URI map so the thread blocks in the first save, then queue two
+	   saves to another file, so the second is superseded while queued. */
+	zix_mutex_lock(&map_mutex);
+	TEST_ASSERT(!lilv_state_saver_save(saver, snapshots[0], NULL,
+	                                   "state/saver.lv2", "first.ttl",
+	                                   state_saved, &statuses[0]));
+	for (unsigned i = 1; i < 3; ++i) {
+		TEST_ASSERT(!lilv_state_saver_save(saver, snapshots[i], NULL,
+		                                   "state/saver.lv2", "saver.ttl",
+		                                   state_saved, &statuses[i]));
+	}
+	zix_mutex_unlock(&map_mutex);
+	lilv_state_saver_free(saver);
+	zix_mutex_destroy(&map_mutex);
+	TEST_ASSERT(statuses[0] == 0);
+	TEST_ASSERT(statuses[1] == -1);
+	TEST_ASSERT(statuses[2] == 0);
+
+	LilvState* saved = lilv_state_new_from_file(
+		world, &test_map, NULL, "state/saver.lv2/saver.ttl");
+	TEST_ASSERT(lilv_state_equals(last, saved));
+	lilv_state_free(saved);
+
+	lilv_state_free(last);
+	cleanup_test_instance();
+	return 1;
+}
+
+/*****************************************************************************/
+
+static int
+test_state_hash(void)
+{
+	TEST_ASSERT(start_test_instance());
+	LilvState* state = new_test_state();
+	TEST_ASSERT(!lilv_state_save(world, &test_map, &test_unmap, state, NULL,
+	                             "state/hash.lv2", "hash.ttl"));
+	LilvState* loaded = lilv_state_new_from_file(
+		world, &test_map, NULL, "state/hash.lv2/hash.ttl");
+	lilv_instance_run(fixture_instance, 1);
+	LilvState* changed = new_test_state();
+
+	// Check that hashes match for equivalent states only
+	uint8_t hash[LILV_STATE_HASH_SIZE];
+	uint8_t other[LILV_STATE_HASH_SIZE];
+	lilv_state_get_hash(state, hash);
+	lilv_state_get_hash(loaded, other);
+	TEST_ASSERT(!memcmp(hash, other, LILV_STATE_HASH_SIZE));
+	lilv_state_get_hash(changed, other);
+	TEST_ASSERT(memcmp(hash, other, LILV_STATE_HASH_SIZE));
+
+	// The label is part of the contents
+	lilv_state_set_label(loaded, "Hashed State");
+	lilv_state_get_hash(loaded, other);
+	TEST_ASSERT(memcmp(hash, other, LILV_STATE_HASH_SIZE));
+
+	lilv_state_free(changed);
+	lilv_state_free(loaded);
+	lilv_state_free(state);
+	cleanup_test_instance();
+	return 1;
+}
+
+/*****************************************************************************/
+
+static int
+test_save_batch(void)
+{
+	TEST_ASSERT(start_test_instance());
+	LilvState* a = new_test_state();
+	lilv_instance_run(fixture_instance, 1);
+	LilvState* b = new_test_state();
+
+	// Save several states into one bundle
+	const LilvState* batch[]       = { a, b };
+	const char*      batch_files[] = { "a.ttl", "b.ttl" };
+	TEST_ASSERT(!lilv_state_save_batch(world, &test_map, &test_unmap,
+	                                   2, batch, NULL,
+	                                   "state/batch.lv2", batch_files));
+	TEST_ASSERT(lilv_state_get_uri(a));
+	TEST_ASSERT(lilv_state_get_uri(b));
+	LilvState* batch_a = lilv_state_new_from_file(
+		world, &test_map, NULL, "state/batch.lv2/a.ttl");
+	LilvState* batch_b = lilv_state_new_from_file(
+		world, &test_map, NULL, "state/batch.lv2/b.ttl");
+	TEST_ASSERT(lilv_state_equals(a, batch_a));
+	TEST_ASSERT(lilv_state_equals(b, batch_b));
+	lilv_state_free(batch_b);
+	lilv_state_free(batch_a);
+
+	// The manifest lists both states
+	uint8_t*  abs_bundle = (uint8_t*)lilv_path_absolute("state/batch.lv2/");
+	SerdNode  bundle     = serd_node_new_file_uri(abs_bundle, 0, 0, true);
+	LilvNode* bundle_uri = lilv_new_uri(world, (const char*)bundle.buf);
+	lilv_world_load_bundle(world, bundle_uri);
+
+	const LilvPresetInfo* presets = NULL;
+	TEST_ASSERT(lilv_plugin_get_presets(fixture_plugin, &presets) == 2);
+	lilv_world_unload_bundle(world, bundle_uri);
+	lilv_node_free(bundle_uri);
+	serd_node_free(&bundle);
+	free(abs_bundle);
+
+	lilv_state_free(b);
+	lilv_state_free(a);
+	cleanup_test_instance();
+	return 1;
+}
+
+/*****************************************************************************/
+
+#define BINARY_STATE_PATH "state/binary.lv2/state" LILV_STATE_BINARY_EXTENSION
+#define TRUNCATED_STATE_PATH \
+	"state/binary.lv2/truncated" LILV_STATE_BINARY_EXTENSION
+
+static int
+test_binary_state(void)
+{
+	TEST_ASSERT(start_test_instance());
+	LilvState* state = new_test_state();
+	lilv_state_set_label(state, "Binary State");
+
+	// Convert state to binary format and back
+	TEST_ASSERT(!lilv_state_save(world, &test_map, &test_unmap, state, NULL,
+	                             "state/binary.lv2",
+	                             "state" LILV_STATE_BINARY_EXTENSION));
+	LilvState* bstate = lilv_state_new_from_file(
+		world, &test_map, NULL, BINARY_STATE_PATH);
+	TEST_ASSERT(lilv_state_equals(state, bstate));  // Round trip accuracy
+	TEST_ASSERT(!strcmp(lilv_state_get_label(bstate),
+	                    lilv_state_get_label(state)));
+	lilv_state_free(bstate);
+
+	// Truncated files are rejected rather than partially loaded
+	char   bbuf[4096];
+	FILE*  bfile = fopen(BINARY_STATE_PATH, "rb");
+	size_t bsize = fread(bbuf, 1, sizeof(bbuf), bfile);
+	fclose(bfile);
+	TEST_ASSERT(bsize > 8 && bsize < sizeof(bbuf));
+	bfile = fopen(TRUNCATED_STATE_PATH, "wb");
+	fwrite(bbuf, 1, bsize - 8, bfile);
+	fclose(bfile);
+	TEST_ASSERT(!lilv_state_new_from_file(
+		            world, &test_map, NULL, TRUNCATED_STATE_PATH));
+
+	lilv_state_free(state);
+	cleanup_test_instance();
+	return 1;
+}
+
+/*****************************************************************************/
+
+#define DELTA_STATE_PATH "state/delta.lv2/delta" LILV_STATE_BINARY_EXTENSION
+
+static int
+test_delta_state(void)
+{
+	TEST_ASSERT(start_test_instance());
+	LilvState* base = new_test_state();
+	lilv_state_set_label(base, "Base State");
+	lilv_instance_run(fixture_instance, 1);
+	LilvState* state = new_test_state();
+	TEST_ASSERT(!lilv_state_equals(base, state));
+
+	// Save changes to another state as a delta and load it back
+	TEST_ASSERT(!lilv_state_save(world, &test_map, &test_unmap, base, NULL,
+	                             "state/delta.lv2",
+	                             "base" LILV_STATE_BINARY_EXTENSION));
+	TEST_ASSERT(!lilv_state_save_delta(world, &test_map, &test_unmap,
+	                                   base, "base" LILV_STATE_BINARY_EXTENSION,
+	                                   state, NULL, "state/delta.lv2",
+	                                   "delta" LILV_STATE_BINARY_EXTENSION));
+
+	LilvState* dstate = lilv_state_new_from_file(
+		world, &test_map, NULL, DELTA_STATE_PATH);
+	TEST_ASSERT(lilv_state_equals(state, dstate));
+	TEST_ASSERT(!lilv_state_get_label(dstate));
+	lilv_state_free(dstate);
+
+	// Overwrite the base, so the delta no longer applies to it
+	TEST_ASSERT(!lilv_state_save(world, &test_map, &test_unmap, state, NULL,
+	                             "state/delta.lv2",
+	                             "base" LILV_STATE_BINARY_EXTENSION));
+	TEST_ASSERT(!lilv_state_new_from_file(
+		            world, &test_map, NULL, DELTA_STATE_PATH));
+
+	lilv_state_free(state);
+	lilv_state_free(base);
+	cleanup_test_instance();
+	return 1;
+}
+
+/*****************************************************************************/
+
+/** Return true iff the shared library at `path` is currently loaded. */
+static bool
+library_is_loaded(const char* path)
+{
+#ifdef RTLD_NOLOAD
+	void* const lib = dlopen(path, RTLD_NOW | RTLD_NOLOAD);
+	if (lib) {
+		dlclose(lib);
+		return true;
+	}
+#endif
+	return false;
+}
+
+static int
+test_preload(void)
+{
+	const LilvPlugin* plugin = load_test_plugin();
+	TEST_ASSERT(plugin);
+
+	char* lib_path = lilv_file_uri_parse(
+		lilv_node_as_uri(lilv_plugin_get_library_uri(plugin)), NULL);
+	LilvNode* bundle_uri = lilv_node_duplicate(
+		lilv_plugin_get_bundle_uri(plugin));
+	TEST_ASSERT(!library_is_loaded(lib_path));
+
+	// Keep the library open after the last instance is freed
+	LilvNode* keep   = lilv_new_int(world, 1);
+	LilvNode* nokeep = lilv_new_int(world, 0);
+	lilv_world_set_option(world, LILV_OPTION_KEEP_LIBS, keep);
+	LilvInstance* instance = lilv_plugin_instantiate(
+		plugin, 48000.0, test_features);
+	TEST_ASSERT(instance);
+	lilv_instance_free(instance);
+#ifdef RTLD_NOLOAD
+	TEST_ASSERT(library_is_loaded(lib_path));
+#endif
+
+	// Close kept libraries when the option is cleared
+	lilv_world_set_option(world, LILV_OPTION_KEEP_LIBS, nokeep);
+	TEST_ASSERT(!library_is_loaded(lib_path));
+
+	// Keep the library after an instance of a preloaded library is freed
+	lilv_world_set_option(world, LILV_OPTION_KEEP_LIBS, keep);
+	TEST_ASSERT(!lilv_world_preload_libraries(world));
+	instance = lilv_plugin_instantiate(plugin, 48000.0, test_features);
+	TEST_ASSERT(instance);
+	lilv_instance_free(instance);
+#ifdef RTLD_NOLOAD
+	TEST_ASSERT(library_is_loaded(lib_path));
+#endif
+
+	// Unloading the bundle closes both the kept and the preloaded library
+	lilv_world_unload_bundle(world, bundle_uri);
+	TEST_ASSERT(!library_is_loaded(lib_path));
+
+	lilv_node_free(nokeep);
+	lilv_node_free(keep);
+	lilv_node_free(bundle_uri);
+	lilv_free(lib_path);
+	free_uri_map();
+	return 1;
+}
+
+/*****************************************************************************/
+
+static int
+test_instantiate_batch(void)
+{
+	const LilvPlugin* plugin = load_test_plugin();
+	TEST_ASSERT(plugin);
+
+	ZixMutex           map_mutex;
+	LV2_URID_Map       locked_map  = { &map_mutex, map_uri_locked };
+	LV2_Feature        map_feature = { LV2_URID_MAP_URI, &locked_map };
+	const LV2_Feature* features[]  = { &map_feature, NULL };
+	zix_mutex_init(&map_mutex);
+
+	// Instantiate several times in parallel
+	LilvInstantiateRequest requests[4];
+	for (unsigned i = 0; i < 4; ++i) {
+		requests[i].plugin      = plugin;
+		requests[i].sample_rate = 48000.0;
+		requests[i].features    = features;
+	}
+	TEST_ASSERT(lilv_plugins_instantiate_batch(4, requests, 2) == 4);
+	for (unsigned i = 0; i < 4; ++i) {
+		TEST_ASSERT(requests[i].status == LILV_INSTANTIATE_SUCCESS);
+		TEST_ASSERT(requests[i].instance);
+		lilv_instance_free(requests[i].instance);
+	}
+
+	zix_mutex_destroy(&map_mutex);
+	free_uri_map();
+	return 1;
+}
+
+/*****************************************************************************/
+
+static int
+test_instance_pool(void)
+{
+	const LilvPlugin* plugin = load_test_plugin();
+	TEST_ASSERT(plugin);
+
+	// The pool instantiates in a background thread
+	ZixMutex           map_mutex;
+	LV2_URID_Map       locked_map  = { &map_mutex, map_uri_locked };
+	LV2_Feature        map_feature = { LV2_URID_MAP_URI, &locked_map };
+	const LV2_Feature* features[]  = { &map_feature, NULL };
+	zix_mutex_init(&map_mutex);
+
+	// Take an instance from a pool, run it, and give it back
+	LilvInstancePool* pool = lilv_instance_pool_new(
+		plugin, 48000.0, features, NULL, 2);
+	TEST_ASSERT(pool);
+	LilvInstance* instance = lilv_instance_pool_get(pool);
+	TEST_ASSERT(instance);
+	in  = 3.0f;
+	out = 0.0f;
+	lilv_instance_connect_port(instance, 0, &in);
+	lilv_instance_connect_port(instance, 1, &out);
+	lilv_instance_run(instance, 1);
+	TEST_ASSERT(out == 3.0f);
+	TEST_ASSERT(!lilv_instance_pool_put(pool, instance));
+	lilv_instance_pool_free(pool);
+	in  = 1.0f;
+	out = 42.0f;
+
+	zix_mutex_destroy(&map_mutex);
+	free_uri_map();
+	return 1;
+}
+
+/*****************************************************************************/
+
+static int
+test_worker(void)
+{
+	TEST_ASSERT(start_test_instance());
+	TEST_ASSERT(lilv_instance_has_worker(fixture_instance));
+
+	// Work scheduled in run() is done by a worker provided by lilv
+	in  = 1.0f;
+	out = 0.0f;
+	lilv_instance_run(fixture_instance, 4);
+	TEST_ASSERT(out == 1.0f);
+	lilv_instance_wait_for_work(fixture_instance);
+	lilv_instance_end_run(fixture_instance);
+	TEST_ASSERT(out == 2.0f);
+
+	// Nothing is delivered when there is no work
+	out = 0.0f;
+	lilv_instance_wait_for_work(fixture_instance);
+	lilv_instance_end_run(fixture_instance);
+	TEST_ASSERT(out == 0.0f);
+
+	cleanup_test_instance();
+	return 1;
+}
+
+/*****************************************************************************/
+
+static int
+test_control_queue(void)
+{
+	TEST_ASSERT(start_test_instance());
+
+	// Run with control changes in the middle of a block
+	LilvPortBuffers*  buffers = lilv_instance_auto_connect(
+		fixture_instance, fixture_plugin, &test_map, 8);
+	LilvControlQueue* queue   = lilv_control_queue_new(4);
+	TEST_ASSERT(lilv_port_buffers_get_num_ports(buffers) == 2);
+	TEST_ASSERT(!lilv_control_queue_push(queue, 0, 0, 1.0f));
+	TEST_ASSERT(!lilv_control_queue_push(queue, 0, 2, 2.0f));
+	TEST_ASSERT(!lilv_control_queue_push(queue, 0, 5, 3.0f));
+	TEST_ASSERT(!lilv_control_queue_push(queue, 0, 20, 4.0f));
+	lilv_instance_run_segmented(fixture_instance, buffers, queue, 0, 8, 3);
+	TEST_ASSERT(*lilv_port_buffers_get_control(buffers, 1) == 3.0f);
+	TEST_ASSERT(*lilv_port_buffers_get_control(buffers, 0) == 3.0f);
+
+	// A later event stays queued until the block that contains frame 20
+	lilv_instance_run_segmented(fixture_instance, buffers, queue, 8, 12, 1);
+	TEST_ASSERT(*lilv_port_buffers_get_control(buffers, 0) == 3.0f);
+	lilv_instance_run_segmented(fixture_instance, buffers, queue, 20, 8, 1);
+	TEST_ASSERT(*lilv_port_buffers_get_control(buffers, 1) == 4.0f);
+
+	// A late event is applied at the start of the next block
+	TEST_ASSERT(!lilv_control_queue_push(queue, 0, 10, 5.0f));
+	lilv_instance_run_segmented(fixture_instance, buffers, queue, 28, 8, 1);
+	TEST_ASSERT(*lilv_port_buffers_get_control(buffers, 1) == 5.0f);
+
+	lilv_control_queue_free(queue);
+	lilv_port_buffers_free(buffers);
+
+	cleanup_test_instance();
+	return 1;
+}
+
+/*****************************************************************************/
+
+static int
+test_run_stats(void)
+{
+	TEST_ASSERT(start_test_instance());
+
+	// Time runs, with no budget so nothing overruns
+	LilvRunStats run_stats;
+	TEST_ASSERT(lilv_instance_get_run_stats(fixture_instance, &run_stats));
+	lilv_instance_enable_run_stats(fixture_instance, 0);
+	for (unsigned i = 0; i < 3; ++i) {
+		lilv_instance_run_timed(fixture_instance, 1);
+	}
+	TEST_ASSERT(!lilv_instance_get_run_stats(fixture_instance, &run_stats));
+	TEST_ASSERT(run_stats.n_runs == 3);
+	TEST_ASSERT(run_stats.n_overruns == 0);
+	uint64_t n_timed = 0;
+	for (unsigned i = 0; i < LILV_RUN_STATS_BUCKETS; ++i) {
+		n_timed += run_stats.histogram[i];
+	}
+	TEST_ASSERT(n_timed == 3);
+	TEST_ASSERT(lilv_run_stats_get_percentile(&run_stats, 50.0) <=
+	            run_stats.max_ns);
+	TEST_ASSERT(lilv_run_stats_bucket_min(16) == 16);
+	TEST_ASSERT(lilv_run_stats_bucket_min(33) == 34);
+
+	cleanup_test_instance();
+	return 1;
+}
+
+/*****************************************************************************/
+
+static int
+test_graph(void)
+{
+	const LilvPlugin* plugin = load_test_plugin();
+	TEST_ASSERT(plugin);
+
+	// Run a graph where node 2 reads the output of node 0
+	LilvInstance* instances[3];
+	float         ins[3]  = { 2.0f, 3.0f, 0.0f };
+	float         outs[3] = { 0.0f, 0.0f, 0.0f };
+	LilvGraph*    graph   = lilv_graph_new(2);
+	for (unsigned i = 0; i < 3; ++i) {
+		instances[i] = lilv_plugin_instantiate(plugin, 48000.0, test_features);
+		TEST_ASSERT(instances[i]);
+		lilv_instance_connect_port(instances[i], 0, i == 2 ? &outs[0] : &ins[i]);
+		lilv_instance_connect_port(instances[i], 1, &outs[i]);
+		lilv_instance_activate(instances[i]);
+		TEST_ASSERT(lilv_graph_add_node(graph, instances[i]) == i);
+	}
+	TEST_ASSERT(!lilv_graph_connect(graph, 0, 1, 2, 0));
+	TEST_ASSERT(lilv_graph_connect(graph, 0, 1, 0, 0));
+	TEST_ASSERT(lilv_graph_run(graph, 1));
+	TEST_ASSERT(!lilv_graph_compile(graph));
+	TEST_ASSERT(!lilv_graph_run(graph, 1));
+	TEST_ASSERT(outs[0] == 2.0f);
+	TEST_ASSERT(outs[1] == 3.0f);
+	TEST_ASSERT(outs[2] == 2.0f);
+	TEST_ASSERT(lilv_graph_get_node_time(graph, 0) >= 0.0);
+
+	// Cycles are rejected
+	TEST_ASSERT(!lilv_graph_connect(graph, 2, 1, 0, 0));
+	TEST_ASSERT(lilv_graph_compile(graph));
+	lilv_graph_free(graph);
+	for (unsigned i = 0; i < 3; ++i) {
+		lilv_instance_deactivate(instances[i]);
+		lilv_instance_free(instances[i]);
+	}
+
+	free_uri_map();
+	return 1;
+}
+
+/*****************************************************************************/
+
 static int
 test_bad_port_symbol(void)
 {
@@ -1940,6 +2877,190 @@ test_world(void)
 
 /*****************************************************************************/
 
+#define FREEZE_N_THREADS 8
+#define FREEZE_N_ROUNDS  200
+
+typedef struct {
+	const LilvPlugin* plugin;
+	const LilvNode*   doap_name;
+	unsigned          n_failures;
+} FreezeThreadData;
+
+static int
+count_matches(const LilvNode* node, void* data)
+{
+	++*(unsigned*)data;
+	return 0;
+}
+
+static void*
+freeze_thread(void* arg)
+{
+	// TEST_ASSERT is not thread-safe, so count failures locally
+	FreezeThreadData* data = (FreezeThreadData*)arg;
+	const LilvPlugin* plug = data->plugin;
+	LilvNode*         min  = NULL;
+	LilvNode*         max  = NULL;
+	LilvNode*         def  = NULL;
+	for (unsigned i = 0; i < FREEZE_N_ROUNDS; ++i) {
+		LilvNode* name = lilv_plugin_get_name(plug);
+		if (!name || strcmp(lilv_node_as_string(name), "Test plugin")) {
+			++data->n_failures;
+		}
+		lilv_node_free(name);
+
+		if (lilv_plugin_get_num_ports(plug) != 2 ||
+		    !lilv_plugin_get_class(plug)) {
+			++data->n_failures;
+		}
+
+		const LilvPort* port  = lilv_plugin_get_port_by_index(plug, 0);
+		LilvNode*       pname = lilv_port_get_name(plug, port);
+		if (!pname || strcmp(lilv_node_as_string(pname), "Gain")) {
+			++data->n_failures;
+		}
+		lilv_node_free(pname);
+
+		lilv_port_get_range(plug, port, &def, &min, &max);
+		if (!min || !max || !def || lilv_node_as_float(max) != 2.0f) {
+			++data->n_failures;
+		}
+		lilv_node_free(def);
+		lilv_node_free(min);
+		lilv_node_free(max);
+
+		unsigned n_names = 0;
+		lilv_plugin_foreach_value(plug, data->doap_name,
+		                          count_matches, &n_names);
+		if (n_names != 1) {
+			++data->n_failures;
+		}
+	}
+	return NULL;
+}
+
+static int
+test_freeze(void)
+{
+	if (!start_bundle(MANIFEST_PREFIXES
+			":plug a lv2:Plugin ; lv2:binary <foo" SHLIB_EXT "> ; rdfs:seeAlso <plugin.ttl> .\n",
+			BUNDLE_PREFIXES
+			":plug a lv2:Plugin ; "
+			PLUGIN_NAME("Test plugin") " ; "
+			LICENSE_GPL " ; "
+			"lv2:port [ "
+			"  a lv2:ControlPort ; a lv2:InputPort ; "
+			"  lv2:index 0 ; lv2:symbol \"gain\" ; lv2:name \"Gain\" ; "
+			"  lv2:minimum 0.0 ; lv2:maximum 2.0 ; lv2:default 1.0 "
+			"] , [ "
+			"  a lv2:AudioPort ; a lv2:OutputPort ; "
+			"  lv2:index 1 ; lv2:symbol \"out\" ; lv2:name \"Out\" "
+			"] ."))
+		return 0;
+
+	init_uris();
+	const LilvPlugins* plugins = lilv_world_get_all_plugins(world);
+	const LilvPlugin*  plug    = lilv_plugins_get_by_uri(plugins, plugin_uri_value);
+	TEST_ASSERT(plug);
+
+	LilvNode* doap_name = lilv_new_uri(world, LILV_NS_DOAP "name");
+
+	TEST_ASSERT(!lilv_world_is_frozen(world));
+	TEST_ASSERT(!lilv_world_freeze(world));
+	TEST_ASSERT(lilv_world_is_frozen(world));
+
+	// Mutating the world is no longer allowed
+	TEST_ASSERT(lilv_world_load_resource(world, plugin_uri_value) == -1);
+
+	// Nodes from the world are pinned rather than referenced
+	LilvNode* name     = lilv_plugin_get_name(plug);
+	LilvNode* dup      = lilv_node_duplicate(name);
+	LilvNode* expected = lilv_new_string(world, "Test plugin");
+	TEST_ASSERT(name->pinned && dup->pinned && dup->node == name->node);
+	TEST_ASSERT(!expected->pinned);
+	TEST_ASSERT(lilv_node_equals(name, expected));
+	lilv_node_free(expected);
+	lilv_node_free(dup);
+	lilv_node_free(name);
+
+	ZixThread        threads[FREEZE_N_THREADS];
+	FreezeThreadData data[FREEZE_N_THREADS];
+	for (unsigned i = 0; i < FREEZE_N_THREADS; ++i) {
+		data[i].plugin     = plug;
+		data[i].doap_name  = doap_name;
+		data[i].n_failures = 0;
+		TEST_ASSERT(!zix_thread_create(&threads[i], 0, freeze_thread, &data[i]));
+	}
+
+	for (unsigned i = 0; i < FREEZE_N_THREADS; ++i) {
+		TEST_ASSERT(!zix_thread_join(threads[i], NULL));
+		TEST_ASSERT(data[i].n_failures == 0);
+	}
+
+	lilv_node_free(doap_name);
+	cleanup_uris();
+	return 1;
+}
+
+/*****************************************************************************/
+
+static int
+count_preset_labels(const LilvNode* const* bindings, void* data)
+{
+	TEST_ASSERT(lilv_node_is_uri(bindings[0]));
+	TEST_ASSERT(lilv_node_is_string(bindings[1]));
+	++*(unsigned*)data;
+	return 0;
+}
+
+static int
+test_query(void)
+{
+	if (!start_bundle(MANIFEST_PREFIXES PREFIX_PSET
+			":plug a lv2:Plugin ; lv2:binary <foo" SHLIB_EXT "> ; rdfs:seeAlso <plugin.ttl> .\n"
+			":preset1 a pset:Preset ; lv2:appliesTo :plug ; rdfs:label \"One\" .\n"
+			":preset2 a pset:Preset ; lv2:appliesTo :plug ; rdfs:label \"Two\" .\n"
+			":preset3 a pset:Preset ; lv2:appliesTo :other ; rdfs:label \"Three\" .\n"
+			":preset4 a pset:Preset ; lv2:appliesTo :plug .\n",
+			BUNDLE_PREFIXES
+			":plug a lv2:Plugin ; "
+			PLUGIN_NAME("Test plugin") " ; "
+			LICENSE_GPL " . "))
+		return 0;
+
+	init_uris();
+
+	LilvNode* rdf_type    = lilv_new_uri(world, LILV_NS_RDF "type");
+	LilvNode* rdfs_label  = lilv_new_uri(world, LILV_NS_RDFS "label");
+	LilvNode* applies_to  = lilv_new_uri(world, LILV_NS_LV2 "appliesTo");
+	LilvNode* pset_Preset = lilv_new_uri(world, LV2_PRESETS__Preset);
+
+	const LilvQueryPattern patterns[] = {
+		{ { NULL, 0 }, { rdf_type, 0 },   { pset_Preset, 0 } },
+		{ { NULL, 0 }, { applies_to, 0 }, { plugin_uri_value, 0 } },
+		{ { NULL, 0 }, { rdfs_label, 0 }, { NULL, 1 } } };
+
+	unsigned n_labels = 0;
+	TEST_ASSERT(lilv_world_query(world, 3, patterns, 2,
+	                             count_preset_labels, &n_labels) == 2);
+	TEST_ASSERT(n_labels == 2);
+
+	// Only the first two patterns, without a callback
+	TEST_ASSERT(lilv_world_query(world, 2, patterns, 1, NULL, NULL) == 3);
+
+	// Invalid variable index
+	TEST_ASSERT(lilv_world_query(world, 3, patterns, 1, NULL, NULL) == 0);
+
+	lilv_node_free(pset_Preset);
+	lilv_node_free(applies_to);
+	lilv_node_free(rdfs_label);
+	lilv_node_free(rdf_type);
+	cleanup_uris();
+	return 1;
+}
+
+/*****************************************************************************/
+
 static int
 test_reload_bundle(void)
 {
@@ -2024,13 +3145,31 @@ static struct TestCase tests[] = {
 	TEST_CASE(preset),
 	TEST_CASE(prototype),
 	TEST_CASE(port),
+	TEST_CASE(port_buffers),
+	TEST_CASE(buffer_plan),
 	TEST_CASE(ui),
 	TEST_CASE(bad_port_symbol),
 	TEST_CASE(bad_port_index),
 	TEST_CASE(bad_port_index),
 	TEST_CASE(string),
 	TEST_CASE(world),
+	TEST_CASE(query),
+	TEST_CASE(freeze),
 	TEST_CASE(state),
+	TEST_CASE(preset_loader),
+	TEST_CASE(snapshot),
+	TEST_CASE(state_saver),
+	TEST_CASE(state_hash),
+	TEST_CASE(save_batch),
+	TEST_CASE(binary_state),
+	TEST_CASE(delta_state),
+	TEST_CASE(preload),
+	TEST_CASE(instantiate_batch),
+	TEST_CASE(instance_pool),
+	TEST_CASE(graph),
+	TEST_CASE(worker),
+	TEST_CASE(control_queue),
+	TEST_CASE(run_stats),
 	TEST_CASE(reload_bundle),
 	{ NULL, NULL }
 };
@@ -23,6 +23,7 @@
 #include "lv2/lv2plug.in/ns/ext/atom/atom.h"
 #include "lv2/lv2plug.in/ns/ext/state/state.h"
 #include "lv2/lv2plug.in/ns/ext/urid/urid.h"
+#include "lv2/lv2plug.in/ns/ext/worker/worker.h"
 #include "lv2/lv2plug.in/ns/lv2core/lv2.h"
 
 #define TEST_URI "http://example.org/lilv-test-plugin"
@@ -33,7 +34,8 @@ enum {
 };
 
 typedef struct {
-	LV2_URID_Map* map;
+	LV2_URID_Map*        map;
+	LV2_Worker_Schedule* schedule;
 
 	struct {
 		LV2_URID atom_Float;
@@ -90,6 +92,7 @@ instantiate(const LV2_Descriptor*     descriptor,
 	}
 
 	test->map           = NULL;
+	test->schedule      = NULL;
 	test->input         = NULL;
 	test->output        = NULL;
 	test->num_runs      = 0;
@@ -108,6 +111,8 @@ instantiate(const LV2_Descriptor*     descriptor,
 				test->map->handle, LV2_ATOM__Float);
 		} else if (!strcmp(features[i]->URI, LV2_STATE__makePath)) {
 			make_path = (LV2_State_Make_Path*)features[i]->data;
+		} else if (!strcmp(features[i]->URI, LV2_WORKER__schedule)) {
+			test->schedule = (LV2_Worker_Schedule*)features[i]->data;
 		}
 	}
 
@@ -144,9 +149,38 @@ run(LV2_Handle instance,
 		fseek(test->rec_file, 0, SEEK_SET);
 		fprintf(test->rec_file, "X");
 		fseek(test->rec_file, 0, SEEK_END);
+	} else if (sample_count == 4 && test->schedule) {
+		// Schedule work, the response is written to the output
+		test->schedule->schedule_work(
+			test->schedule->handle, sizeof(float), test->input);
 	}
 }
 
+static LV2_Worker_Status
+work(LV2_Handle                  instance,
+     LV2_Worker_Respond_Function respond,
+     LV2_Worker_Respond_Handle   handle,
+     uint32_t                    size,
+     const void*                 data)
+{
+	if (size != sizeof(float)) {
+		return LV2_WORKER_ERR_UNKNOWN;
+	}
+
+	const float value = *(const float*)data * 2.0f;
+	return respond(handle, sizeof(value), &value);
+}
+
+static LV2_Worker_Status
+work_response(LV2_Handle  instance,
+              uint32_t    size,
+              const void* body)
+{
+	Test* test = (Test*)instance;
+	*test->output = *(const float*)body;
+	return LV2_WORKER_SUCCESS;
+}
+
 static uint32_t
 map_uri(Test* plugin, const char* uri)
 {
@@ -354,9 +388,12 @@ restore(LV2_Handle                  instance,
 static const void*
 extension_data(const char* uri)
 {
-	static const LV2_State_Interface state = { save, restore };
+	static const LV2_State_Interface  state  = { save, restore };
+	static const LV2_Worker_Interface worker = { work, work_response, NULL };
 	if (!strcmp(uri, LV2_STATE__interface)) {
 		return &state;
+	} else if (!strcmp(uri, LV2_WORKER__interface)) {
+		return &worker;
 	}
 	return NULL;
 }
@@ -0,0 +1,167 @@
+/*
+  Copyright 2016 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+/**
+   @file lilv-file-bench.c Benchmark of the file primitives used to save state.
+
+   This uses internal functions, so it is built with the unit tests against
+   the static library rather than installed.
+*/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lilv_internal.h"
+#include "bench.h"
+
+#define BLOCK_SIZE 65536
+
+/** Compare files a byte at a time, like lilv_file_equals() used to. */
+static bool
+naive_file_equals(const char* a_path, const char* b_path)
+{
+	FILE* a_file = fopen(a_path, "rb");
+	FILE* b_file = fopen(b_path, "rb");
+	bool  match  = a_file && b_file;
+	while (match && !feof(a_file) && !feof(b_file)) {
+		if (fgetc(a_file) != fgetc(b_file)) {
+			match = false;
+		}
+	}
+	if (a_file) {
+		fclose(a_file);
+	}
+	if (b_file) {
+		fclose(b_file);
+	}
+	return match;
+}
+
+/** Copy a file a page at a time, like lilv_copy_file() used to. */
+static int
+naive_copy_file(const char* src, const char* dst)
+{
+	FILE* in  = fopen(src, "rb");
+	FILE* out = fopen(dst, "wb");
+	char  page[4096];
+	int   st  = (in && out) ? 0 : 1;
+	for (size_t n = 0; !st && (n = fread(page, 1, sizeof(page), in)) > 0;) {
+		st = fwrite(page, 1, n, out) != n;
+	}
+	if (in) {
+		fclose(in);
+	}
+	if (out) {
+		fclose(out);
+	}
+	return st;
+}
+
+static int
+write_test_file(const char* path, size_t size)
+{
+	FILE* fd = fopen(path, "wb");
+	if (!fd) {
+		return 1;
+	}
+
+	uint32_t* block = (uint32_t*)malloc(BLOCK_SIZE);
+	uint32_t  x     = 1;
+	for (size_t written = 0; written < size; written += BLOCK_SIZE) {
+		for (size_t i = 0; i < BLOCK_SIZE / sizeof(uint32_t); ++i) {
+			x ^= x << 13;  // Xorshift, so the data does not compress
+			x ^= x >> 17;
+			x ^= x << 5;
+			block[i] = x;
+		}
+		const size_t n = (size - written < BLOCK_SIZE)
+			? size - written : BLOCK_SIZE;
+		fwrite(block, 1, n, fd);
+	}
+
+	free(block);
+	return fclose(fd);
+}
+
+static void
+print_usage(void)
+{
+	printf("lilv-file-bench - Benchmark file comparison and copying.\n");
+	printf("Usage: lilv-file-bench [OPTIONS] [DIRECTORY]\n");
+	printf("\n");
+	printf("  -s MEGABYTES  Size of test files (default 1024).\n");
+	printf("  -h, --help    Display this help and exit.\n");
+}
+
+int
+main(int argc, char** argv)
+{
+	size_t      n_megabytes = 1024;
+	const char* dir         = ".";
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+			print_usage();
+			return 0;
+		} else if (!strcmp(argv[i], "-s") && (i + 1 < argc)) {
+			n_megabytes = strtoul(argv[++i], NULL, 10);
+		} else if (argv[i][0] != '-') {
+			dir = argv[i];
+		} else {
+			print_usage();
+			return 1;
+		}
+	}
+
+	char* const a_path = lilv_path_join(dir, "lilv-file-bench-a");
+	char* const b_path = lilv_path_join(dir, "lilv-file-bench-b");
+	char* const c_path = lilv_path_join(dir, "lilv-file-bench-c");
+	if (write_test_file(a_path, n_megabytes << 20)) {
+		fprintf(stderr, "Failed to write %s\n", a_path);
+		return 1;
+	}
+
+	struct timespec ts         = bench_start();
+	const int       naive_copy = naive_copy_file(a_path, b_path);
+	const double    naive_copy_time = bench_end(&ts);
+
+	ts = bench_start();
+	const int    copy      = lilv_copy_file(a_path, c_path);
+	const double copy_time = bench_end(&ts);
+
+	ts = bench_start();
+	const bool   naive_equals      = naive_file_equals(a_path, b_path);
+	const double naive_equals_time = bench_end(&ts);
+
+	ts = bench_start();
+	const bool   equals      = lilv_file_equals(b_path, c_path);
+	const double equals_time = bench_end(&ts);
+
+	printf("# Megabytes Operation Naive Lilv\n");
+	printf("%zu copy %lf %lf\n", n_megabytes, naive_copy_time, copy_time);
+	printf("%zu equals %lf %lf\n", n_megabytes, naive_equals_time, equals_time);
+
+	remove(a_path);
+	remove(b_path);
+	remove(c_path);
+	free(a_path);
+	free(b_path);
+	free(c_path);
+
+	return (naive_copy || copy || !naive_equals || !equals) ? 1 : 0;
+}
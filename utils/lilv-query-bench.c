@@ -0,0 +1,160 @@
+/*
+  Copyright 2016 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lilv/lilv.h"
+#include "lv2/lv2plug.in/ns/ext/presets/presets.h"
+
+#include "lilv_config.h"
+#include "bench.h"
+
+static LilvNode* lv2_appliesTo = NULL;
+static LilvNode* pset_Preset   = NULL;
+static LilvNode* rdf_type      = NULL;
+static LilvNode* rdfs_label    = NULL;
+
+static void
+print_usage(void)
+{
+	printf("lilv-query-bench - Benchmark preset queries on installed plugins.\n");
+	printf("Usage: lilv-query-bench [OPTIONS]\n");
+	printf("\n");
+	printf("  -n ITERATIONS  Number of times to run each query.\n");
+	printf("  -h, --help     Display this help and exit.\n");
+}
+
+/** Count preset labels with nested lilv_world_find_nodes() loops. */
+static unsigned
+count_nested(LilvWorld* world, const LilvNode* plugin_uri)
+{
+	unsigned   n_labels = 0;
+	LilvNodes* presets  = lilv_world_find_nodes(
+		world, NULL, lv2_appliesTo, plugin_uri);
+	LILV_FOREACH(nodes, i, presets) {
+		const LilvNode* preset = lilv_nodes_get(presets, i);
+		if (lilv_world_ask(world, preset, rdf_type, pset_Preset)) {
+			LilvNodes* labels = lilv_world_find_nodes(
+				world, preset, rdfs_label, NULL);
+			n_labels += lilv_nodes_size(labels);
+			lilv_nodes_free(labels);
+		}
+	}
+	lilv_nodes_free(presets);
+	return n_labels;
+}
+
+/** Count preset labels with a single lilv_world_query(). */
+static unsigned
+count_query(LilvWorld* world, const LilvNode* plugin_uri)
+{
+	const LilvQueryPattern patterns[] = {
+		{ { NULL, 0 }, { rdf_type, 0 },      { pset_Preset, 0 } },
+		{ { NULL, 0 }, { lv2_appliesTo, 0 }, { plugin_uri, 0 } },
+		{ { NULL, 0 }, { rdfs_label, 0 },    { NULL, 1 } } };
+
+	return lilv_world_query(world, 3, patterns, 2, NULL, NULL);
+}
+
+static double
+bench(LilvWorld* world,
+      unsigned (*count)(LilvWorld*, const LilvNode*),
+      unsigned   n_iterations,
+      unsigned*  n_labels)
+{
+	const LilvPlugins* plugins = lilv_world_get_all_plugins(world);
+	struct timespec    ts      = bench_start();
+
+	*n_labels = 0;
+	for (unsigned i = 0; i < n_iterations; ++i) {
+		LILV_FOREACH(plugins, p, plugins) {
+			const LilvPlugin* plugin = lilv_plugins_get(plugins, p);
+			*n_labels += count(world, lilv_plugin_get_uri(plugin));
+		}
+	}
+
+	return bench_end(&ts);
+}
+
+int
+main(int argc, char** argv)
+{
+	unsigned n_iterations = 100;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+			print_usage();
+			return 0;
+		} else if (!strcmp(argv[i], "-n") && (i + 1 < argc)) {
+			n_iterations = atoi(argv[++i]);
+		} else {
+			print_usage();
+			return 1;
+		}
+	}
+
+	LilvWorld* world = lilv_world_new();
+
+	// Queries do not filter by language, so compare against all labels
+	LilvNode* no = lilv_new_bool(world, false);
+	lilv_world_set_option(world, LILV_OPTION_FILTER_LANG, no);
+	lilv_node_free(no);
+
+	lilv_world_load_all(world);
+
+	lv2_appliesTo = lilv_new_uri(world, LILV_NS_LV2 "appliesTo");
+	pset_Preset   = lilv_new_uri(world, LV2_PRESETS__Preset);
+	rdf_type      = lilv_new_uri(world, LILV_NS_RDF "type");
+	rdfs_label    = lilv_new_uri(world, LILV_NS_RDFS "label");
+
+	// Load all presets so labels not in manifests are available
+	unsigned           n_presets = 0;
+	const LilvPlugins* plugins   = lilv_world_get_all_plugins(world);
+	LILV_FOREACH(plugins, p, plugins) {
+		const LilvPlugin* plugin  = lilv_plugins_get(plugins, p);
+		LilvNodes*        presets = lilv_plugin_get_related(plugin, pset_Preset);
+		LILV_FOREACH(nodes, i, presets) {
+			lilv_world_load_resource(world, lilv_nodes_get(presets, i));
+			++n_presets;
+		}
+		lilv_nodes_free(presets);
+	}
+
+	unsigned     nested_labels = 0;
+	unsigned     query_labels  = 0;
+	const double nested_time   = bench(
+		world, count_nested, n_iterations, &nested_labels);
+	const double query_time    = bench(
+		world, count_query, n_iterations, &query_labels);
+
+	printf("# Plugins Presets Iterations Method Labels Time\n");
+	printf("%u %u %u find_nodes %u %lf\n", lilv_plugins_size(plugins),
+	       n_presets, n_iterations, nested_labels, nested_time);
+	printf("%u %u %u query %u %lf\n", lilv_plugins_size(plugins),
+	       n_presets, n_iterations, query_labels, query_time);
+
+	lilv_node_free(rdfs_label);
+	lilv_node_free(rdf_type);
+	lilv_node_free(pset_Preset);
+	lilv_node_free(lv2_appliesTo);
+
+	lilv_world_free(world);
+
+	return (nested_labels == query_labels) ? 0 : 1;
+}
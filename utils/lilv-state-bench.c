@@ -0,0 +1,171 @@
+/*
+  Copyright 2016 David Robillard <http://drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#define _POSIX_C_SOURCE 199309L
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lilv/lilv.h"
+#include "lv2/lv2plug.in/ns/ext/atom/atom.h"
+#include "lv2/lv2plug.in/ns/ext/options/options.h"
+#include "lv2/lv2plug.in/ns/ext/urid/urid.h"
+
+#include "lilv_config.h"
+#include "bench.h"
+#include "uri_table.h"
+
+#define STATE_BENCH_URI "http://example.org/lilv-state-bench-plugin"
+
+#ifndef LILV_STATE_BENCH_BUNDLE
+#    define LILV_STATE_BENCH_BUNDLE NULL
+#endif
+
+/** Load the bundle at `path` into `world` if it exists. */
+static void
+load_bundle(LilvWorld* world, const char* path)
+{
+	const size_t len           = strlen(path);
+	char*        manifest_path = (char*)malloc(len + sizeof("/manifest.ttl"));
+	memcpy(manifest_path, path, len);
+	memcpy(manifest_path + len, "/manifest.ttl", sizeof("/manifest.ttl"));
+
+	FILE* manifest = fopen(manifest_path, "r");
+	if (manifest) {
+		fclose(manifest);
+		LilvNode* bundle = lilv_new_file_uri(world, NULL, path);
+		lilv_world_load_bundle(world, bundle);
+		lilv_node_free(bundle);
+	}
+	free(manifest_path);
+}
+
+static void
+print_usage(void)
+{
+	printf("lilv-state-bench - Benchmark state save and restore.\n");
+	printf("Usage: lilv-state-bench [OPTIONS]\n");
+	printf("\n");
+	printf("  -b BUNDLE      Load synthetic plugin from BUNDLE.\n");
+	printf("  -n ITERATIONS  Number of times to save and restore.\n");
+	printf("  -p PROPERTIES  Number of properties in synthetic plugin state.\n");
+	printf("  -h, --help     Display this help and exit.\n");
+}
+
+int
+main(int argc, char** argv)
+{
+	const char* bundle_path  = LILV_STATE_BENCH_BUNDLE;
+	unsigned    n_iterations = 100;
+	unsigned    n_props      = 5000;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+			print_usage();
+			return 0;
+		} else if (!strcmp(argv[i], "-b") && (i + 1 < argc)) {
+			bundle_path = argv[++i];
+		} else if (!strcmp(argv[i], "-n") && (i + 1 < argc)) {
+			n_iterations = atoi(argv[++i]);
+		} else if (!strcmp(argv[i], "-p") && (i + 1 < argc)) {
+			n_props = atoi(argv[++i]);
+		} else {
+			print_usage();
+			return 1;
+		}
+	}
+
+	LilvWorld* world = lilv_world_new();
+	lilv_world_load_all(world);
+	if (bundle_path) {
+		load_bundle(world, bundle_path);
+	}
+
+	LilvNode*         plugin_uri = lilv_new_uri(world, STATE_BENCH_URI);
+	const LilvPlugin* plugin     = lilv_plugins_get_by_uri(
+		lilv_world_get_all_plugins(world), plugin_uri);
+	lilv_node_free(plugin_uri);
+	if (!plugin) {
+		fprintf(stderr, "Plugin <%s> not found, skipping.\n", STATE_BENCH_URI);
+		lilv_world_free(world);
+		return 0;
+	}
+
+	URITable uri_table;
+	uri_table_init(&uri_table);
+
+	LV2_URID_Map  map           = { &uri_table, uri_table_map };
+	LV2_Feature   map_feature   = { LV2_URID__map, &map };
+	const int32_t n_props_value = (int32_t)n_props;
+
+	// Pass the number of properties to the plugin as an option
+	LV2_Options_Option options[] = {
+		{ LV2_OPTIONS_INSTANCE, 0,
+		  uri_table_map(&uri_table, STATE_BENCH_URI "#properties"),
+		  sizeof(int32_t), uri_table_map(&uri_table, LV2_ATOM__Int),
+		  &n_props_value },
+		{ LV2_OPTIONS_INSTANCE, 0, 0, 0, 0, NULL } };
+
+	LV2_Feature        options_feature = { LV2_OPTIONS__options, options };
+	const LV2_Feature* features[]      = {
+		&map_feature, &options_feature, NULL };
+
+	LilvInstance* instance = lilv_plugin_instantiate(plugin, 48000.0, features);
+	if (!instance) {
+		fprintf(stderr, "Failed to instantiate <%s>, skipping.\n",
+		        STATE_BENCH_URI);
+		uri_table_destroy(&uri_table);
+		lilv_world_free(world);
+		return 0;
+	}
+
+	float restored = 0.0f;
+	lilv_instance_connect_port(instance, 0, &restored);
+
+	double save_time    = 0.0;
+	double restore_time = 0.0;
+	double free_time    = 0.0;
+	for (unsigned i = 0; i < n_iterations; ++i) {
+		struct timespec ts    = bench_start();
+		LilvState*      state = lilv_state_new_from_instance(
+			plugin, instance, &map, NULL, NULL, NULL, NULL,
+			NULL, NULL, 0, features);
+		save_time += bench_end(&ts);
+
+		ts = bench_start();
+		lilv_state_restore(state, instance, NULL, NULL, 0, features);
+		restore_time += bench_end(&ts);
+
+		ts = bench_start();
+		lilv_state_free(state);
+		free_time += bench_end(&ts);
+	}
+
+	// The plugin outputs the number of properties found by the last restore
+	lilv_instance_run(instance, 1);
+
+	printf("# Properties Iterations Save Restore Free\n");
+	printf("%u %u %lf %lf %lf\n",
+	       n_props, n_iterations, save_time, restore_time, free_time);
+
+	const bool success = !n_iterations || (uint32_t)restored == n_props;
+
+	lilv_instance_free(instance);
+	uri_table_destroy(&uri_table);
+	lilv_world_free(world);
+
+	return success ? 0 : 1;
+}
@@ -21,20 +21,13 @@
 #include <string.h>
 
 #include "lilv/lilv.h"
-#include "lv2/lv2plug.in/ns/ext/atom/atom.h"
+#include "lilv/portbuffers.h"
 
 #include "lilv_config.h"
 #include "bench.h"
 #include "uri_table.h"
 
-static LilvNode* atom_AtomPort   = NULL;
-static LilvNode* atom_Sequence   = NULL;
-static LilvNode* lv2_AudioPort   = NULL;
-static LilvNode* lv2_CVPort      = NULL;
-static LilvNode* lv2_ControlPort = NULL;
-static LilvNode* lv2_InputPort   = NULL;
-static LilvNode* lv2_OutputPort  = NULL;
-static LilvNode* urid_map        = NULL;
+static LilvNode* urid_map = NULL;
 
 static bool full_output = false;
 
@@ -74,19 +67,6 @@ bench(const LilvPlugin* p, uint32_t sample_count, uint32_t block_size)
 	LV2_Feature        unmap_feature = { LV2_URID_UNMAP_URI, &unmap };
 	const LV2_Feature* features[]    = { &map_feature, &unmap_feature, NULL };
 
-	float* const buf = (float*)calloc(block_size * 2, sizeof(float));
-	float* const in  = buf;
-	float* const out = buf + block_size;
-	if (!buf) {
-		fprintf(stderr, "Out of memory\n");
-		return 0.0;
-	}
-
-	LV2_Atom_Sequence seq = {
-		{ sizeof(LV2_Atom_Sequence_Body),
-		  uri_table_map(&uri_table, LV2_ATOM__Sequence) },
-		{ 0, 0 } };
-
 	const char* uri      = lilv_node_as_string(lilv_plugin_get_uri(p));
 	LilvNodes*  required = lilv_plugin_get_required_features(p);
 	LILV_FOREACH(nodes, i, required) {
@@ -94,7 +74,6 @@ bench(const LilvPlugin* p, uint32_t sample_count, uint32_t block_size)
 		if (!lilv_node_equals(feature, urid_map)) {
 			fprintf(stderr, "<%s> requires feature <%s>, skipping\n",
 			        uri, lilv_node_as_uri(feature));
-			free(buf);
 			uri_table_destroy(&uri_table);
 			return 0.0;
 		}
@@ -104,49 +83,33 @@ bench(const LilvPlugin* p, uint32_t sample_count, uint32_t block_size)
 	if (!instance) {
 		fprintf(stderr, "Failed to instantiate <%s>\n",
 		        lilv_node_as_uri(lilv_plugin_get_uri(p)));
-		free(buf);
 		uri_table_destroy(&uri_table);
 		return 0.0;
 	}
 
-	float* controls = (float*)calloc(
-		lilv_plugin_get_num_ports(p), sizeof(float));
-	lilv_plugin_get_port_ranges_float(p, NULL, NULL, controls);
+	LilvPortBuffers* buffers = lilv_instance_auto_connect(
+		instance, p, &map, block_size);
+	if (!buffers) {
+		fprintf(stderr, "Failed to allocate buffers for <%s>\n", uri);
+		lilv_instance_free(instance);
+		uri_table_destroy(&uri_table);
+		return 0.0;
+	}
 
 	const uint32_t n_ports = lilv_plugin_get_num_ports(p);
 	for (uint32_t index = 0; index < n_ports; ++index) {
-		const LilvPort* port = lilv_plugin_get_port_by_index(p, index);
-		if (lilv_port_is_a(p, port, lv2_ControlPort)) {
-			lilv_instance_connect_port(instance, index, &controls[index]);
-		} else if (lilv_port_is_a(p, port, lv2_AudioPort) ||
-		           lilv_port_is_a(p, port, lv2_CVPort)) {
-			if (lilv_port_is_a(p, port, lv2_InputPort)) {
-				lilv_instance_connect_port(instance, index, in);
-			} else if (lilv_port_is_a(p, port, lv2_OutputPort)) {
-				lilv_instance_connect_port(instance, index, out);
-			} else {
-				fprintf(stderr, "<%s> port %d neither input nor output, skipping\n",
-				        uri, index);
-				lilv_instance_free(instance);
-				free(buf);
-				free(controls);
-				uri_table_destroy(&uri_table);
-				return 0.0;
-			}
-		} else if (lilv_port_is_a(p, port, atom_AtomPort)) {
-			lilv_instance_connect_port(instance, index, &seq);
-		} else {
+		if (!lilv_port_buffers_get_type(buffers, index)) {
 			fprintf(stderr, "<%s> port %d has unknown type, skipping\n",
 			        uri, index);
 			lilv_instance_free(instance);
-			free(buf);
-			free(controls);
+			lilv_port_buffers_free(buffers);
 			uri_table_destroy(&uri_table);
 			return 0.0;
 		}
 	}
 
 	lilv_instance_activate(instance);
+	lilv_port_buffers_reset(buffers);
 
 	struct timespec ts = bench_start();
 	for (uint32_t i = 0; i < (sample_count / block_size); ++i) {
@@ -156,6 +119,7 @@ bench(const LilvPlugin* p, uint32_t sample_count, uint32_t block_size)
 
 	lilv_instance_deactivate(instance);
 	lilv_instance_free(instance);
+	lilv_port_buffers_free(buffers);
 
 	uri_table_destroy(&uri_table);
 
@@ -164,8 +128,6 @@ bench(const LilvPlugin* p, uint32_t sample_count, uint32_t block_size)
 	}
 	printf("%lf %s\n", elapsed, uri);
 
-	free(buf);
-	free(controls);
 	return elapsed;
 }
 
@@ -197,14 +159,7 @@ main(int argc, char** argv)
 	LilvWorld* world = lilv_world_new();
 	lilv_world_load_all(world);
 
-	atom_AtomPort   = lilv_new_uri(world, LV2_ATOM__AtomPort);
-	atom_Sequence   = lilv_new_uri(world, LV2_ATOM__Sequence);
-	lv2_AudioPort   = lilv_new_uri(world, LV2_CORE__AudioPort);
-	lv2_CVPort      = lilv_new_uri(world, LV2_CORE__CVPort);
-	lv2_ControlPort = lilv_new_uri(world, LV2_CORE__ControlPort);
-	lv2_InputPort   = lilv_new_uri(world, LV2_CORE__InputPort);
-	lv2_OutputPort  = lilv_new_uri(world, LV2_CORE__OutputPort);
-	urid_map        = lilv_new_uri(world, LV2_URID__map);
+	urid_map = lilv_new_uri(world, LV2_URID__map);
 
 	if (full_output) {
 		printf("# Block Samples Time Plugin\n");
@@ -216,13 +171,6 @@ main(int argc, char** argv)
 	}
 
 	lilv_node_free(urid_map);
-	lilv_node_free(lv2_OutputPort);
-	lilv_node_free(lv2_InputPort);
-	lilv_node_free(lv2_ControlPort);
-	lilv_node_free(lv2_CVPort);
-	lilv_node_free(lv2_AudioPort);
-	lilv_node_free(atom_Sequence);
-	lilv_node_free(atom_AtomPort);
 
 	lilv_world_free(world);
 
@@ -0,0 +1,181 @@
+/*
+  Lilv State Benchmark Plugin
+  Copyright 2016 David Robillard <d@drobilla.net>
+
+  Permission to use, copy, modify, and/or distribute this software for any
+  purpose with or without fee is hereby granted, provided that the above
+  copyright notice and this permission notice appear in all copies.
+
+  THIS SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+  WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+  MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+  ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+  WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+  ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+  OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "lv2/lv2plug.in/ns/ext/atom/atom.h"
+#include "lv2/lv2plug.in/ns/ext/options/options.h"
+#include "lv2/lv2plug.in/ns/ext/state/state.h"
+#include "lv2/lv2plug.in/ns/ext/urid/urid.h"
+#include "lv2/lv2plug.in/ns/lv2core/lv2.h"
+
+#define STATE_BENCH_URI "http://example.org/lilv-state-bench-plugin"
+
+/**
+   Synthetic plugin which saves and restores many small properties.
+
+   The number of properties is set with the STATE_BENCH_URI#properties option
+   (an atom:Int).  The output port is the number of properties found by the
+   last restore, so the host can check that the state was complete.
+*/
+typedef struct {
+	LV2_URID* keys;
+	uint32_t  n_keys;
+	LV2_URID  atom_Int;
+	LV2_URID  atom_Chunk;
+	float*    restored;
+	uint32_t  n_restored;
+} StateBench;
+
+static void
+cleanup(LV2_Handle instance)
+{
+	StateBench* plugin = (StateBench*)instance;
+	free(plugin->keys);
+	free(plugin);
+}
+
+static void
+connect_port(LV2_Handle instance,
+             uint32_t   port,
+             void*      data)
+{
+	StateBench* plugin = (StateBench*)instance;
+	if (port == 0) {
+		plugin->restored = (float*)data;
+	}
+}
+
+static LV2_Handle
+instantiate(const LV2_Descriptor*     descriptor,
+            double                    rate,
+            const char*               path,
+            const LV2_Feature* const* features)
+{
+	LV2_URID_Map*             map     = NULL;
+	const LV2_Options_Option* options = NULL;
+	for (int i = 0; features[i]; ++i) {
+		if (!strcmp(features[i]->URI, LV2_URID__map)) {
+			map = (LV2_URID_Map*)features[i]->data;
+		} else if (!strcmp(features[i]->URI, LV2_OPTIONS__options)) {
+			options = (const LV2_Options_Option*)features[i]->data;
+		}
+	}
+	if (!map) {
+		return NULL;
+	}
+
+	StateBench* plugin = (StateBench*)calloc(1, sizeof(StateBench));
+	plugin->atom_Int   = map->map(map->handle, LV2_ATOM__Int);
+	plugin->atom_Chunk = map->map(map->handle, LV2_ATOM__Chunk);
+	plugin->n_keys     = 5000;
+
+	const LV2_URID properties = map->map(
+		map->handle, STATE_BENCH_URI "#properties");
+	for (const LV2_Options_Option* o = options; o && o->key; ++o) {
+		if (o->key == properties && o->type == plugin->atom_Int) {
+			plugin->n_keys = (uint32_t)*(const int32_t*)o->value;
+		}
+	}
+
+	plugin->keys = (LV2_URID*)calloc(plugin->n_keys, sizeof(LV2_URID));
+	for (uint32_t i = 0; i < plugin->n_keys; ++i) {
+		char uri[64];
+		snprintf(uri, sizeof(uri), "urn:lilv-state-bench:property%u", i);
+		plugin->keys[i] = map->map(map->handle, uri);
+	}
+
+	return (LV2_Handle)plugin;
+}
+
+static void
+run(LV2_Handle instance, uint32_t sample_count)
+{
+	StateBench* plugin = (StateBench*)instance;
+	if (plugin->restored) {
+		*plugin->restored = (float)plugin->n_restored;
+	}
+}
+
+static LV2_State_Status
+save(LV2_Handle                instance,
+     LV2_State_Store_Function  store,
+     void*                     callback_data,
+     uint32_t                  flags,
+     const LV2_Feature* const* features)
+{
+	const StateBench* plugin    = (const StateBench*)instance;
+	const uint8_t     chunk[64] = { 0 };
+	for (uint32_t i = 0; i < plugin->n_keys; ++i) {
+		const int32_t value = (int32_t)i;
+		if (i % 2) {
+			store(callback_data, plugin->keys[i], chunk, sizeof(chunk),
+			      plugin->atom_Chunk, LV2_STATE_IS_POD|LV2_STATE_IS_PORTABLE);
+		} else {
+			store(callback_data, plugin->keys[i], &value, sizeof(value),
+			      plugin->atom_Int, LV2_STATE_IS_POD|LV2_STATE_IS_PORTABLE);
+		}
+	}
+	return LV2_STATE_SUCCESS;
+}
+
+static LV2_State_Status
+restore(LV2_Handle                  instance,
+        LV2_State_Retrieve_Function retrieve,
+        void*                       callback_data,
+        uint32_t                    flags,
+        const LV2_Feature* const*   features)
+{
+	StateBench* plugin = (StateBench*)instance;
+	plugin->n_restored = 0;
+	for (uint32_t i = 0; i < plugin->n_keys; ++i) {
+		size_t   size      = 0;
+		uint32_t type      = 0;
+		uint32_t val_flags = 0;
+		if (retrieve(callback_data, plugin->keys[i],
+		             &size, &type, &val_flags)) {
+			++plugin->n_restored;
+		}
+	}
+	return LV2_STATE_SUCCESS;
+}
+
+static const void*
+extension_data(const char* uri)
+{
+	static const LV2_State_Interface state = { save, restore };
+	return strcmp(uri, LV2_STATE__interface) ? NULL : &state;
+}
+
+static const LV2_Descriptor descriptor = {
+	STATE_BENCH_URI,
+	instantiate,
+	connect_port,
+	NULL, // activate,
+	run,
+	NULL, // deactivate,
+	cleanup,
+	extension_data
+};
+
+LV2_SYMBOL_EXPORT
+const LV2_Descriptor* lv2_descriptor(uint32_t index)
+{
+	return index == 0 ? &descriptor : NULL;
+}